@@ -26,13 +26,25 @@
 
 #include "constants.h"
 #include "adahrs_grtaa301.h"
+#include "wire_fields.h"
+
+// High rate primary data message
+//         name               offset  type      order    scale
+WIRE_FIELD(grtRoll,           4,      int16_t,  WIRE_BE, M_PI/32768);      // +/- PI radians: positive is right wing down
+WIRE_FIELD(grtPitch,          6,      int16_t,  WIRE_BE, M_PI/32768);      // +/- PI radians: positive nose up
+WIRE_FIELD(grtHeading,        8,      int16_t,  WIRE_BE, 180.0/32768);     // +/- 180 degrees
+WIRE_FIELD(grtPressureAlt,    10,     uint16_t, WIRE_BE, 1);               // feet + 5000
+WIRE_FIELD(grtVertSpeed,      12,     int16_t,  WIRE_BE, 1);               // fpm
+WIRE_FIELD(grtIas,            14,     int16_t,  WIRE_BE, 0.00987473002);   // fpm-->kts (1 feet per minute = 0.00987473002 knots)
+WIRE_FIELD(grtIasRate,        16,     int16_t,  WIRE_BE, 1);               // Airspeed acceleration
+WIRE_FIELD(grtSlipball,       18,     int16_t,  WIRE_BE, 1);               // +/-180 positive values right wind down
+WIRE_FIELD(grtZAccel,         20,     int16_t,  WIRE_BE, 1);               // Positive for aircraft accel upward, in sensor (aircraft) frame
 
 //#define ANGLE_CONV_FACTOR float(180.0/32768);
 //#define RADIAN_CONV_FACTOR float(M_PI/32768);
 //#define RADIAN_RATE_CONV_FACTOR float((M_PI/180) * (1200.0/32768));
 //#define ACCEL_G_CONV_FACTOR float(15.0/32768);
 //#define ACCEL_MS_CONV_FACTOR float(LOCAL_GRAVITY*15.0/32768);
-#define NUM_OF_MSG_TYPES  4
 #define HIGH_RATE_PRIMARY_DATA_MSG_LEN  23
 #define LOW_RATE_PRIMARY_DATA_MSG_LEN   21
 #define USER_CALIBRATION_MSG_LEN        25
@@ -43,6 +55,24 @@
 #define USER_CALIBRATION_MSG_HDR       "\x7F\xFF\xFC"
 #define MAINTENANCE_MSG_HDR            "\x7F\xFF\xFB"
 
+// Message types, used to tag frames coming back from the serial layer
+enum {
+    HIGH_RATE_PRIMARY_DATA_MSG,
+    LOW_RATE_PRIMARY_DATA_MSG,
+    USER_CALIBRATION_MSG,
+    MAINTENANCE_MSG
+};
+
+// Checksum is the inverted 8 bit sum of everything after the 0x7F 0xFF sync
+// bytes, sent as the last byte of the frame.
+static const frameDialect grtDialects[] = {
+  // type                         hdr                             hdrLen frameLen                        lenIdx/Bias checksum                start stop idx
+  { HIGH_RATE_PRIMARY_DATA_MSG,  HIGH_RATE_PRIMARY_DATA_MSG_HDR, 3,     HIGH_RATE_PRIMARY_DATA_MSG_LEN, 0, 0,       CHECKSUM_SUM8_INVERTED, 2,    21,  22 },
+  { LOW_RATE_PRIMARY_DATA_MSG,   LOW_RATE_PRIMARY_DATA_MSG_HDR,  3,     LOW_RATE_PRIMARY_DATA_MSG_LEN,  0, 0,       CHECKSUM_SUM8_INVERTED, 2,    19,  20 },
+  { USER_CALIBRATION_MSG,        USER_CALIBRATION_MSG_HDR,       3,     USER_CALIBRATION_MSG_LEN,       0, 0,       CHECKSUM_SUM8_INVERTED, 2,    23,  24 },
+  { MAINTENANCE_MSG,             MAINTENANCE_MSG_HDR,            3,     MAINTENANCE_MSG_LEN,            0, 0,       CHECKSUM_SUM8_INVERTED, 2,    34,  35 }
+};
+
 
 // NOTE/TODO: Didn't include some msg types that weren't used
 // in normal operation (i.e. calibration, ROM load, etc.)
@@ -51,11 +81,29 @@ using namespace std;
 
 adahrs_grtaa301::adahrs_grtaa301 (const char *port)
 {
-  // TODO: fix // ahrs_hardware::ahrs_hardware();
-  //good = FALSE;
+    good = FALSE;
+    status = 0;
+    pressure_alt = 0;
+    vert_speed_fpm = 0;
+    ias_kts = 0;
+    slip_ball = 0;
+    z_accel = 0;
+    frames = 0;
+    frame_stamp = 0;
+    airspeed_fresh = FALSE;
+    altitude_fresh = FALSE;
+    // The high rate message has no rates or accelerations the AHRS can use
+    ang_roll = ang_pitch = ang_head = 0;
+    accel_thrust = accel_yaw = 0;
+    accel_lift = LOCAL_GRAVITY;
+
     serialPtr = new serial(port, TRUE);
+    for (unsigned i=0; i<NELEMENTS(grtDialects); i++) {
+      serialPtr->addFrameDialect(grtDialects[i]);
+    }
     initialize();
-    //dt = GRT_FRAME_PERIOD;
+    dt = GRT_FRAME_PERIOD;
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
  }
 
 
@@ -65,141 +113,133 @@ void adahrs_grtaa301::initialize() {
 }
 
 
+int adahrs_grtaa301::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  return serial::scanDialects(grtDialects, NELEMENTS(grtDialects), buf, len, covered);
+}
+
+
+// Whichever instrument samples first reads the port for all of them
+bool adahrs_grtaa301::readFrames() {
+  bool newData = FALSE;
+  frameView view;
+  while (serialPtr->getFrameView(view)) {
+    // Parse the frame in place; only copied if it wrapped the ring
+    unsigned char scratch[MAINTENANCE_MSG_LEN];
+    parseMessage(view.type, view.linear(scratch), view.stamp);
+    newData = TRUE;
+  }
+  return newData;
+}
+
+
 // Returns TRUE if new data was available
 // or FALSE if the data remains unchanged as a result
 // of calling this function.
 bool adahrs_grtaa301::Sample() {
-  // Look for all msg types
-  int msgLen[] = {HIGH_RATE_PRIMARY_DATA_MSG_LEN,
-		  LOW_RATE_PRIMARY_DATA_MSG_LEN,
-		  USER_CALIBRATION_MSG_LEN,
-		  MAINTENANCE_MSG_LEN};
-
-  int idx[4];
-  while(1) {
-    idx[0] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)HIGH_RATE_PRIMARY_DATA_MSG_HDR, 3, HIGH_RATE_PRIMARY_DATA_MSG_LEN);
-    idx[1] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)LOW_RATE_PRIMARY_DATA_MSG_HDR, 3, LOW_RATE_PRIMARY_DATA_MSG_LEN);
-    idx[2] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)USER_CALIBRATION_MSG_HDR, 3, USER_CALIBRATION_MSG_LEN);
-    idx[3] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *) MAINTENANCE_MSG_HDR, 3, MAINTENANCE_MSG_LEN);
-
-    int tmpIdx = 1000000;
-    int frameLen = -1;
-    for (int i=0; i < NUM_OF_MSG_TYPES; i++) {
-      if (idx[i] == -1) continue;
-      if (DEBUG) printf("Found possible frame i=%d\n", i);
-      if (idx[i] < tmpIdx) {
-        tmpIdx = idx[i];
-        frameLen= msgLen[i];
-      }
-    }
+  readFrames();
+  return (queue_head != queue_tail);
+}
+
+
+bool adahrs_grtaa301::Sample(unsigned &value) {
+  readFrames();
+  if (!airspeed_fresh) return FALSE;
+  airspeed_fresh = FALSE;
+  value = (ias_kts > 0) ? (unsigned)(ias_kts + 0.5) : 0;
+  airspeed_hardware::sample_stamp = frame_stamp;
+  return TRUE;
+}
+
+
+bool adahrs_grtaa301::Sample(int &value) {
+  readFrames();
+  if (!altitude_fresh) return FALSE;
+  altitude_fresh = FALSE;
+  value = pressure_alt;
+  altitude_hardware::sample_stamp = frame_stamp;
+  return TRUE;
+}
 
-    unsigned char msg[36]; // 32 chars will take care of longest message.
-    memset(msg, '\0', 36); // terminate str
-    if (tmpIdx == 1000000) return FALSE; // No more messages found
-    serialPtr->getFrameFromBufAndShift(msg, tmpIdx, frameLen);
-    parseMessage(msg);
-  }
 
+bool adahrs_grtaa301::VerticalSpeed(float &fpm) {
+  fpm = vert_speed_fpm;
   return TRUE;
 }
 
 
+float adahrs_grtaa301::TimeBase() const {
+  return 1000000.0 / GRT_FRAME_PERIOD;
+}
+
+
 
-bool adahrs_grtaa301::parseMessage(unsigned char *msg) {
-  if (memcmp(msg,HIGH_RATE_PRIMARY_DATA_MSG_HDR,3) == 0) {
+// Frames arrive already matched and checksummed by the serial layer
+void adahrs_grtaa301::parseMessage(int msgType, const unsigned char *msg, unsigned stamp) {
+  switch (msgType) {
+  case HIGH_RATE_PRIMARY_DATA_MSG:
     if (DEBUG) printf("RECEIVED HIGH_RATE_PRIMARY_DATA_MSG: \n");
-    if (!checksumOk(msg, 2, 21, 22)) return FALSE;
-    handleHighRatePrimaryDataMsg(msg);
-    return TRUE;
-  }
-  else if (memcmp(msg,LOW_RATE_PRIMARY_DATA_MSG_HDR,3) == 0) {
+    handleHighRatePrimaryDataMsg(msg, stamp);
+    break;
+  case LOW_RATE_PRIMARY_DATA_MSG:
     if (DEBUG) printf("RECEIVED  LOW_RATE_PRIMARY_DATA_MSG: \n");
-    if (!checksumOk(msg, 2, 19, 20)) return FALSE;
     handleLowRatePrimaryDataMsg(msg);
-    return TRUE;
-  }
-  else if (memcmp(msg, USER_CALIBRATION_MSG_HDR,3) == 0) {
-  if (DEBUG) printf("RECEIVED  USER_CALIBRATION_MSG: \n");
-    if (!checksumOk(msg, 2, 23, 24)) return FALSE;
+    break;
+  case USER_CALIBRATION_MSG:
+    if (DEBUG) printf("RECEIVED  USER_CALIBRATION_MSG: \n");
     handleUserCalibrationMsg(msg);
-    return TRUE;
-  }
-  else if (memcmp(msg,MAINTENANCE_MSG_HDR,3) == 0) {
+    break;
+  case MAINTENANCE_MSG:
     if (DEBUG) printf("RECEIVED MAINTENANCE_MSG: \n");
-    if (!checksumOk(msg, 2, 38, 39)) return FALSE;
     handleMaintenanceMsg(msg);
-    return TRUE;
+    break;
   }
-  return FALSE;
-}
-
-
-bool adahrs_grtaa301::checksumOk(unsigned char *checkMsg, 
-				  int startIdx, 
-				  int stopIdx, 
-				  int checksumIdx) {
-  unsigned short sum = 0;
-  
-  for (int i=startIdx; i<=stopIdx; i++) {
-    sum += checkMsg[i];
-  }
-  //if (DEBUG) printf("Calculated raw checksum (no 1's complement yet): %d\n", sum);
-  // NOTE: Grand Rapids doesn't care about overflow/carries
-  // Use carries to compute 1's complement sum.
-  /*
-  sum = (sum >> 8) + (sum & 0x00FF);
-  sum += sum >> 8; // One final carry is possible
-  */
-
-  // Now invert the 8-bit result.
-  unsigned char calculatedChecksum = ((unsigned char) ~sum);
-
-  // Get the checksum included in the packet
-  unsigned char extractedChecksum = (unsigned char)checkMsg[checksumIdx];
-
-  if (calculatedChecksum != extractedChecksum) {
-    if (DEBUG) printf("CHECKSUM ERROR calculated:extracted  %d:%d\n", calculatedChecksum, extractedChecksum);
-    return FALSE;
-  }
-  return TRUE;
 }
 
 
 
-void adahrs_grtaa301::handleHighRatePrimaryDataMsg(unsigned char *msg) {
-  unsigned char status_byte = msg[3]; // = 0 for normal
-  printf("Status byte: %X\n", status_byte);
-  // TODO: make these use the inherited members where available
-  float roll_cooked =    (((short)(msg[4]<<8)  + (short)msg[5])) * M_PI/32768; // +/- PI radians: positive is right wing down
-  //printf("roll_raw = %d\n",   ((short)(msg[4]<<8)  + (short)msg[5]));
-  float pitch_cooked =   (((short)(msg[6]<<8)  + (short)msg[7])) * M_PI/32768; // +/- PI radians: positive nose up
-  int heading_cooked = (((short)msg[8]<<8) + (short)msg[9]) * 180/32768;
-  if (heading_cooked <= 0) heading_cooked += 360; // Change the scale from -180->180 to 0->360
-  int pressure_alt = (unsigned short)(msg[10]<<8)  + (unsigned short)msg[11] - 5000; // Convert for 5K offset
-  int vert_speed_fpm = (short)(msg[12]<<8)  + (short)msg[13];
-  float ias_kts = ((short)(msg[14]<<8)  + (short)msg[15]) * 0.00987473002; // fpm-->kts (1 feet per minute = 0.00987473002 knots)
-  // NOTE: don't really need right now //int ias_rate_fpm = ((short)(msg[16]<<8)  + (short)msg[17]); // Airspeed acceleration
-  int slipball_deg = ((short)(msg[18]<<8)  + (short)msg[19]); // +/-180 positive values right wind down
-  int z_g = ((short)(msg[20]<<8)  + (short)msg[21]); // Positive for aircraft accel upward, data is in sensor (aircraft) frame
-  // TODO: check scaling on z_g (look in spec to see if need normalize by 32k?)
-
-
-  printf("roll:pitch:heading    %6.4f:%6.4f:%d\n", roll_cooked, pitch_cooked, heading_cooked);
-  printf("pAlt:vertSpd:ias:incl:g    %d:%d:%4.1f:%d:%d\n", pressure_alt, vert_speed_fpm, ias_kts, slipball_deg, z_g);
-
+void adahrs_grtaa301::handleHighRatePrimaryDataMsg(const unsigned char *msg, unsigned stamp) {
+  status = msg[3]; // = 0 for normal
+  roll_cooked =    grtRoll::Get(msg);
+  pitch_cooked =   grtPitch::Get(msg);
+  heading_cooked = grtHeading::Get(msg) / DEGREES_PER_RADIAN;
+  if (heading_cooked <= 0) heading_cooked += 2*M_PI; // Change the scale from -PI->PI to 0->2PI
+  pressure_alt = grtPressureAlt::Raw(msg) - 5000; // Convert for 5K offset
+  vert_speed_fpm = grtVertSpeed::Raw(msg);
+  ias_kts = grtIas::Get(msg);
+  // NOTE: don't really need right now //int ias_rate_fpm = grtIasRate::Raw(msg);
+  slip_ball = grtSlipball::Raw(msg);
+  z_accel = grtZAccel::Raw(msg);
+  // TODO: check scaling on z_accel (look in spec to see if need normalize by 32k?)
+  good = (status == 0);
+  frames++;
+
+  // One decode serves every instrument
+  dt = (frame_stamp != 0) ? stamp - frame_stamp : GRT_FRAME_PERIOD;
+  frame_stamp = stamp;
+  ahrs_hardware::sample_stamp = stamp;
+  PushSample();
+  airspeed_fresh = TRUE;
+  altitude_fresh = TRUE;
+
+  if (DEBUG) {
+    printf("Status byte: %X\n", status);
+    printf("roll:pitch:heading    %6.4f:%6.4f:%6.4f\n", roll_cooked, pitch_cooked, heading_cooked);
+    printf("pAlt:vertSpd:ias:incl:g    %d:%d:%4.1f:%d:%d\n", pressure_alt, vert_speed_fpm, ias_kts, slip_ball, z_accel);
+  }
 }
 
-void adahrs_grtaa301::handleLowRatePrimaryDataMsg(unsigned char *msg) {
-  strcat((char *)msg,"FOO"); // get rid of warning for now
+void adahrs_grtaa301::handleLowRatePrimaryDataMsg(const unsigned char *msg) {
+  (void) msg; // get rid of warning for now
   // TODO:
 }
 
-void adahrs_grtaa301::handleUserCalibrationMsg(unsigned char *msg) {
-  strcat((char *)msg,"FOO"); // get rid of warning for now
+void adahrs_grtaa301::handleUserCalibrationMsg(const unsigned char *msg) {
+  (void) msg; // get rid of warning for now
   // TODO:
 }
 
-void adahrs_grtaa301::handleMaintenanceMsg(unsigned char *msg) {
-  strcat((char *)msg,"FOO"); // get rid of warning for now
+void adahrs_grtaa301::handleMaintenanceMsg(const unsigned char *msg) {
+  (void) msg; // get rid of warning for now
   // TODO:
 }
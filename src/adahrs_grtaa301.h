@@ -15,7 +15,13 @@
 //  along with this program; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
+
+#ifndef ADAHRS_GRTAA301_H
+#define ADAHRS_GRTAA301_H
+
 #include "ahrs.h"
+#include "airspeed.h"
+#include "altitude.h"
 #include "serial.h"
 
 // GRT_FRAME_PERIOD: microseconds between the samples sent out the com port
@@ -23,18 +29,37 @@
 #define GRT_FRAME_PERIOD  10000 // TODO: May need to tweak
 
 // This class interfaces with the Grand Rapids Technologies GRT-AA-0301 series device that provides
-// "cooked" AHRS and airdata.
-class adahrs_grtaa301 // TODO fix inheritance : public ahrs_hardware
+// "cooked" AHRS and airdata. One object is the hardware for the AHRS, the
+// airspeed and the altitude (and VSI) all at once: each frame is read and
+// decoded once, and every instrument gets its part of it the next time it
+// samples.
+class adahrs_grtaa301 : public ahrs_hardware,
+                        public airspeed_hardware,
+                        public altitude_hardware
 {
     public:
-        // public members
+        // Latest decoded values, for the instruments and for display
+        unsigned char   status;         // Status byte, 0 when normal
+        int             pressure_alt;   // Feet
+        int             vert_speed_fpm;
+        float           ias_kts;
+        int             slip_ball;      // +/- 180, positive is right wing down
+        int             z_accel;        // Raw; positive is upwards in the aircraft frame
+        unsigned        frames;         // High rate frames decoded
+
     protected:
 	serial *serialPtr;
+	unsigned frame_stamp;   // Arrival of the last high rate frame, 0 if none yet
+	// Set for each instrument when a frame is decoded, cleared when that
+	// instrument takes the values
+	bool airspeed_fresh;
+	bool altitude_fresh;
 
     public:
         /**
          * Sample
-         * DESCRIPTION:     Sample GRT ad-ahrs cooked data.
+         * DESCRIPTION:     Sample GRT ad-ahrs cooked data for the AHRS. Every
+         *                  high rate frame is queued (see NextSample).
          * PRE-CONDITIONS:  Connected to a valid GRT ad-ahrs device (powered up and connected).
          * POST-CONDITIONS: good flag is FALSE, or all public angle data is correct.
          * EXCEPTIONS THROWN:  NO_IO_BOARD, BAD_IO_DRIVER
@@ -45,8 +70,42 @@ class adahrs_grtaa301 // TODO fix inheritance : public ahrs_hardware
                         // of calling this function.
             Sample (void);
 
+        /**
+         * Sample
+         * DESCRIPTION:     airspeed_hardware and altitude_hardware: the
+         *                  indicated airspeed or pressure altitude from the
+         *                  latest frame
+         * PRE-CONDITIONS:  Connected to a valid GRT ad-ahrs device
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  NO_IO_BOARD, BAD_IO_DRIVER
+         * EXCEPTIONS HANDLED: None
+         */
+        virtual bool    // TRUE if a frame came in since the last call
+            Sample (unsigned &value);
+        virtual bool    // Same
+            Sample (int &value);
+
+        // altitude_hardware: the unit measures vertical speed itself
+        virtual bool VerticalSpeed (float &fpm);
+
+        // airspeed_hardware and altitude_hardware: frames per second
+        virtual float TimeBase (void) const;
+
         adahrs_grtaa301(const char *port);
 
+        /**
+         * Recognize
+         * DESCRIPTION:     Counts the frames of any of the unit's message
+         *                  types, checksums good, in bytes heard on a port
+         *                  (see port_detect.h)
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of bytes in those frames
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        static int      // Good frames found
+            Recognize (const unsigned char *buf, int len, int &covered);
+
 
     protected:
         /**
@@ -59,6 +118,17 @@ class adahrs_grtaa301 // TODO fix inheritance : public ahrs_hardware
          */
 	void initialize(void);
 
+        /**
+         * readFrames
+         * DESCRIPTION:    Decodes every frame waiting at the port, whichever
+         *                 instrument is sampling
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  Read errors from the port
+         * EXCEPTIONS HANDLED: None
+         */
+	bool readFrames(void);
+
         /**
          * parseMessage
          * DESCRIPTION:    Extracts data from serial frame and sets members
@@ -67,12 +137,12 @@ class adahrs_grtaa301 // TODO fix inheritance : public ahrs_hardware
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-	bool parseMessage(unsigned char*);
+	void parseMessage(int msgType, const unsigned char *msg, unsigned stamp);
 
-	void handleHighRatePrimaryDataMsg(unsigned char *msg);
-	void handleLowRatePrimaryDataMsg(unsigned char *msg);
-	void handleUserCalibrationMsg(unsigned char *msg);
-	void handleMaintenanceMsg(unsigned char *msg);
-	bool checksumOk(unsigned char *checkMsg, int startIdx, int stopIdx, int checksumIdx);
+	void handleHighRatePrimaryDataMsg(const unsigned char *msg, unsigned stamp);
+	void handleLowRatePrimaryDataMsg(const unsigned char *msg);
+	void handleUserCalibrationMsg(const unsigned char *msg);
+	void handleMaintenanceMsg(const unsigned char *msg);
 };
 
+#endif /* ADAHRS_GRTAA301_H */
@@ -40,23 +40,30 @@
  */
 void ahrs::SampleAndCompute (void)
 {
+    unsigned    start;
 
     if (data_source == NULL)
         ThrowException (NO_IO_BOARD);
     if (data_source->Sample() == FALSE)
         return;         // No new sensor data available, so don't compute anything
 
-    /******  Compute AHRS from raw sensor data  *******/
-    if (TheGPS->good) {
-        compute_pitch(data_source->dt, TheGPS->delta_v);
-        good = TRUE;
-    } else {
-        compute_pitch(data_source->dt, 0);
-        good = FALSE;
+    /******  Compute AHRS from raw sensor data, one reading at a time  *******/
+    start = monotonic_us ();
+    while (data_source->NextSample ())
+    {
+        if (TheGPS->good) {
+            compute_pitch(data_source->dt, TheGPS->delta_v);
+            good = TRUE;
+        } else {
+            compute_pitch(data_source->dt, 0);
+            good = FALSE;
+        }
+        compute_roll_flying (data_source->dt);
+        compute_heading_flying (data_source->dt);
+        compute_yaw();
+        samples_computed++;
     }
-    compute_roll_flying (data_source->dt);
-    compute_heading_flying (data_source->dt);
-    compute_yaw();
+    compute_us += monotonic_us () - start;
 
 //    static int i = 0;
 //    if ((++i % 100) == 0)
@@ -81,6 +88,7 @@ void ahrs::SampleAndCompute (void)
  */
 void ahrs::SampleAndComputeStill (void)
 {
+    unsigned    start;
 
     if (data_source == NULL)
         ThrowException (NO_IO_BOARD);
@@ -88,10 +96,16 @@ void ahrs::SampleAndComputeStill (void)
         return;         // No new sensor data available, so don't compute anything
 
     /******  Compute AHRS from raw sensor data  *******/
-    compute_pitch(0, 0);
-    compute_roll_still ();
-    compute_heading_still ();
-    compute_yaw();
+    start = monotonic_us ();
+    while (data_source->NextSample ())
+    {
+        compute_pitch(0, 0);
+        compute_roll_still ();
+        compute_heading_still ();
+        compute_yaw();
+        samples_computed++;
+    }
+    compute_us += monotonic_us () - start;
 }
 
 /**
@@ -366,6 +380,9 @@ ahrs::ahrs (void)
 
     noise_constant = 0;
     yaw_roll_constant = 0;
+
+    samples_computed = 0;
+    compute_us = 0;
     
     data_source = NULL;
 }
@@ -385,5 +402,72 @@ ahrs_hardware::Sample (void)
 {
     ThrowException (NO_IO_BOARD);
 }
+
+bool ahrs_hardware::NextSample (void)
+{
+    if (queue_head == queue_tail)
+        return (FALSE);
+    const ahrs_sample  &s = queue [queue_head++ & (AHRS_SAMPLE_QUEUE_LEN - 1)];
+    accel_thrust = s.accel_thrust;
+    accel_yaw = s.accel_yaw;
+    accel_lift = s.accel_lift;
+    ang_roll = s.ang_roll;
+    ang_pitch = s.ang_pitch;
+    ang_head = s.ang_head;
+    roll_cooked = s.roll_cooked;
+    pitch_cooked = s.pitch_cooked;
+    heading_cooked = s.heading_cooked;
+    good = s.good;
+    dt = s.dt;
+    sample_stamp = s.stamp;
+    return (TRUE);
+}
+
+
+void ahrs_hardware::PushSample (const ahrs_sample &s)
+{
+    if (queue_tail - queue_head == AHRS_SAMPLE_QUEUE_LEN)
+    {
+        // Filter is behind; lose the oldest reading but not its time
+        unsigned carried_dt = queue [queue_head++ & (AHRS_SAMPLE_QUEUE_LEN - 1)].dt;
+        queue [queue_head & (AHRS_SAMPLE_QUEUE_LEN - 1)].dt += carried_dt;
+        samples_dropped++;
+    }
+    queue [queue_tail++ & (AHRS_SAMPLE_QUEUE_LEN - 1)] = s;
+}
+
+
+void ahrs_hardware::PushSample (void)
+{
+    ahrs_sample s;
+    SaveSample (s);
+    PushSample (s);
+}
+
+
+void ahrs_hardware::SaveSample (ahrs_sample &s) const
+{
+    s.accel_thrust = accel_thrust;
+    s.accel_yaw = accel_yaw;
+    s.accel_lift = accel_lift;
+    s.ang_roll = ang_roll;
+    s.ang_pitch = ang_pitch;
+    s.ang_head = ang_head;
+    s.roll_cooked = roll_cooked;
+    s.pitch_cooked = pitch_cooked;
+    s.heading_cooked = heading_cooked;
+    s.good = good;
+    s.dt = dt;
+    s.stamp = sample_stamp;
+}
+
+
 ahrs_hardware::ahrs_hardware (void)
-{ang_scale = M_PI / 180.0; accel_scale = 1.0;}
+{
+    ang_scale = M_PI / 180.0;
+    accel_scale = 1.0;
+    sample_stamp = 0;
+    queue_head = 0;
+    queue_tail = 0;
+    samples_dropped = 0;
+}
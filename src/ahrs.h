@@ -24,6 +24,10 @@
 // Hardware abstraction class:
 class ahrs_hardware;
 
+// Readings the hardware has queued for the filter. MUST be a power of two;
+// 64 is 0.64 s of the xbow's 100 Hz frames.
+#define AHRS_SAMPLE_QUEUE_LEN   64
+
 // Behavior abstraction class:
 // This parent class assumes raw e-gyro and accelerometer data.
 // If the actual sensor presents pre-cooked data, override the comput_* functions
@@ -46,6 +50,9 @@ class ahrs
 
         unsigned        duty_cycle;
 
+        unsigned        samples_computed;       // Hardware samples filtered so far
+        unsigned        compute_us;             // Time spent filtering them
+
     protected:
         // noise_constant = some value greater than drift introduced by random noise.
         //                  for angular rate sensors.
@@ -226,6 +233,23 @@ class ahrs
 
 extern ahrs    *TheAHRS;
 
+// ahrs_sample: One reading, as queued by ahrs_hardware::PushSample
+struct ahrs_sample
+{
+    float           accel_thrust;
+    float           accel_yaw;
+    float           accel_lift;
+    float           ang_roll;
+    float           ang_pitch;
+    float           ang_head;
+    float           roll_cooked;
+    float           pitch_cooked;
+    float           heading_cooked;
+    bool            good;
+    unsigned        dt;
+    unsigned        stamp;
+};
+
 // Hardware abstraction class:
 class ahrs_hardware
 {
@@ -262,11 +286,64 @@ class ahrs_hardware
                         // of calling this function.
             Sample (void);
 
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the data returned by the last successful
+         *                  Sample arrived (monotonic_us), or 0 if this
+         *                  hardware doesn't know.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
+        /**
+         * NextSample
+         * DESCRIPTION:     Takes the oldest reading Sample queued and puts
+         *                  it in the public members above (dt, good and
+         *                  SampleStamp included), so the filter can run
+         *                  once per reading the hardware sent.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE if there was nothing queued
+            NextSample (void);
+
+        unsigned        samples_dropped;        // Readings lost to a full queue
+
         ahrs_hardware ();
 
     protected:
         // File descriptor open to I/O board
         int             io_board_fd;
+        unsigned        sample_stamp;           // See SampleStamp
+        // Readings waiting for NextSample, oldest at queue_head
+        ahrs_sample     queue [AHRS_SAMPLE_QUEUE_LEN];
+        unsigned        queue_head;
+        unsigned        queue_tail;
+
+        /**
+         * PushSample
+         * DESCRIPTION:     Queues a reading for NextSample (by default the
+         *                  public members as they stand). If the queue is
+         *                  full the oldest reading is dropped and its dt
+         *                  added to the next one, so the filter still
+         *                  integrates over the whole time.
+         * PRE-CONDITIONS:  dt and stamp describe this reading
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void PushSample (const ahrs_sample &s);
+        void PushSample (void);
+
+        // Copies the public members (and sample_stamp) into "s"
+        void SaveSample (ahrs_sample &s) const;
         float           ang_scale;
         float           accel_scale;
 };
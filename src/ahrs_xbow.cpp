@@ -26,12 +26,27 @@
 
 #include "constants.h"
 #include "ahrs_xbow.h"
-
-#define ANGLE_CONV_FACTOR float(180.0/32768);
-#define RADIAN_CONV_FACTOR float(M_PI/32768);
-#define RADIAN_RATE_CONV_FACTOR float((M_PI/180) * (1200.0/32768));
-#define ACCEL_G_CONV_FACTOR float(15.0/32768);
-#define ACCEL_MS_CONV_FACTOR float(LOCAL_GRAVITY*15.0/32768);
+#include "wire_fields.h"
+
+#define ANGLE_CONV_FACTOR float(180.0/32768)
+#define RADIAN_CONV_FACTOR float(M_PI/32768)
+#define RADIAN_RATE_CONV_FACTOR float((M_PI/180) * (1200.0/32768))
+#define ACCEL_G_CONV_FACTOR float(15.0/32768)
+#define ACCEL_MS_CONV_FACTOR float(LOCAL_GRAVITY*15.0/32768)
+
+// Angle mode data frame
+//         name               offset  type      order    scale
+WIRE_FIELD(xbowRoll,          2,      int16_t,  WIRE_BE, RADIAN_CONV_FACTOR);      // radians
+WIRE_FIELD(xbowPitch,         4,      int16_t,  WIRE_BE, RADIAN_CONV_FACTOR);
+WIRE_FIELD(xbowHeading,       6,      int16_t,  WIRE_BE, RADIAN_CONV_FACTOR);
+WIRE_FIELD(xbowRollRate,      8,      int16_t,  WIRE_BE, RADIAN_RATE_CONV_FACTOR); // radians/sec
+WIRE_FIELD(xbowPitchRate,     10,     int16_t,  WIRE_BE, RADIAN_RATE_CONV_FACTOR);
+WIRE_FIELD(xbowYawRate,       12,     int16_t,  WIRE_BE, RADIAN_RATE_CONV_FACTOR);
+WIRE_FIELD(xbowAccelX,        14,     int16_t,  WIRE_BE, ACCEL_MS_CONV_FACTOR);    // m/s^2
+WIRE_FIELD(xbowAccelY,        16,     int16_t,  WIRE_BE, ACCEL_MS_CONV_FACTOR);
+WIRE_FIELD(xbowAccelZ,        18,     int16_t,  WIRE_BE, ACCEL_MS_CONV_FACTOR);
+WIRE_FIELD(xbowModel,         20,     int16_t,  WIRE_BE, 1);
+WIRE_FIELD(xbowStatus,        22,     uint16_t, WIRE_BE, 1);
 
 using namespace std;
 
@@ -40,9 +55,13 @@ ahrs_xbow::ahrs_xbow (const char *port)
     ahrs_hardware::ahrs_hardware();
 
     good = FALSE;
+    frame_stamp = 0;
+    run_stamp = 0;
+    run_step = XBOW_FRAME_PERIOD;
     serialPtr = new serial(port, TRUE);
     initialize();
     dt = XBOW_FRAME_PERIOD;
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
  }
 
 ahrs_xbow::ahrs_xbow ()
@@ -71,6 +90,18 @@ void ahrs_xbow::initialize() {
 }
 
 
+// The one frame the unit sends in AHRS mode, as the framer and
+// parseDataFrame see it
+static const frameDialect xbowDialect =
+  // type hdr           hdrLen frameLen lenIdx/Bias checksum           start stop idx
+  { 0,    {0xAA, 0x55}, 2,     26,      0, 0,       CHECKSUM_SUM16_BE, 2,    23,  24 };
+
+int ahrs_xbow::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  return serial::scanDialects(&xbowDialect, 1, buf, len, covered);
+}
+
+
 /**
  * Sample
  * DESCRIPTION:     Sample xbow data.
@@ -85,23 +116,64 @@ bool    // Returns TRUE if new data was available
 ahrs_xbow::Sample (void)
 {
   unsigned char framePtr[256];
-  // Keep reading frames as longs as returning good ones...
+  unsigned stamp = 0;
+  ahrs_sample run[AHRS_SAMPLE_QUEUE_LEN]; // Frames out of the same read
+  int runLen = 0;
+  bool newData = FALSE;
+  // Every good frame is queued for the filter (see NextSample), so none of
+  // the 100 Hz data is lost however often Sample is called.
   try {
-    while(serialPtr->getFrame(framePtr) == TRUE) {
-      continue;
+    while(serialPtr->getFrame(framePtr, &stamp) == TRUE) {
+      if (parseDataFrame(framePtr) == FALSE) continue;
+      if (runLen > 0 && (stamp != run[0].stamp || runLen == (int)NELEMENTS(run))) {
+        queueRun(run, runLen);
+        runLen = 0;
+      }
+      sample_stamp = stamp;
+      SaveSample(run[runLen++]);
+      newData = TRUE;
     }
   }
   catch(string errStr) {
     fprintf(stderr, errStr.c_str());
     serialPtr->initializePort(); // Always try to put port back in good state if any probs
-    return FALSE;
   }
+  if (runLen > 0) queueRun(run, runLen);
+  return newData;
+}
+
+
+// Frames that came out of one read all carry that read's stamp, although
+// the unit sent them XBOW_FRAME_PERIOD apart. Spread them back out so each
+// one is integrated over its own share of the time since the frame before.
+void ahrs_xbow::queueRun(ahrs_sample *run, int n) {
+  unsigned stamp = run[0].stamp;
 
-  // Now parse the most recent data frame you just found.
-  if ( parseDataFrame(framePtr) == TRUE ) {
-    return TRUE;
+  // The rest of a read whose first frames were queued already (the run
+  // filled up, or Sample returned in between) has no time of its own left:
+  // carry on at that read's step, and take the overrun off the next read
+  if (frame_stamp != 0 && stamp == run_stamp) {
+    for (int i = 0; i < n; i++) {
+      run[i].dt = run_step;
+      PushSample(run[i]);
+    }
+    frame_stamp += n * run_step;
+    return;
   }
-  return FALSE;
+
+  int since = (frame_stamp != 0) ? (int)(stamp - frame_stamp) : n * XBOW_FRAME_PERIOD;
+  if (since < n) since = n; // Overrun still not taken up; keep every dt non-zero
+  int step = XBOW_FRAME_PERIOD;
+  if (since < n * step) step = since / n; // Came in faster than the unit's rate
+
+  // Any gap beyond the unit's rate (lost frames, or the port going unread)
+  // goes to the first frame
+  for (int i = 0; i < n; i++) run[i].dt = step;
+  run[0].dt = since - (n - 1) * step;
+  for (int i = 0; i < n; i++) PushSample(run[i]);
+  frame_stamp = stamp;
+  run_stamp = stamp;
+  run_step = step;
 }
 
 
@@ -109,23 +181,23 @@ ahrs_xbow::Sample (void)
 
 
 bool ahrs_xbow::parseDataFrame(unsigned char *framePtr) {
-  if (serial::checksumGood(framePtr,2,23,24) == FALSE) return FALSE;
+  if (serialPtr->portChecksumGood(framePtr,2,23,24) == FALSE) return FALSE;
   // TODO: set member variables
   // TODO: check conversion because python scripts differ by a degree sometimes (rounding???)
-  roll_cooked =    (((short)(framePtr[2]<<8)  + (short)framePtr[3])) * RADIAN_CONV_FACTOR; // radians
-  pitch_cooked =   (((short)(framePtr[4]<<8)  + (short)framePtr[5])) * RADIAN_CONV_FACTOR;
-  heading_cooked = (((short)(framePtr[6]<<8)  + (short)framePtr[7])) * RADIAN_CONV_FACTOR;
+  roll_cooked =    xbowRoll::Get(framePtr); // radians
+  pitch_cooked =   xbowPitch::Get(framePtr);
+  heading_cooked = xbowHeading::Get(framePtr);
   //short hdg_raw = ((short)(framePtr[6]<<8)  + (short)framePtr[7]);
   //printf("Heading raw: %d\n", hdg_raw);
   if (heading_cooked <= 0) heading_cooked += 2*M_PI; // Change the scale from -PI->PI to 0->2PI
-  ang_roll =     (((short)(framePtr[8]<<8)  + (short)framePtr[9]))  * RADIAN_RATE_CONV_FACTOR; // radians/sec
-  ang_pitch =    (((short)(framePtr[10]<<8) + (short)framePtr[11])) * RADIAN_RATE_CONV_FACTOR;
-  ang_head =      (((short)(framePtr[12]<<8) + (short)framePtr[13])) * RADIAN_RATE_CONV_FACTOR;
-  accel_yaw =  (((short)(framePtr[14]<<8) + (short)framePtr[15])) * ACCEL_MS_CONV_FACTOR; // g's
-  accel_lift =  (((short)(framePtr[16]<<8) + (short)framePtr[17])) * ACCEL_MS_CONV_FACTOR; // g's
-  accel_thrust =  (((short)(framePtr[18]<<8) + (short)framePtr[19])) * ACCEL_MS_CONV_FACTOR; // g's
-  int model_num =     ((short)(framePtr[20]<<8)  + (short)framePtr[21]); 
-  int status_short =     ((short)(framePtr[22]<<8)  + (short)framePtr[23]); 
+  ang_roll =     xbowRollRate::Get(framePtr); // radians/sec
+  ang_pitch =    xbowPitchRate::Get(framePtr);
+  ang_head =     xbowYawRate::Get(framePtr);
+  accel_yaw =    xbowAccelX::Get(framePtr);
+  accel_lift =   xbowAccelY::Get(framePtr);
+  accel_thrust = xbowAccelZ::Get(framePtr);
+  int model_num =    xbowModel::Raw(framePtr);
+  int status_short = xbowStatus::Raw(framePtr);
   
   // Status bits
   int hard_failure      = status_short & 0x0001;
@@ -150,7 +222,7 @@ bool ahrs_xbow::parseDataFrame(unsigned char *framePtr) {
 
 
 
-  printf("roll/pitch/heading angle %f/%f/%f\n", roll_cooked, pitch_cooked, heading_cooked);
+  if (DEBUG) printf("roll/pitch/heading angle %f/%f/%f\n", roll_cooked, pitch_cooked, heading_cooked);
   /*printf("model_num: %d\n", model_num);
   printf("status flags %d:%d:%d:%d:%d:%d:%d:%d\n", 
          hard_failure, soft_failure, not_ready, power_fail, 
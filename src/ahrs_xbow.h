@@ -29,6 +29,9 @@ class ahrs_xbow : public ahrs_hardware
         // public members
     protected:
 	serial *serialPtr;
+	unsigned frame_stamp;   // Time the queued frames are integrated up to, 0 if none yet
+	unsigned run_stamp;     // Stamp of the last run's read
+	unsigned run_step;      // dt given to the frames of that read
 
     public:
         /**
@@ -47,6 +50,18 @@ class ahrs_xbow : public ahrs_hardware
         ahrs_xbow(void);
         ahrs_xbow(const char *port);
 
+        /**
+         * Recognize
+         * DESCRIPTION:     Counts the 0xAA55 data frames with good checksums
+         *                  in bytes heard on a port (see port_detect.h)
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of bytes in those frames
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        static int      // Good frames found
+            Recognize (const unsigned char *buf, int len, int &covered);
+
 
     protected:
         //float           thrust_vec;
@@ -71,5 +86,17 @@ class ahrs_xbow : public ahrs_hardware
          * EXCEPTIONS HANDLED: None
          */
 	bool parseDataFrame(unsigned char*);
+
+        /**
+         * queueRun
+         * DESCRIPTION:    Sets the dt of "n" frames read at the same time and
+         *                 queues them for the filter
+         * PRE-CONDITIONS:  All "n" have the same stamp
+         * POST-CONDITIONS: frame_stamp is their stamp, or past it if they
+         *                  are the rest of a read already queued
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	void queueRun(ahrs_sample *run, int n);
 };
 
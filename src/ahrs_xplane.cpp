@@ -24,7 +24,6 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
-#include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -37,7 +36,76 @@
 
 #include "ahrs_xplane.h"
 
-char    rcv_buffer [1500];
+// Decoder of each record type the AHRS takes, NULL for the rest
+ahrs_xplane::recordDecoder ahrs_xplane::decoders [XPLANE_MAX_TYPES];
+
+
+void ahrs_xplane::DecodeThrust (const unsigned char *record, unsigned)
+{
+    thrust_vec = xplaneValue (record, 0) +
+                 xplaneValue (record, 1) +
+                 xplaneValue (record, 2) +
+                 xplaneValue (record, 3);
+}
+
+
+void ahrs_xplane::DecodeForces (const unsigned char *record, unsigned)
+{
+    accel_lift = xplaneValue (record, 0) * accel_scale;
+    // These readings are inaccurate from X-Plane: accel_thrust = (thrust_vec - xplaneValue (record, 1)) * accel_scale;
+    accel_thrust = 0;
+    accel_yaw = xplaneValue (record, 2) * accel_scale;
+}
+
+
+void ahrs_xplane::DecodeRates (const unsigned char *record, unsigned stamp)
+{
+    ang_pitch = xplaneValue (record, 0) * ang_scale;
+    ang_roll = xplaneValue (record, 1) * ang_scale;
+    ang_head = xplaneValue (record, 2) * ang_scale;
+    // Rates are integrated over the real gap between records
+    if (rate_stamp == 0)
+        dt += XP_FRAME_RATE * 1000;
+    else
+        dt += stamp - rate_stamp;
+    rate_stamp = stamp;
+}
+
+
+void ahrs_xplane::DecodeAttitude (const unsigned char *record, unsigned stamp)
+{
+    //printf ("PRH:\n"
+    //        "  %15f%15f%15f%15f\n"
+    //        "  %15f%15f%15f%15f\n",
+    //        xplaneValue (record, 0),
+    //        xplaneValue (record, 1),
+    //        xplaneValue (record, 2),
+    //        xplaneValue (record, 3),
+    //        xplaneValue (record, 4),
+    //        xplaneValue (record, 5),
+    //        xplaneValue (record, 6),
+    //        xplaneValue (record, 7));
+    pitch_cooked = xplaneValue (record, 0) * ang_scale;
+    roll_cooked = xplaneValue (record, 1) * ang_scale;
+    heading = xplaneValue (record, 3);
+    heading_cooked = heading * ang_scale;
+    sample_stamp = stamp;
+    good = TRUE;
+}
+
+
+bool ahrs_xplane::Decode (int type, const unsigned char *record, unsigned stamp)
+{
+    if (type < 0 || type >= XPLANE_MAX_TYPES || decoders [type] == NULL)
+    {
+        // Another row ticked in X-Plane's data output screen, most likely
+        unknown_records++;
+        return (FALSE);
+    }
+    (this->*decoders [type]) (record, stamp);
+    return (TRUE);
+}
+
 
 /**
  * Sample
@@ -52,81 +120,27 @@ bool    // Returns TRUE if new data was available
                 // of calling this function.
 ahrs_xplane::Sample (void)
 {
-    struct sockaddr_in          lp;
-    int                         size, fromlen;
     int                         type;
+    const unsigned char        *record;
+    unsigned                    stamp, n;
     bool                        ret;
 
-    lp.sin_family = AF_INET;
-    lp.sin_port = 49000;
-    lp.sin_addr.s_addr = INADDR_LOOPBACK;
-
-    fromlen = sizeof (lp);
-
     dt = 0;
 
-    assert (sizeof(int) == sizeof(float));
     ret = FALSE;
-    while (1)
-    {
-        size = recvfrom (io_board_fd, rcv_buffer, sizeof (rcv_buffer), 0,
-                         (struct sockaddr*) &lp, (socklen_t*)&fromlen);
-        if (size == -1)
-            break;
-
-        ret = TRUE;
-        memcpy (&type, rcv_buffer, sizeof(type));
-        switch (type)
-        {
-            case XPT_ENG_THRUST:
-                thrust_vec = ((float*)rcv_buffer) [1] +
-                             ((float*)rcv_buffer) [2] +
-                             ((float*)rcv_buffer) [3] +
-                             ((float*)rcv_buffer) [4];
-                break;
-            case XPT_AERO_FORCE:
-                accel_lift = ((float*)rcv_buffer) [1] * accel_scale;
-                // These readings are inaccurate from X-Plane: accel_thrust = (thrust_vec - ((float*)rcv_buffer) [2]) * accel_scale;
-                accel_thrust = 0;
-                accel_yaw = ((float*)rcv_buffer) [3] * accel_scale;
-                break;
-            case XPT_ANG_VEL:
-                ang_pitch = ((float*)rcv_buffer) [1] * ang_scale;
-                ang_roll = ((float*)rcv_buffer) [2] * ang_scale;
-                ang_head = ((float*)rcv_buffer) [3] * ang_scale;
-                dt += XP_FRAME_RATE * 1000;
-                break;
-            case XPT_PRH:
-                //printf ("PRH:\n"
-                //        "  %15f%15f%15f%15f\n"
-                //        "  %15f%15f%15f%15f\n",
-                //        ((float*)rcv_buffer) [1],
-                //        ((float*)rcv_buffer) [2],
-                //        ((float*)rcv_buffer) [3],
-                //        ((float*)rcv_buffer) [4],
-                //        ((float*)rcv_buffer) [5],
-                //        ((float*)rcv_buffer) [6],
-                //        ((float*)rcv_buffer) [7],
-                //        ((float*)rcv_buffer) [8]);
-                pitch_cooked = ((float*)rcv_buffer) [1] * ang_scale;
-                roll_cooked = ((float*)rcv_buffer) [2] * ang_scale;
-                heading_cooked = ((float*)rcv_buffer) [4] * ang_scale;
-                heading = ((float*)rcv_buffer) [4];
-                good = TRUE;
-                break;
-            default:
-                ThrowException (INVALID_MSG);
-                break;
-        }
-    }
+    while (source->Next (type, record, stamp, n))
+        if (Decode (type, record, stamp))
+            ret = TRUE;
+
+    // The records that came in together make up one reading
+    if (ret)
+        PushSample ();
     return (ret);
 }
 
 
 ahrs_xplane::ahrs_xplane ()
 {
-    struct sockaddr_in  lcl;
-
     ahrs_hardware::ahrs_hardware();
 
     accel_scale = NEWTON_PER_LBF / AIRCRAFT_WEIGHT;
@@ -135,16 +149,17 @@ ahrs_xplane::ahrs_xplane ()
     accel_lift = 9.8;
     heading = 0;
     good = FALSE;
+    rate_stamp = 0;
+    unknown_records = 0;
 
-    io_board_fd = socket (PF_INET, SOCK_DGRAM, 0);
-    if (io_board_fd == -1)
+    if (decoders [XPT_PRH] == NULL)
     {
-        perror ("ahrs_xplane: socket");
-        ThrowException(errno);
+        decoders [XPT_ENG_THRUST] = &ahrs_xplane::DecodeThrust;
+        decoders [XPT_AERO_FORCE] = &ahrs_xplane::DecodeForces;
+        decoders [XPT_ANG_VEL] = &ahrs_xplane::DecodeRates;
+        decoders [XPT_PRH] = &ahrs_xplane::DecodeAttitude;
     }
-    lcl.sin_family = AF_INET;
-    lcl.sin_port = htons (48001);
-    lcl.sin_addr.s_addr = htonl (INADDR_ANY);
 
-    bind (io_board_fd, (struct sockaddr*) &lcl, sizeof (lcl)); fcntl (io_board_fd, F_SETFL, O_NONBLOCK);
+    source = new xplane_source (XPLANE_AHRS, 48001, "ahrs_xplane");
+    io_board_fd = source->Fd ();
 }
@@ -16,6 +16,7 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
+#include "xplane_ingest.h"
 #include "ahrs.h"
 
 #define AIRCRAFT_WEIGHT 1513.6  /* Kg */
@@ -38,7 +39,31 @@ class ahrs_xplane : public ahrs_hardware
                         // of calling this function.
             Sample (void);
 
+        /**
+         * Decode
+         * DESCRIPTION:     Takes one record. Types the AHRS has no use for
+         *                  are counted in unknown_records and skipped.
+         * PRE-CONDITIONS:  record is the record's 8 values (see xplaneValue)
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE if the type was skipped
+            Decode (int type, const unsigned char *record, unsigned stamp);
+
         ahrs_xplane (void);
+
+        unsigned        unknown_records;        // Records skipped by Decode
     protected:
+        typedef void (ahrs_xplane::*recordDecoder) (const unsigned char *record, unsigned stamp);
+        static recordDecoder decoders [XPLANE_MAX_TYPES];
+
+        void    DecodeThrust (const unsigned char *record, unsigned stamp);
+        void    DecodeForces (const unsigned char *record, unsigned stamp);
+        void    DecodeRates (const unsigned char *record, unsigned stamp);
+        void    DecodeAttitude (const unsigned char *record, unsigned stamp);
+
+        xplane_source  *source;
         float           thrust_vec;
+        unsigned        rate_stamp;     // Arrival of the last XPT_ANG_VEL record
 };
@@ -19,24 +19,13 @@
 #include <stdio.h>
 
 #include "exceptions.h"
+#include "utilities.h"
 
 #include "airspeed.h"
 
 airspeed::airspeed (void)
 {
-    static float        das_filt [20];
-    unsigned            i;
-    float               tap;
-
-    tap = .5;
-    for (i = 0; i < NELEMENTS(das_filt)-1; i++)
-    {
-        das_filt [i] = tap;
-        tap /= 2;
-    }
-    das_filt [NELEMENTS(das_filt)-1] = das_filt [NELEMENTS(das_filt)-2]; 
     hw = NULL;
-    diff = new differentiate (100, das_filt, NELEMENTS(das_filt));
 }
 
 /**
@@ -54,14 +43,17 @@ void airspeed::Update (void)
         ThrowException (NO_IO_BOARD);
     if (hw->Sample (as))
     {
-        float   das;
-        diff->AddSample ((int)as);
-        das = diff->Differentiate();
-        as_prime = das * sample_rate;
+        // Differentiate over when the readings actually arrived, not
+        // over how often we expected to call Update
+        unsigned stamp = hw->SampleStamp ();
+        if (stamp == 0)
+            stamp = monotonic_us ();
+        diff.AddSample ((int)as, stamp);
+        as_prime = diff.Rate ();
         good = TRUE;
         // TODO: Add FDR function call here
-        //printf ("Airspeed = %5u, das = %10f, sample_rate = %8f, as_prime = %8f\n",
-        //        as, das, sample_rate, as_prime);
+        //printf ("Airspeed = %5u, sample_rate = %8f, as_prime = %8f\n",
+        //        as, sample_rate, as_prime);
     }
 }
 
@@ -125,6 +117,7 @@ airspeed::DutyCycle
 airspeed_hardware::airspeed_hardware (void)
 {
     as_scale = 1.0;
+    sample_stamp = 0;
 }
 
 /**
@@ -15,8 +15,11 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
+#ifndef AIRSPEED_H
+#define AIRSPEED_H
+
 #include "syntax_error.h"
-#include "differentiate.h"
+#include "fixed_differentiate.h"
 
 #define AIRSPEED_IDEAL_SAMPLE_PERIOD 500000
 
@@ -89,15 +92,11 @@ class airspeed {
 
         airspeed (void);
 
-        virtual ~airspeed ()
-        {
-            if (diff)
-                delete diff;
-        }
+        virtual ~airspeed () {}
 
     protected:
         airspeed_hardware      *hw;
-        differentiate          *diff;
+        fixed_differentiate<100, halving_taps<20> > diff;
         float                   sample_rate;
 
 #ifdef DO_AIRSPEED_CALIBRATION
@@ -140,11 +139,27 @@ class airspeed_hardware
         virtual float   // See Description
             TimeBase (void) const;
 
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the data returned by the last successful
+         *                  Sample arrived (monotonic_us), or 0 if this
+         *                  hardware doesn't know.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
         airspeed_hardware (void);
         virtual ~airspeed_hardware ();
 
     protected:
         int             io_board_fd;            // File descriptor to I/O board reading
+        unsigned        sample_stamp;           // See SampleStamp
         float           as_scale;
 };
 
+#endif /* AIRSPEED_H */
@@ -37,8 +37,6 @@
 
 #include "airspeed_xplane.h"
 
-extern char    rcv_buffer [1500];
-
 /**
  * Sample
  * DESCRIPTION:     Sample sensor data.
@@ -55,38 +53,28 @@ airspeed_xplane::Sample
  unsigned      &value
 )
 {
-    struct sockaddr_in          lp;
-    int                         size, fromlen;
     int                         type;
+    const unsigned char        *record;
+    unsigned                    n;
+    unsigned                    stamp;
     bool                        ret;
 
-    lp.sin_family = AF_INET;
-    lp.sin_port = 49000;
-    lp.sin_addr.s_addr = INADDR_LOOPBACK;
-
-    fromlen = sizeof (lp);
-
     assert (sizeof(int) == sizeof(float));
     ret = FALSE;
-    while (1)
+    while (source->Next (type, record, stamp, n))
     {
-        size = recvfrom (io_board_fd, rcv_buffer, sizeof (rcv_buffer), 0,
-                         (struct sockaddr*) &lp, (socklen_t*)&fromlen);
-        if (size == -1)
-            break;
-
-        memcpy (&type, rcv_buffer, sizeof(type));
         switch (type)
         {
             case XPT_SPEED_VSI:
-                if (++oversample_counter >= XP_FRAME_RATE / AIRSPEED_SAMPLE_RATE)
+                if ((oversample_counter += n) >= XP_FRAME_RATE / AIRSPEED_SAMPLE_RATE)
                 {
                     ret = TRUE;
                     oversample_counter = 0;
-                    value = (unsigned) roundf (((float*) rcv_buffer) [2] * as_scale);
+                    value = (unsigned) roundf (xplaneValue (record, 1) * as_scale);
+                    sample_stamp = stamp;
                 }
-                vgrnd = ((float*) rcv_buffer) [7];
-                vvi = ((float*) rcv_buffer) [5];
+                vgrnd = xplaneValue (record, 6);
+                vvi = xplaneValue (record, 4);
                 break;
             default:
                 ThrowException (INVALID_MSG);
@@ -115,22 +103,10 @@ float   // See Description
 
 airspeed_xplane::airspeed_xplane ()
 {
-    struct sockaddr_in  lcl;
-
     ::airspeed_hardware();
 
     oversample_counter = 0;
 
-    io_board_fd = socket (PF_INET, SOCK_DGRAM, 0);
-    if (io_board_fd == -1)
-    {
-        perror ("airspeed_xplane: socket");
-        ThrowException(errno);
-    }
-    lcl.sin_family = AF_INET;
-    lcl.sin_port = htons (48004);
-    lcl.sin_addr.s_addr = INADDR_ANY;
-
-    bind (io_board_fd, (struct sockaddr*) &lcl, sizeof (lcl));
-    fcntl (io_board_fd, F_SETFL, O_NONBLOCK);
+    source = new xplane_source (XPLANE_AIRSPEED, 48004, "airspeed_xplane");
+    io_board_fd = source->Fd ();
 }
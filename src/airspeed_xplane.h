@@ -16,6 +16,7 @@
 //
 //
 
+#include "xplane_ingest.h"
 #include "airspeed.h"
 
 class airspeed_xplane : public airspeed_hardware
@@ -55,6 +56,7 @@ class airspeed_xplane : public airspeed_hardware
 
         virtual ~airspeed_xplane () {}
     protected:
+        xplane_source  *source;
         unsigned        oversample_counter;
 };
 
@@ -19,24 +19,13 @@
 #include <stdio.h>
 
 #include "exceptions.h"
+#include "utilities.h"
 
 #include "altitude.h"
 
 altitude::altitude (void)
 {
-    static float        dal_filt [20];
-    unsigned            i;
-    float               tap;
-
-    tap = .5;
-    for (i = 0; i < NELEMENTS(dal_filt)-1; i++)
-    {
-        dal_filt [i] = tap;
-        tap /= 2;
-    }
-    dal_filt [NELEMENTS(dal_filt)-1] = dal_filt [NELEMENTS(dal_filt)-2]; 
     hw = NULL;
-    diff = new differentiate (100, dal_filt, NELEMENTS(dal_filt));
 }
 
 /**
@@ -53,14 +42,16 @@ void altitude::Update (void)
         ThrowException (NO_IO_BOARD);
     if (hw->Sample (alt))
     {
-        float   dal;
-        diff->AddSample (alt);
-        dal = diff->Differentiate();
-        alt_prime = (dal * sample_rate) * 60 * 1000 / (ALTITUDE_IDEAL_SAMPLE_PERIOD / 1000);      // fpm
+        unsigned stamp = hw->SampleStamp ();
+        if (stamp == 0)
+            stamp = monotonic_us ();
+        diff.AddSample (alt, stamp);
+        if (!hw->VerticalSpeed (alt_prime))
+            alt_prime = diff.Rate () * 60 * 1000 / (ALTITUDE_IDEAL_SAMPLE_PERIOD / 1000);      // fpm
         good = TRUE;
         // TODO: Add FDR function call here
-        //printf ("Altitude = %5d, dal = %10f, sample_rate = %8f, alt_prime = %8f\n",
-        //        alt, dal, sample_rate, alt_prime);
+        //printf ("Altitude = %5d, sample_rate = %8f, alt_prime = %8f\n",
+        //        alt, sample_rate, alt_prime);
     }
 }
 
@@ -154,5 +145,5 @@ altitude_hardware::TimeBase (void) const
     ThrowException (NO_IO_BOARD);
 }
 
-altitude_hardware::altitude_hardware (void) : alt_scale (1.0) {}
+altitude_hardware::altitude_hardware (void) : sample_stamp (0), alt_scale (1.0) {}
 
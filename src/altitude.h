@@ -15,7 +15,10 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
-#include "differentiate.h"
+#ifndef ALTITUDE_H
+#define ALTITUDE_H
+
+#include "fixed_differentiate.h"
 
 #define ALTITUDE_IDEAL_SAMPLE_PERIOD    750000
 
@@ -92,7 +95,7 @@ class altitude {
 
     protected:
         altitude_hardware      *hw;
-        differentiate          *diff;
+        fixed_differentiate<100, halving_taps<20> > diff;
         float                   sample_rate;
 };
 
@@ -130,9 +133,40 @@ class altitude_hardware
         virtual float   // See Description
             TimeBase (void) const;
 
+        /**
+         * VerticalSpeed
+         * DESCRIPTION:     Vertical speed as measured by the hardware itself,
+         *                  for hardware that does. Otherwise the altitude
+         *                  class differentiates the samples.
+         * PRE-CONDITIONS:  Sample returned TRUE
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        virtual bool    // FALSE if the hardware doesn't measure it
+            VerticalSpeed (float &)
+            {return (FALSE);}
+
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the data returned by the last successful
+         *                  Sample arrived (monotonic_us), or 0 if this
+         *                  hardware doesn't know.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
         altitude_hardware (void);
 
     protected:
         int             io_board_fd;            // File descriptor to I/O board reading
+        unsigned        sample_stamp;           // See SampleStamp
         float           alt_scale;
 };
+
+#endif /* ALTITUDE_H */
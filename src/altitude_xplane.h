@@ -42,6 +42,7 @@ class altitude_xplane : public altitude_hardware
                 if (gps->good == FALSE)
                     return (FALSE);
                 value = (int) roundf(gps->altitude);
+                sample_stamp = gps->SampleStamp ();
                 return (TRUE);
             }
 
@@ -419,6 +419,7 @@ control_airspeed:
     }
     //if ((pitch_engaged) || (roll_engaged) || (rudder_engaged))
     //    putchar ('\n');
+    hw->flush_servos ();
 }
 
 /**
@@ -683,6 +684,18 @@ void autopilot_hardware::update_rudder_servo (
     ThrowException (NO_SERVOS);
 }
 
+/**
+ * flush_servos
+ * DESCRIPTION:     Send the settings staged this cycle to the servos
+ * PRE-CONDITIONS:  
+ * POST-CONDITIONS: 
+ * EXCEPTIONS THROWN:   None
+ * EXCEPTIONS HANDLED: 
+ */
+void autopilot_hardware::flush_servos (void)
+{
+}
+
 autopilot_hardware::autopilot_hardware (void)
 {
     actual_aileron_force = 0;
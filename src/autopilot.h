@@ -385,6 +385,20 @@ class autopilot_hardware
                                                 // Both arguments range between +/- 100%
         );
 
+        /**
+         * flush_servos
+         * DESCRIPTION:     Send the settings the update_*_servo calls of this
+         *                  cycle have staged, all three axes together. Called
+         *                  once at the end of every autopilot::Update.
+         *                  Hardware that sets each servo as it is updated has
+         *                  nothing to do.
+         * PRE-CONDITIONS:  
+         * POST-CONDITIONS: Staged settings sent
+         * EXCEPTIONS THROWN:   None
+         * EXCEPTIONS HANDLED: 
+         */
+        virtual void flush_servos (void);
+
         autopilot_hardware (void);
 
     protected:
@@ -33,13 +33,15 @@
 #include "xplane_interface.h"
 #include "constants.h"
 
+#include "utilities.h"
 #include "autopilot_xplane.h"
+#include "xplane_ingest.h"
 
 /**
  * update_aileron_servo
- * DESCRIPTION:     Send a new setting to the aileron servo
+ * DESCRIPTION:     Stage a new setting for the aileron servo
  * PRE-CONDITIONS:  
- * POST-CONDITIONS: 
+ * POST-CONDITIONS: Sent at the next flush_servos
  * EXCEPTIONS THROWN:   NO_SERVOS
  * EXCEPTIONS HANDLED: 
  */
@@ -53,15 +55,15 @@ void autopilot_xplane::update_aileron_servo
     if (aileron_servo_on)
     {
         actual_aileron_force = (int) roundf (new_value * servo_scale);
-        send_control_info();
+        staged = TRUE;
     }
 }
 
 /**
  * update_elevator_servo
- * DESCRIPTION:     Send a new setting to the elevator servo
+ * DESCRIPTION:     Stage a new setting for the elevator servo
  * PRE-CONDITIONS:  
- * POST-CONDITIONS: 
+ * POST-CONDITIONS: Sent at the next flush_servos
  * EXCEPTIONS THROWN:   NO_SERVOS
  * EXCEPTIONS HANDLED: 
  */
@@ -74,16 +76,16 @@ void autopilot_xplane::update_elevator_servo (
     if (elevator_servo_on)
     {
         actual_elevator_force = (int) roundf (new_value * servo_scale);
-        send_control_info();
+        staged = TRUE;
     }
 }
 
 
 /**
  * update_rudder_servo
- * DESCRIPTION:     Send a new setting to the rudder servo
+ * DESCRIPTION:     Stage a new setting for the rudder servo
  * PRE-CONDITIONS:  
- * POST-CONDITIONS: 
+ * POST-CONDITIONS: Sent at the next flush_servos
  * EXCEPTIONS THROWN:   NO_SERVOS
  * EXCEPTIONS HANDLED: 
  */
@@ -96,7 +98,7 @@ void autopilot_xplane::update_rudder_servo (
     if (rudder_servo_on)
     {
         actual_rudder_force = (int) roundf (new_value * servo_scale);
-        send_control_info();
+        staged = TRUE;
     }
 }
 
@@ -108,6 +110,15 @@ autopilot_xplane::autopilot_xplane (void)
 
     servo_scale = 1.0;
     xplane_scale = 1.0 / 500.0;
+    staged = FALSE;
+    control_sequence = 0;
+    output_interval = 0;
+    last_output = 0;
+
+    memset (&relay, 0, sizeof (relay));
+    relay.sin_family = AF_INET;
+    relay.sin_port = htons (48006);
+    relay.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
 
     io_board_fd = socket (PF_INET, SOCK_DGRAM, 0);
     if (io_board_fd == -1)
@@ -123,9 +134,54 @@ autopilot_xplane::autopilot_xplane (void)
     fcntl (io_board_fd, F_SETFL, O_NONBLOCK);
 }
 
+/**
+ * flush_servos
+ * DESCRIPTION:     Send what update_*_servo staged this cycle, unless the
+ *                  last packet went out less than output_interval ago. A
+ *                  setting held back goes with the next flush that sends.
+ * PRE-CONDITIONS:  
+ * POST-CONDITIONS: 
+ * EXCEPTIONS THROWN:   None
+ * EXCEPTIONS HANDLED: 
+ */
+void autopilot_xplane::flush_servos (void)
+{
+    unsigned            now;
+
+    if (!staged)
+        return;
+    now = monotonic_us ();
+    if (output_interval != 0 && control_sequence != 0 &&
+        now - last_output < output_interval)
+        return;
+    send_control_info ();
+    staged = FALSE;
+    last_output = now;
+}
+
+/**
+ * SetOutputInterval
+ * DESCRIPTION:     Send control packets at most once every interval
+ *                  microseconds, however often Update runs
+ * PRE-CONDITIONS:  
+ * POST-CONDITIONS: 
+ * EXCEPTIONS THROWN:   None
+ * EXCEPTIONS HANDLED: 
+ */
+void autopilot_xplane::SetOutputInterval
+(
+ unsigned       interval                // uS. 0 sends every cycle with a change
+)
+{
+    output_interval = interval;
+}
+
 /**
  * send_control_info
- * DESCRIPTION:     Send the updated flight control settings to X-Plane via UDP
+ * DESCRIPTION:     Send the flight control settings to X-Plane via UDP as
+ *                  one XPT_FLT_CONTROL record. Byte 4 of the header, which
+ *                  X-Plane ignores, carries the low byte of the packet's
+ *                  sequence number so the far end can count losses.
  * PRE-CONDITIONS:  
  * POST-CONDITIONS: 
  * EXCEPTIONS THROWN:   NO_IO_BOARD
@@ -133,41 +189,38 @@ autopilot_xplane::autopilot_xplane (void)
  */
 void autopilot_xplane::send_control_info (void)
 {
-    struct sockaddr_in  xplane;
-    static char         xmt_buffer [1500];
+    char                xmt_buffer [XPLANE_DATA_HDR_LEN + SIZEOF_XPT_DATA];
     int                 type;
     float               data [8];
-    static int          duty_cycle = 0, i = 0;
 
-    if ((duty_cycle++ % 9) == 0)
-    {
-        xplane.sin_family = AF_INET;
-        xplane.sin_port = htons (48006);
-        xplane.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
-
-        strcpy (xmt_buffer, "DATA");
-        xmt_buffer [5] = '0';
-
-        type = XPT_FLT_CONTROL;
-
-        memcpy (xmt_buffer + 6, (void*)&type, sizeof(type));
-        data [0] = actual_elevator_force * xplane_scale;
-        data [1] = actual_aileron_force * xplane_scale;
-        data [2] = actual_rudder_force * xplane_scale;
-        data [3] = 0;
-        data [4] = 0;
-        data [5] = 0;
-        data [6] = 0;
-        data [7] = 0;
-
-        if ((i++) % 10 == 0)
-            printf ("el = %f, ail = %f, r = %f\n", data [0], data[1], data[2]);
-
-        memcpy (xmt_buffer + 10, data, sizeof (data));
-
-        sendto (io_board_fd, xmt_buffer, 6 + sizeof (type) + sizeof (data),
-                0, (struct sockaddr*)&xplane, sizeof (xplane));
-    }
+    memcpy (xmt_buffer, "DATA", 4);
+    xmt_buffer [4] = (char) control_sequence;
+    xmt_buffer [5] = '0';
+
+    type = XPT_FLT_CONTROL;
+
+    memcpy (xmt_buffer + 6, (void*)&type, sizeof(type));
+    data [0] = actual_elevator_force * xplane_scale;
+    data [1] = actual_aileron_force * xplane_scale;
+    data [2] = actual_rudder_force * xplane_scale;
+    data [3] = 0;
+    data [4] = 0;
+    data [5] = 0;
+    data [6] = 0;
+    data [7] = 0;
+
+    if ((control_sequence % 10) == 0)
+        printf ("el = %f, ail = %f, r = %f\n", data [0], data[1], data[2]);
+    control_sequence++;
+
+    memcpy (xmt_buffer + 10, data, sizeof (data));
+
+    // Straight to X-Plane, unless the xplane_interface relay has its socket
+    if (TheXPlane != NULL)
+        TheXPlane->Send (xmt_buffer, sizeof (xmt_buffer));
+    else
+        sendto (io_board_fd, xmt_buffer, sizeof (xmt_buffer),
+                0, (struct sockaddr*)&relay, sizeof (relay));
 }
 
 /**
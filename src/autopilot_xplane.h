@@ -16,6 +16,8 @@
 //
 //
 
+#include <netinet/in.h>
+
 #include "autopilot.h"
 
 class autopilot_xplane : public autopilot_hardware
@@ -44,9 +46,9 @@ class autopilot_xplane : public autopilot_hardware
 
         /**
          * update_aileron_servo
-         * DESCRIPTION:     Send a new setting to the aileron servo
+         * DESCRIPTION:     Stage a new setting for the aileron servo
          * PRE-CONDITIONS:  
-         * POST-CONDITIONS: 
+         * POST-CONDITIONS: Sent at the next flush_servos
          * EXCEPTIONS THROWN:   NO_SERVOS
          * EXCEPTIONS HANDLED: 
          */
@@ -58,9 +60,9 @@ class autopilot_xplane : public autopilot_hardware
 
         /**
          * update_elevator_servo
-         * DESCRIPTION:     Send a new setting to the elevator servo
+         * DESCRIPTION:     Stage a new setting for the elevator servo
          * PRE-CONDITIONS:  
-         * POST-CONDITIONS: 
+         * POST-CONDITIONS: Sent at the next flush_servos
          * EXCEPTIONS THROWN:   NO_SERVOS
          * EXCEPTIONS HANDLED: 
          */
@@ -73,9 +75,9 @@ class autopilot_xplane : public autopilot_hardware
 
         /**
          * update_rudder_servo
-         * DESCRIPTION:     Send a new setting to the rudder servo
+         * DESCRIPTION:     Stage a new setting for the rudder servo
          * PRE-CONDITIONS:  
-         * POST-CONDITIONS: 
+         * POST-CONDITIONS: Sent at the next flush_servos
          * EXCEPTIONS THROWN:   NO_SERVOS
          * EXCEPTIONS HANDLED: 
          */
@@ -85,12 +87,44 @@ class autopilot_xplane : public autopilot_hardware
                                                 // Both arguments range between +/- 100%
         );
 
+        /**
+         * flush_servos
+         * DESCRIPTION:     Send the three axes staged this cycle to X-Plane
+         *                  in one packet, no more often than the output
+         *                  interval allows
+         * PRE-CONDITIONS:  
+         * POST-CONDITIONS: 
+         * EXCEPTIONS THROWN:   None
+         * EXCEPTIONS HANDLED: 
+         */
+        virtual void flush_servos (void);
+
+        /**
+         * SetOutputInterval
+         * DESCRIPTION:     Send control packets at most once every interval
+         *                  microseconds, however often Update runs
+         * PRE-CONDITIONS:  
+         * POST-CONDITIONS: 
+         * EXCEPTIONS THROWN:   None
+         * EXCEPTIONS HANDLED: 
+         */
+        void SetOutputInterval
+        (
+         unsigned       interval                // uS. 0 sends every cycle with a change
+        );
+
         autopilot_xplane (void);
 
     protected:
         float           servo_scale;
         float           xplane_scale;
 
+        bool            staged;                 // Settings changed since the last packet
+        unsigned        control_sequence;       // Packets sent
+        unsigned        output_interval;        // uS between packets, at least
+        unsigned        last_output;            // monotonic_us of the last packet
+        struct sockaddr_in relay;               // xplane_interface, without TheXPlane
+
         /**
          * send_control_info
          * DESCRIPTION:     Send the updated flight control settings to X-Plane via UDP
@@ -0,0 +1,200 @@
+// bench_framescan.cpp: Microbenchmark for the frame start searches
+//
+// Compares the nested-loop scan that serial::getStartCharsBufIdx used to
+// do against the memchr and vector searches in framescan.cpp, on recorded
+// byte streams or, if none are given, on synthetic ones.
+//
+//   bench_framescan [-h hexheader] [file ...]
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+#include "framescan.h"
+
+// Roughly what piles up on one port while the display thread stalls
+#define BACKLOG_SIZE    8192
+#define MIN_BENCH_BYTES (64 * 1024 * 1024)
+
+struct stream {
+    const char          *name;
+    unsigned char        hdr[8];
+    int                  hdrLen;
+    unsigned char       *data;
+    int                  len;
+};
+
+
+// The scan getStartCharsBufIdx did before, minus its DLE escape rules
+static int findHeaderOld (const unsigned char *buf, int len,
+                          const unsigned char *hdr, int hdrLen)
+{
+    for (int i = 0; i < len - hdrLen + 1; i++)
+    {
+        int matchedCharCnt = 0;
+        for (int j = 0; j < hdrLen; j++)
+        {
+            if (buf[i + j] == hdr[j])
+                matchedCharCnt++;
+            else
+                break;
+        }
+        if (matchedCharCnt == hdrLen)
+            return (i);
+    }
+    return (-1);
+}
+
+
+static double cpuSecs (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+
+// Build a stream of "frameLen" byte frames starting with "hdr", filled with
+// random payload bytes (which will now and then contain the first header
+// byte, as real data does).
+static void synthesize (stream *s, const char *name, const char *hdr, int hdrLen, int frameLen)
+{
+    s->name = name;
+    memcpy (s->hdr, hdr, hdrLen);
+    s->hdrLen = hdrLen;
+    s->len = 1024 * 1024;
+    s->data = (unsigned char *)malloc (s->len);
+    for (int i = 0; i < s->len; i++)
+    {
+        if (i % frameLen < hdrLen)
+            s->data[i] = hdr[i % frameLen];
+        else
+            s->data[i] = rand () & 0xFF;
+    }
+}
+
+
+static bool loadFile (stream *s, const char *path, const unsigned char *hdr, int hdrLen)
+{
+    FILE *f = fopen (path, "rb");
+    if (f == NULL)
+    {
+        perror (path);
+        return (FALSE);
+    }
+    fseek (f, 0, SEEK_END);
+    s->len = ftell (f);
+    rewind (f);
+    s->data = (unsigned char *)malloc (s->len + 1);
+    s->len = fread (s->data, 1, s->len, f);
+    fclose (f);
+    s->name = path;
+    memcpy (s->hdr, hdr, hdrLen);
+    s->hdrLen = hdrLen;
+    return (TRUE);
+}
+
+
+// Find every header in the stream one backlog at a time, the way the serial
+// layer walks its ring. Returns frames found per CPU second.
+static double run (const stream *s,
+                   int (*scan) (const unsigned char *, int, const unsigned char *, int),
+                   unsigned *found, double *nsPerByte)
+{
+    int passes = MIN_BENCH_BYTES / s->len + 1;
+    unsigned frames = 0;
+    double start = cpuSecs ();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int base = 0; base < s->len; base += BACKLOG_SIZE)
+        {
+            int len = s->len - base;
+            if (len > BACKLOG_SIZE)
+                len = BACKLOG_SIZE;
+            int i = 0, idx;
+            while ((idx = scan (&s->data[base + i], len - i, s->hdr, s->hdrLen)) >= 0)
+            {
+                frames++;
+                i += idx + 1;
+            }
+        }
+    }
+    double secs = cpuSecs () - start;
+    *found = frames / passes;
+    *nsPerByte = secs * 1e9 / ((double)passes * s->len);
+    return (frames / secs);
+}
+
+
+int main (int argc, char *argv[])
+{
+    stream              streams[16];
+    int                 numStreams = 0;
+    unsigned char       hdr[8] = { 0xAA, 0x55 };
+    int                 hdrLen = 2;
+
+    for (int a = 1; a < argc && numStreams < 16; a++)
+    {
+        if (strcmp (argv[a], "-h") == 0 && a + 1 < argc)
+        {
+            const char *hex = argv[++a];
+            for (hdrLen = 0; hdrLen < 8 && sscanf (&hex[hdrLen * 2], "%2hhx", &hdr[hdrLen]) == 1; hdrLen++);
+            continue;
+        }
+        if (loadFile (&streams[numStreams], argv[a], hdr, hdrLen))
+            numStreams++;
+    }
+
+    if (numStreams == 0)
+    {
+        srand (1);
+        synthesize (&streams[numStreams++], "ahrs_xbow AA 55", "\xAA\x55", 2, 26);
+        synthesize (&streams[numStreams++], "adahrs 7F FF FE", "\x7F\xFF\xFE", 3, 23);
+        synthesize (&streams[numStreams++], "sl70r ^SS", "^SS", 3, 11);
+        synthesize (&streams[numStreams++], "fad STX", "\x02", 1, 139);
+    }
+
+    printf ("vector implementation: %s\n\n", framescanImpl ());
+    printf ("%-20s %-8s %10s %14s %10s\n", "stream", "scanner", "found", "frames/cpu-s", "ns/byte");
+    for (int n = 0; n < numStreams; n++)
+    {
+        static const struct {
+            const char *name;
+            int (*scan) (const unsigned char *, int, const unsigned char *, int);
+        } scanners[] = {
+            { "old",    findHeaderOld },
+            { "memchr", findHeaderScalar },
+            { "vector", findHeader }
+        };
+        unsigned reference = 0;
+        for (unsigned k = 0; k < NELEMENTS (scanners); k++)
+        {
+            unsigned found;
+            double nsPerByte;
+            double rate = run (&streams[n], scanners[k].scan, &found, &nsPerByte);
+            printf ("%-20s %-8s %10u %14.0f %10.3f%s\n", streams[n].name, scanners[k].name,
+                    found, rate, nsPerByte,
+                    (k > 0 && found != reference) ? "  MISMATCH" : "");
+            if (k == 0)
+                reference = found;
+        }
+    }
+    return (0);
+}
@@ -0,0 +1,466 @@
+// bench_serial.cpp: Throughput benchmark for the serial device drivers
+//
+// Generates a stream in each wire format the drivers parse, optionally
+// corrupts a fraction of the frames, and plays it through a pty (see
+// capture.h) into the unmodified driver while timing its Sample() calls.
+// Each driver is run twice, once on a clean stream and once on the
+// corrupted one, so the extra cost of recovering from corruption can be
+// told apart from the cost of the data itself.
+//
+//   bench_serial [-n frames] [-c corrupt_rate] [-p poll_usecs] [-s seed]
+//                [-o dir] [-v] [driver ...]
+//
+// For each driver it reports:
+//   frames/s   frames handed to the driver per CPU second of the thread
+//              calling Sample()
+//   ns/byte    CPU time of that thread per byte on the wire
+//   reject %   frames dropped for a bad checksum, by the serial layer or
+//              through serial::portChecksumGood (drivers that check their
+//              own checksums show "-")
+//   resync     per corrupted frame: good frames lost (1.00 if only the
+//              corrupted frame itself was) and extra CPU time over the
+//              clean run
+//
+// With -o the generated streams are kept as <dir>/<driver>.cap for
+// cots_hardware_test.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "constants.h"
+#include "capture.h"
+#include "checksum.h"
+#include "utilities.h"
+#include "ahrs_xbow.h"
+#include "fad_fdatasystems.h"
+#include "gps.h"
+#include "compass.h"
+#include "gps_ff.h"
+#include "xpdr_sl70r.h"
+#include "adahrs_grtaa301.h"
+#include "comm_sl40.h"
+
+gps            *TheGPS                  = NULL;
+compass        *TheCompass              = NULL;
+
+#define MAX_GEN_FRAME_LEN       512     // Longest frame on the wire, escapes included
+#define IDLE_USECS              200000  // Quiet time after the replay that ends a run
+
+// A frame generator writes the "seq"th frame of its stream into "out"
+// exactly as it goes on the wire and returns its length.
+typedef int (*frameGenerator) (unsigned char *out, unsigned seq);
+
+struct benchResult {
+    unsigned            bytes;
+    unsigned            framesGenerated;
+    unsigned            framesCorrupted;
+    unsigned            framesOut;      // portStats::framesDelivered
+    unsigned            dialectRejects; // Dropped by the serial layer
+    unsigned            driverRejects;  // Handed out, then failed portChecksumGood
+    double              cpuSecs;
+};
+
+
+static unsigned char randByte (void)
+{
+    return (rand () & 0xFF);
+}
+
+
+static double threadCpuSecs (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+
+// ---------------------------------------------------------------------------
+// Generators, one per wire format
+// ---------------------------------------------------------------------------
+
+// gps_ff: TSIP-style DLE <id> ... <sum16> DLE ETX, with data DLEs doubled.
+// Mostly 0x51 navigation packets, with a 0x75 and a 0x5e now and then.
+static int genTsip (unsigned char *out, unsigned seq)
+{
+    unsigned char       frame[128];
+    int                 len;
+
+    frame[0] = 0x10;
+    if (seq % 20 == 19)
+    {
+        len = 35;
+        frame[1] = 0x75;
+    }
+    else if (seq % 20 == 9)
+    {
+        len = 10;
+        frame[1] = 0x5e;
+    }
+    else
+    {
+        len = 91;
+        frame[1] = 0x51;
+    }
+    for (int i = 2; i < len - 2; i++)
+        frame[i] = randByte ();
+    switch (frame[1])
+    {
+        case 0x51:
+            checksum<sum16_be>::Put (frame, 0, 36, 37);
+            checksum<sum16_be>::Put (frame, 0, 86, 87);
+            break;
+        case 0x75:
+            checksum<sum16_be>::Put (frame, 0, 30, 31);
+            break;
+        case 0x5e:
+            checksum<sum16_be>::Put (frame, 0, 5, 6);
+            break;
+    }
+    frame[len - 2] = 0x10;
+    frame[len - 1] = 0x03;
+
+    int n = 0;
+    out[n++] = frame[0];
+    for (int i = 1; i < len - 2; i++)
+    {
+        out[n++] = frame[i];
+        if (frame[i] == 0x10)
+            out[n++] = 0x10;
+    }
+    out[n++] = frame[len - 2];
+    out[n++] = frame[len - 1];
+    return (n);
+}
+
+
+// ahrs_xbow: 26 byte 0xAA 0x55 frames with a 16 bit sum of bytes 2-23
+static int genXbow (unsigned char *out, unsigned seq)
+{
+    (void) seq;
+    out[0] = 0xAA;
+    out[1] = 0x55;
+    for (int i = 2; i < 24; i++)
+        out[i] = randByte ();
+    checksum<sum16_be>::Put (out, 2, 23, 24);
+    return (26);
+}
+
+
+// adahrs_grtaa301: 0x7F 0xFF <type> frames with an inverted 8 bit sum of
+// everything after the sync bytes. Mostly high rate data, some low rate.
+static int genGrt (unsigned char *out, unsigned seq)
+{
+    int len = (seq % 10 == 9) ? 21 : 23;
+    out[0] = 0x7F;
+    out[1] = 0xFF;
+    out[2] = (len == 23) ? 0xFE : 0xFD;
+    for (int i = 3; i < len - 1; i++)
+        out[i] = randByte ();
+    checksum<sum8_inverted>::Put (out, 2, len - 2, len - 1);
+    return (len);
+}
+
+
+// xpdr_sl70r: Fixed length ASCII messages with an 8 bit sum in hex
+static int genSl70 (unsigned char *out, unsigned seq)
+{
+    static const struct {
+        const char     *hdr;
+        int             len;
+        int             checksumIdx;
+    } msgs[] = {
+        { "#AL", 17, 14 },
+        { "^SS", 11, 9 },
+        { "^MD", 17, 14 },
+        { "^RC", 11, 8 }
+    };
+    int m = seq % NELEMENTS (msgs);
+    int idx = msgs[m].checksumIdx;
+
+    memcpy (out, msgs[m].hdr, 3);
+    out[3] = ' ';
+    for (int i = 4; i < idx; i++)
+        out[i] = '0' + rand () % 10;
+    checksum<sum8_hex>::Put (out, 0, idx - 1, idx);
+    for (int i = idx + 2; i < msgs[m].len; i++)
+        out[i] = '\r';
+    return (msgs[m].len);
+}
+
+
+// comm_sl40: $PMRRC01 status sentences, checksum as two nibbles + 0x30
+static int genPmrrc (unsigned char *out, unsigned seq)
+{
+    (void) seq;
+    memcpy (out, "$PMRRC01", 8);
+    for (int i = 8; i < 14; i++)
+        out[i] = '0' + rand () % 10;
+    checksum<sum8_nibbles>::Put (out, 6, 13, 14);
+    out[16] = '\r';
+    return (17);
+}
+
+
+// fad_fdatasystems: 139 byte STX ... ETX Shadin Z air data blocks
+static int genShadinZ (unsigned char *out, unsigned seq)
+{
+    static const struct {
+        char            label;
+        int             len;
+    } fields[] = {
+        { 'A', 3 }, { 'B', 3 }, { 'C', 3 }, { 'D', 5 }, { 'E', 5 },
+        { 'F', 3 }, { 'G', 3 }, { 'H', 3 }, { 'I', 3 }, { 'J', 3 },
+        { 'K', 4 }, { 'L', 3 }, { 'M', 4 }, { 'N', 5 }, { 'O', 4 },
+        { 'Q', 3 }, { 'R', 5 }, { 'S', 3 }
+    };
+    (void) seq;
+    int n = 0;
+    out[n++] = 0x02;
+    for (unsigned f = 0; f < NELEMENTS (fields); f++)
+    {
+        out[n++] = 'Z';
+        out[n++] = fields[f].label;
+        if (fields[f].label == 'R')
+            checksum< sum8_decimal<5> >::Put (out, 0, n - 3, n);
+        else
+            for (int i = 0; i < fields[f].len; i++)
+                out[n + i] = '0' + rand () % 10;
+        n += fields[f].len;
+        out[n++] = '\r';
+        out[n++] = '\n';
+    }
+    out[n++] = 0x03;
+    return (n);
+}
+
+
+// ---------------------------------------------------------------------------
+// Running a driver
+// ---------------------------------------------------------------------------
+
+// Build "numFrames" frames into a capture file, corrupting each with
+// probability "corruptRate" by changing one random byte of it
+static bool writeStream (const char *path, frameGenerator gen, unsigned numFrames,
+                         double corruptRate, unsigned seed, benchResult *r)
+{
+    unlink (path);
+    int fd = captureOpen (path);
+    if (fd == -1)
+    {
+        perror (path);
+        return (FALSE);
+    }
+    srand (seed);
+    unsigned char       frame[MAX_GEN_FRAME_LEN];
+    for (unsigned seq = 0; seq < numFrames; seq++)
+    {
+        int len = gen (frame, seq);
+        if (corruptRate > 0 && rand () < corruptRate * RAND_MAX)
+        {
+            frame[rand () % len] ^= 1 + rand () % 255;
+            r->framesCorrupted++;
+        }
+        captureWrite (fd, frame, len);
+        r->bytes += len;
+    }
+    r->framesGenerated = numFrames;
+    close (fd);
+    return (TRUE);
+}
+
+
+// Gets at the driver's port without changing the driver
+template <class T>
+class probe : public T
+{
+    public:
+        probe (const char *port) : T (port) {}
+        virtual ~probe () {}
+        serial *Port (void) { return (this->serialPtr); }
+};
+
+
+template <class T>
+static bool runDriver (const char *capPath, long pollUsecs, benchResult *r)
+{
+    capture_replay      replay;
+    if (!replay.Open (capPath, 0, 1))
+        return (FALSE);
+
+    probe<T> *dev = new probe<T> (replay.SlaveName ());
+    serial *port = dev->Port ();
+    unsigned checksumFails = serial::checksumFailCnt;
+
+    replay.Start ();
+    double start = threadCpuSecs ();
+    unsigned lastCnt = 0;
+    unsigned lastNew = monotonic_us ();
+    while (1)
+    {
+        dev->Sample ();
+        unsigned now = monotonic_us ();
+        if (port->stats->framesDelivered != lastCnt)
+        {
+            lastCnt = port->stats->framesDelivered;
+            lastNew = now;
+        }
+        else if (replay.done && now - lastNew > IDLE_USECS)
+        {
+            break;
+        }
+        if (pollUsecs > 0)
+            usleep (pollUsecs);
+    }
+    r->cpuSecs = threadCpuSecs () - start;
+    r->framesOut = port->stats->framesDelivered;
+    r->driverRejects = serial::checksumFailCnt - checksumFails;
+    // The port's count has the driver's rejects in it too
+    r->dialectRejects = port->stats->checksumRejects - r->driverRejects;
+    replay.Wait ();
+    delete port;        // The drivers never close their ports themselves
+    delete dev;
+    return (TRUE);
+}
+
+
+struct driverBench {
+    const char         *name;
+    frameGenerator      gen;
+    bool                (*run) (const char *, long, benchResult *);
+    bool                checksumVisible;        // Checks go through serial
+};
+
+static const driverBench drivers[] = {
+    { "gps_ff",           genTsip,    runDriver<gps_ff>,           TRUE  },
+    { "ahrs_xbow",        genXbow,    runDriver<ahrs_xbow>,        TRUE  },
+    { "adahrs_grtaa301",  genGrt,     runDriver<adahrs_grtaa301>,  TRUE  },
+    { "xpdr_sl70r",       genSl70,    runDriver<xpdr_sl70r>,       TRUE  },
+    { "comm_sl40",        genPmrrc,   runDriver<comm_sl40>,        FALSE },
+    { "fad_fdatasystems", genShadinZ, runDriver<fad_fdatasystems>, FALSE }
+};
+
+
+static void usage (void)
+{
+    fprintf (stderr, "usage: bench_serial [-n frames] [-c corrupt_rate] [-p poll_usecs] [-s seed] [-o dir] [-v] [driver ...]\n");
+    fprintf (stderr, "  drivers:");
+    for (unsigned d = 0; d < NELEMENTS (drivers); d++)
+        fprintf (stderr, " %s", drivers[d].name);
+    fprintf (stderr, "\n");
+    exit (-1);
+}
+
+
+int main (int argc, char *argv[])
+{
+    unsigned            numFrames = 20000;
+    double              corruptRate = 0.01;
+    long                pollUsecs = 1000;
+    unsigned            seed = 1;
+    const char         *keepDir = NULL;
+    bool                verbose = FALSE;
+    int                 opt;
+
+    while ((opt = getopt (argc, argv, "n:c:p:s:o:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':   numFrames = atoi (optarg);      break;
+            case 'c':   corruptRate = atof (optarg);    break;
+            case 'p':   pollUsecs = atol (optarg);      break;
+            case 's':   seed = atoi (optarg);           break;
+            case 'o':   keepDir = optarg;               break;
+            case 'v':   verbose = TRUE;                 break;
+            default:    usage ();
+        }
+    }
+    if (numFrames == 0 || corruptRate < 0 || corruptRate > 1)
+        usage ();
+
+    // The drivers print what they parse; keep the report readable
+    FILE *report = fdopen (dup (1), "w");
+    if (!verbose)
+        freopen ("/dev/null", "w", stdout);
+
+    fprintf (report, "%u frames per run, %.2f%% corrupted, Sample() every %ld us\n\n",
+             numFrames, corruptRate * 100, pollUsecs);
+    fprintf (report, "%-17s %9s %9s %8s %9s   %s\n", "", "frames/s", "ns/byte",
+             "reject%", "lost/bad", "resync ns/bad");
+
+    for (unsigned d = 0; d < NELEMENTS (drivers); d++)
+    {
+        const driverBench *b = &drivers[d];
+        bool wanted = (optind == argc);
+        for (int i = optind; i < argc; i++)
+            if (strcmp (argv[i], b->name) == 0)
+                wanted = TRUE;
+        if (!wanted)
+            continue;
+
+        char cleanPath[256], dirtyPath[256];
+        const char *dir = (keepDir != NULL) ? keepDir : P_tmpdir;
+        snprintf (cleanPath, sizeof (cleanPath), "%s/%s-clean%s", dir, b->name, CAPTURE_SUFFIX);
+        snprintf (dirtyPath, sizeof (dirtyPath), "%s/%s%s", dir, b->name, CAPTURE_SUFFIX);
+
+        benchResult clean, dirty;
+        memset (&clean, 0, sizeof (clean));
+        memset (&dirty, 0, sizeof (dirty));
+        if (!writeStream (cleanPath, b->gen, numFrames, 0, seed, &clean) ||
+            !writeStream (dirtyPath, b->gen, numFrames, corruptRate, seed, &dirty) ||
+            !b->run (cleanPath, pollUsecs, &clean) ||
+            !b->run (dirtyPath, pollUsecs, &dirty))
+        {
+            fprintf (report, "%-17s failed\n", b->name);
+            continue;
+        }
+        if (keepDir == NULL)
+        {
+            unlink (cleanPath);
+            unlink (dirtyPath);
+        }
+
+        double cpu = (dirty.cpuSecs > 0) ? dirty.cpuSecs : 1e-9;
+        unsigned examined = dirty.framesOut + dirty.dialectRejects;
+        char rejectStr[16] = "-";
+        if (b->checksumVisible && examined > 0)
+            snprintf (rejectStr, sizeof (rejectStr), "%.2f",
+                      100.0 * (dirty.dialectRejects + dirty.driverRejects) / examined);
+        fprintf (report, "%-17s %9.0f %9.1f %8s", b->name,
+                 dirty.framesOut / cpu, dirty.cpuSecs * 1e9 / dirty.bytes, rejectStr);
+        if (dirty.framesCorrupted > 0)
+        {
+            double cleanGood = (double)clean.framesOut - clean.driverRejects;
+            double dirtyGood = (double)dirty.framesOut - dirty.driverRejects;
+            double lost = (cleanGood - dirtyGood) / dirty.framesCorrupted;
+            double extraNs = (dirty.cpuSecs - clean.cpuSecs * dirty.bytes / clean.bytes) * 1e9;
+            fprintf (report, " %9.2f   %.0f", lost, extraNs / dirty.framesCorrupted);
+        }
+        fprintf (report, "\n");
+        unsigned cleanRejects = clean.dialectRejects + clean.driverRejects;
+        if (clean.framesOut != clean.framesGenerated || cleanRejects != 0)
+            fprintf (report, "%-17s (clean run: %u of %u frames, %u rejected)\n", "",
+                     clean.framesOut, clean.framesGenerated, cleanRejects);
+        fflush (report);
+    }
+    return (0);
+}
@@ -0,0 +1,201 @@
+// bench_xplane.cpp: Microbenchmark for decoding X-Plane records in the AHRS
+//
+// Decodes DATA packets the way X-Plane sends them with 20 rows ticked, 4 of
+// which the AHRS takes, and compares the switch ahrs_xplane::Sample used to
+// do (which threw INVALID_MSG on the other 16) against its dispatch table.
+// The cost is shown per record and per second of a 50 Hz simulator.
+//
+//   bench_xplane [rows]
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "constants.h"
+#include "exceptions.h"
+#include "xplane_interface.h"
+#include "ahrs_xplane.h"
+#include "gps.h"
+#include "compass.h"
+
+gps            *TheGPS                  = NULL;
+compass        *TheCompass              = NULL;
+
+#define SIM_RATE        50      // Packets per second from X-Plane
+#define DEFAULT_ROWS    20
+#define MAX_ROWS        40
+#define NUM_PACKETS     (SIM_RATE * 60)         // A minute of flying
+#define MIN_BENCH_RECORDS (20 * 1000 * 1000)
+
+// What the old switch wrote
+struct oldState {
+    float       thrust_vec, accel_lift, accel_thrust, accel_yaw;
+    float       ang_pitch, ang_roll, ang_head;
+    float       pitch, roll, heading;
+};
+
+
+// The switch ahrs_xplane::Sample did before, on one record read through a
+// float pointer, as the relay handed it over
+static void decodeOld (oldState &s, const char *rcv_buffer)
+{
+    int type;
+    memcpy (&type, rcv_buffer, sizeof(type));
+    switch (type)
+    {
+        case XPT_ENG_THRUST:
+            s.thrust_vec = ((float*)rcv_buffer) [1] +
+                           ((float*)rcv_buffer) [2] +
+                           ((float*)rcv_buffer) [3] +
+                           ((float*)rcv_buffer) [4];
+            break;
+        case XPT_AERO_FORCE:
+            s.accel_lift = ((float*)rcv_buffer) [1];
+            s.accel_thrust = 0;
+            s.accel_yaw = ((float*)rcv_buffer) [3];
+            break;
+        case XPT_ANG_VEL:
+            s.ang_pitch = ((float*)rcv_buffer) [1];
+            s.ang_roll = ((float*)rcv_buffer) [2];
+            s.ang_head = ((float*)rcv_buffer) [3];
+            break;
+        case XPT_PRH:
+            s.pitch = ((float*)rcv_buffer) [1];
+            s.roll = ((float*)rcv_buffer) [2];
+            s.heading = ((float*)rcv_buffer) [4];
+            break;
+        default:
+            ThrowException (INVALID_MSG);
+            break;
+    }
+}
+
+
+static double cpuSecs (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+
+// "rows" records per packet: the AHRS's four, then others from the data
+// output screen. Returns the packet length.
+static int makePacket (unsigned char *pkt, int rows, unsigned seq)
+{
+    static const int ahrsTypes [] = { XPT_ENG_THRUST, XPT_AERO_FORCE, XPT_ANG_VEL, XPT_PRH };
+    static const int otherTypes [] = {
+        XPT_FRAME_RATE, XPT_ELAPSE_TIME, XPT_SPEED_VSI, XPT_JOYSTICK, XPT_ART_STAB,
+        XPT_FLT_CONTROL, XPT_WINGSWEEP_THRUST_VEC, XPT_TRIM_FLAP, XPT_GEAR_BRAKES,
+        XPT_ANG_MOMENTS, XPT_ANG_ACCEL, XPT_LAT_LONG_ALT, XPT_XYZ, XPT_THROTTLE_SETTING,
+        XPT_ENGINE_SETTING, XPT_PROP_SETTING, XPT_MIXTURE_SETTING, XPT_COWL_FLAP,
+        XPT_NAV_FREQ, XPT_NAV_OBS, XPT_NAV_DEFLECT, XPT_GPS
+    };
+
+    memcpy (pkt, "DATA@", 5);
+    pkt [5] = 0;
+    int len = 6;
+    for (int r = 0; r < rows; r++)
+    {
+        int type;
+        if (r < (int)NELEMENTS (ahrsTypes))
+            type = ahrsTypes [r];
+        else
+            type = otherTypes [(r - NELEMENTS (ahrsTypes)) % NELEMENTS (otherTypes)];
+        memcpy (&pkt [len], &type, sizeof (type));
+        for (int k = 0; k < 8; k++)
+        {
+            float v = (seq % 360) + k * 0.5;
+            memcpy (&pkt [len + sizeof (type) + k * sizeof (float)], &v, sizeof (v));
+        }
+        len += SIZEOF_XPT_DATA;
+    }
+    return (len);
+}
+
+
+int main (int argc, char *argv[])
+{
+    int rows = DEFAULT_ROWS;
+    if (argc > 1)
+        rows = atoi (argv [1]);
+    if (rows < 4 || rows > MAX_ROWS)
+    {
+        fprintf (stderr, "Usage: bench_xplane [rows (4 - %d)]\n", MAX_ROWS);
+        return (-1);
+    }
+
+    int             pktLen = 6 + rows * SIZEOF_XPT_DATA;
+    unsigned char  *packets = (unsigned char *)malloc (NUM_PACKETS * pktLen);
+    for (int p = 0; p < NUM_PACKETS; p++)
+        makePacket (&packets [p * pktLen], rows, p);
+    int passes = MIN_BENCH_RECORDS / (NUM_PACKETS * rows) + 1;
+    double records = (double)passes * NUM_PACKETS * rows;
+
+    // Old: every record goes through the relay's 36 byte buffer, and each
+    // one the AHRS doesn't take unwinds out of Sample
+    oldState        old;
+    char            rcv_buffer [1500];
+    unsigned        thrown = 0;
+    memset (&old, 0, sizeof (old));
+    double start = cpuSecs ();
+    for (int pass = 0; pass < passes; pass++)
+        for (int p = 0; p < NUM_PACKETS; p++)
+            for (int r = 0; r < rows; r++)
+            {
+                memcpy (rcv_buffer, &packets [p * pktLen + 6 + r * SIZEOF_XPT_DATA], SIZEOF_XPT_DATA);
+                try {
+                    decodeOld (old, rcv_buffer);
+                }
+                catch (...)
+                {
+                    thrown++;
+                }
+            }
+    double oldSecs = cpuSecs () - start;
+
+    // Table: straight out of the packet, where the values are only 2 byte
+    // aligned
+    ahrs_xplane    *ax = new ahrs_xplane ();
+    start = cpuSecs ();
+    for (int pass = 0; pass < passes; pass++)
+        for (int p = 0; p < NUM_PACKETS; p++)
+        {
+            const unsigned char *rec = &packets [p * pktLen + 6];
+            for (int r = 0; r < rows; r++, rec += SIZEOF_XPT_DATA)
+            {
+                int type;
+                memcpy (&type, rec, sizeof (type));
+                ax->Decode (type, rec + sizeof (type), p);
+            }
+        }
+    double tableSecs = cpuSecs () - start;
+
+    if (old.heading != ax->heading || thrown != ax->unknown_records)
+        printf ("MISMATCH: heading %f / %f, skipped %u / %u\n",
+                old.heading, ax->heading, thrown, ax->unknown_records);
+
+    printf ("%d rows at %d Hz, %d for the AHRS\n\n", rows, SIM_RATE, 4);
+    printf ("%-8s %12s %16s\n", "decoder", "ns/record", "cpu-us/sim-second");
+    printf ("%-8s %12.1f %16.1f\n", "switch", oldSecs * 1e9 / records,
+            oldSecs * 1e6 / records * rows * SIM_RATE);
+    printf ("%-8s %12.1f %16.1f\n", "table", tableSecs * 1e9 / records,
+            tableSecs * 1e6 / records * rows * SIM_RATE);
+    return (0);
+}
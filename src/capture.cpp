@@ -0,0 +1,325 @@
+// capture.cpp: Raw serial byte stream capture files and their replay
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "constants.h"
+#include "capture.h"
+
+static const unsigned char zeroPad [CAPTURE_ALIGN] = { 0 };
+
+static inline size_t padTo (size_t len)
+{
+    return ((CAPTURE_ALIGN - (len % CAPTURE_ALIGN)) % CAPTURE_ALIGN);
+}
+
+static uint64_t monotonicNs (void)
+{
+    struct timespec     ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+
+int captureOpen (const char *path)
+{
+    int fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return (-1);
+
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size == 0)
+    {
+        captureFileHdr hdr;
+        memset (&hdr, 0, sizeof (hdr));
+        memcpy (hdr.magic, CAPTURE_MAGIC, sizeof (hdr.magic));
+        hdr.version = CAPTURE_VERSION;
+        if (write (fd, &hdr, sizeof (hdr)) != sizeof (hdr))
+        {
+            close (fd);
+            return (-1);
+        }
+    }
+    return (fd);
+}
+
+
+void captureWrite (int fd, const unsigned char *buf, int len)
+{
+    captureRecordHdr    rec;
+    struct iovec        iov [3];
+
+    rec.stamp_ns = monotonicNs ();
+    rec.len = len;
+    rec.reserved = 0;
+    iov [0].iov_base = &rec;
+    iov [0].iov_len = sizeof (rec);
+    iov [1].iov_base = (void *)buf;
+    iov [1].iov_len = len;
+    iov [2].iov_base = (void *)zeroPad;
+    iov [2].iov_len = padTo (len);
+    // One writev per record: with O_APPEND two ports sharing a file can't
+    // interleave inside a record, and a crash can only truncate the last.
+    if (writev (fd, iov, 3) == -1 && DEBUG)
+        perror ("captureWrite");
+}
+
+
+captureFile::captureFile (void)
+{
+    map = NULL;
+    mapLen = 0;
+    pos = 0;
+}
+
+
+captureFile::~captureFile ()
+{
+    if (map != NULL)
+        munmap ((void *)map, mapLen);
+}
+
+
+bool captureFile::Open (const char *path)
+{
+    int fd = open (path, O_RDONLY);
+    if (fd == -1)
+        return (FALSE);
+    struct stat st;
+    if (fstat (fd, &st) == -1 || st.st_size < (off_t)sizeof (captureFileHdr))
+    {
+        close (fd);
+        return (FALSE);
+    }
+    void *m = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (m == MAP_FAILED)
+        return (FALSE);
+
+    const captureFileHdr *hdr = (const captureFileHdr *)m;
+    if (memcmp (hdr->magic, CAPTURE_MAGIC, sizeof (hdr->magic)) != 0 ||
+        hdr->version != CAPTURE_VERSION)
+    {
+        munmap (m, st.st_size);
+        return (FALSE);
+    }
+    madvise (m, st.st_size, MADV_SEQUENTIAL);
+    map = (const unsigned char *)m;
+    mapLen = st.st_size;
+    Rewind ();
+    return (TRUE);
+}
+
+
+void captureFile::Rewind (void)
+{
+    pos = sizeof (captureFileHdr);
+}
+
+
+bool captureFile::Next (const unsigned char *&data, int &len, uint64_t &stamp_ns)
+{
+    if (pos + sizeof (captureRecordHdr) > mapLen)
+        return (FALSE);
+    const captureRecordHdr *rec = (const captureRecordHdr *)&map [pos];
+    if (pos + sizeof (*rec) + rec->len > mapLen)
+        return (FALSE);     // Truncated last record
+    data = &map [pos + sizeof (*rec)];
+    len = rec->len;
+    stamp_ns = rec->stamp_ns;
+    pos += sizeof (*rec) + rec->len + padTo (rec->len);
+    return (TRUE);
+}
+
+
+bool captureFile::IsCapture (const char *path)
+{
+    char        magic [8];
+    int fd = open (path, O_RDONLY | O_NONBLOCK);
+    if (fd == -1)
+        return (FALSE);
+    struct stat st;
+    bool ret = (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) &&
+                read (fd, magic, sizeof (magic)) == sizeof (magic) &&
+                memcmp (magic, CAPTURE_MAGIC, sizeof (magic)) == 0);
+    close (fd);
+    return (ret);
+}
+
+
+capture_replay::capture_replay (void)
+{
+    bytesSent = 0;
+    recordsSent = 0;
+    done = FALSE;
+    master = slaveHold = -1;
+    slaveName [0] = '\0';
+    speed = 1;
+    loops = 1;
+    threadStarted = FALSE;
+}
+
+
+capture_replay::~capture_replay ()
+{
+    Wait ();
+    if (slaveHold != -1)
+        close (slaveHold);
+    if (master != -1)
+        close (master);
+}
+
+
+bool capture_replay::Open (const char *path, double spd, int nloops)
+{
+    if (!file.Open (path))
+    {
+        fprintf (stderr, "capture_replay: %s is not a readable capture file\n", path);
+        return (FALSE);
+    }
+    speed = spd;
+    loops = nloops;
+
+    master = posix_openpt (O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1 || grantpt (master) == -1 || unlockpt (master) == -1)
+    {
+        perror ("capture_replay: pty");
+        return (FALSE);
+    }
+    strncpy (slaveName, ptsname (master), sizeof (slaveName) - 1);
+    slaveName [sizeof (slaveName) - 1] = '\0';
+
+    // Hold the slave open so the pty survives the driver reopening it, and
+    // make it raw so nothing is translated before the driver sets it up.
+    slaveHold = open (slaveName, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slaveHold == -1)
+    {
+        perror ("capture_replay: slave");
+        return (FALSE);
+    }
+    struct termios tio;
+    tcgetattr (slaveHold, &tio);
+    cfmakeraw (&tio);
+    tcsetattr (slaveHold, TCSANOW, &tio);
+    return (TRUE);
+}
+
+
+// Throw away anything the driver sent to the "device"
+void capture_replay::Drain (void)
+{
+    unsigned char junk [256];
+    struct pollfd pfd = { master, POLLIN, 0 };
+    while (poll (&pfd, 1, 0) == 1 && (pfd.revents & POLLIN) &&
+           read (master, junk, sizeof (junk)) > 0);
+}
+
+
+void capture_replay::Send (const unsigned char *data, int len)
+{
+    while (len > 0)
+    {
+        struct pollfd pfd = { master, POLLIN | POLLOUT, 0 };
+        if (poll (&pfd, 1, 1000) <= 0)
+            continue;
+        if (pfd.revents & POLLIN)
+            Drain ();
+        if (pfd.revents & POLLOUT)
+        {
+            int n = write (master, data, len);
+            if (n > 0)
+            {
+                data += n;
+                len -= n;
+                bytesSent += n;
+            }
+            else if (n == -1 && errno != EAGAIN && errno != EINTR)
+            {
+                perror ("capture_replay: write");
+                return;
+            }
+        }
+    }
+}
+
+
+void capture_replay::Run (void)
+{
+    for (int loop = 0; loop < loops; loop++)
+    {
+        const unsigned char    *data;
+        int                     len;
+        uint64_t                stamp, first = 0;
+        uint64_t                start = monotonicNs ();
+
+        file.Rewind ();
+        while (file.Next (data, len, stamp))
+        {
+            if (first == 0)
+                first = stamp;
+            if (speed > 0)
+            {
+                // Keep to the captured spacing (scaled), measured from the
+                // start so sleep overruns don't accumulate
+                uint64_t due = start + (uint64_t)((stamp - first) / speed);
+                struct timespec ts;
+                ts.tv_sec = due / 1000000000ULL;
+                ts.tv_nsec = due % 1000000000ULL;
+                while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+            }
+            Send (data, len);
+            recordsSent++;
+        }
+    }
+    Drain ();
+    done = TRUE;
+}
+
+
+void *capture_replay::ThreadMain (void *arg)
+{
+    ((capture_replay *)arg)->Run ();
+    return (NULL);
+}
+
+
+bool capture_replay::Start (void)
+{
+    if (pthread_create (&thread, NULL, ThreadMain, this) != 0)
+        return (FALSE);
+    threadStarted = TRUE;
+    return (TRUE);
+}
+
+
+void capture_replay::Wait (void)
+{
+    if (threadStarted)
+        pthread_join (thread, NULL);
+    threadStarted = FALSE;
+}
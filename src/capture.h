@@ -0,0 +1,174 @@
+// capture.h: Raw serial byte stream capture files and their replay
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// Capture file layout. Everything is little-endian and 8 byte aligned so a
+// reader can mmap the file and walk it in place:
+//
+//   captureFileHdr
+//   captureRecordHdr, <len> bytes as read, padding to the next 8 bytes
+//   captureRecordHdr, ...
+//
+// Each record is one read() from the port.
+#define CAPTURE_MAGIC           "EFISCAP1"
+#define CAPTURE_VERSION         1
+#define CAPTURE_ALIGN           8
+#define CAPTURE_SUFFIX          ".cap"
+
+// Set to a directory to capture every serial port opened; each port is
+// appended to <dir>/<port basename>.cap
+#define CAPTURE_DIR_ENV         "EFIS_CAPTURE_DIR"
+
+struct captureFileHdr {
+    char        magic [8];
+    uint32_t    version;
+    uint32_t    reserved;
+};
+
+struct captureRecordHdr {
+    uint64_t    stamp_ns;       // CLOCK_MONOTONIC when the read returned
+    uint32_t    len;            // Bytes of data following
+    uint32_t    reserved;
+};
+
+/**
+ * captureOpen
+ * DESCRIPTION:     Opens (creating if need be) a capture file for appending
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: File has a valid header
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+int     // File descriptor, or -1 (with errno set) on failure
+    captureOpen (const char *path);
+
+/**
+ * captureWrite
+ * DESCRIPTION:     Appends one record holding "len" bytes just read
+ * PRE-CONDITIONS:  fd from captureOpen
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+void captureWrite (int fd, const unsigned char *buf, int len);
+
+// captureFile class: A capture file mapped read-only, walked one record at
+// a time.
+class captureFile
+{
+    public:
+        captureFile (void);
+        ~captureFile ();
+
+        /**
+         * Open
+         * DESCRIPTION:     Maps a capture file
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: Positioned at the first record
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE if the file can't be read or isn't a capture file
+            Open (const char *path);
+
+        /**
+         * Next
+         * DESCRIPTION:     Steps to the next record
+         * PRE-CONDITIONS:  Open succeeded
+         * POST-CONDITIONS: data/len/stamp_ns describe the record
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE at the end of the file
+            Next (const unsigned char *&data, int &len, uint64_t &stamp_ns);
+
+        void    Rewind (void);
+
+        // TRUE if "path" names a capture file rather than a device
+        static bool IsCapture (const char *path);
+
+    protected:
+        const unsigned char    *map;
+        size_t                  mapLen;
+        size_t                  pos;
+};
+
+// capture_replay class: Plays a capture file into a pseudo-terminal so the
+// unmodified drivers can open the slave side as if it were the device.
+// Whatever the driver writes to the "device" is read and thrown away.
+class capture_replay
+{
+    public:
+        unsigned long long      bytesSent;
+        unsigned                recordsSent;
+        volatile bool           done;   // Whole file has been played
+
+        capture_replay (void);
+        ~capture_replay ();
+
+        /**
+         * Open
+         * DESCRIPTION:     Maps the capture file and creates the pty
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: SlaveName() can be handed to a driver
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE (with a message on stderr) on failure
+            Open
+            (
+             const char *path,
+             double      speed,         // 1 = as captured, N = N times faster,
+                                        // 0 = as fast as the reader takes it
+             int         loops          // Times to play the file
+            );
+
+        const char     *SlaveName (void) const { return (slaveName); }
+
+        /**
+         * Run/Start
+         * DESCRIPTION:     Play the file in this thread, or in a new one
+         * PRE-CONDITIONS:  Open succeeded
+         * POST-CONDITIONS: done is TRUE once the file has been played
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void    Run (void);
+        bool    Start (void);
+        void    Wait (void);
+
+    protected:
+        captureFile     file;
+        int             master;
+        int             slaveHold;      // Keeps the pty up between driver opens
+        char            slaveName [64];
+        double          speed;
+        int             loops;
+        pthread_t       thread;
+        bool            threadStarted;
+
+        static void    *ThreadMain (void *arg);
+        void            Send (const unsigned char *data, int len);
+        void            Drain (void);
+};
+
+#endif /* CAPTURE_H */
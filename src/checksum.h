@@ -0,0 +1,180 @@
+// checksum.h: The checksums used by the serial wire protocols
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Every device in the tree uses an additive checksum; they differ only in
+// how many bits are kept and how the result is sent. So a checksum is the
+// plain sum of the bytes covered, and a policy class below says how to
+// compare it with, or write it as, the bytes on the wire:
+//
+//   SENT_LEN                   bytes the checksum takes up in the frame
+//   Match (sum, sent)          TRUE if "sent" holds the checksum of "sum"
+//   Put (sum, out)             writes the checksum of "sum" to "out"
+//
+// checksum<Policy> then checks or fills in a frame, and
+// checksum_accumulator<Policy> builds the sum up a byte at a time for code
+// that is walking the bytes anyway.
+
+/**
+ * byteSum
+ * DESCRIPTION:     Sum of "len" bytes. Long runs are summed 16 bytes at a
+ *                  time with the SSE2 sum-of-absolute-differences against
+ *                  zero.
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static inline unsigned  // Full sum; callers keep the bits they need
+    byteSum (const unsigned char *buf, int len)
+{
+    unsigned    sum = 0;
+    int         i = 0;
+#ifdef __SSE2__
+    if (len >= 32)
+    {
+        __m128i zero = _mm_setzero_si128 ();
+        __m128i acc = zero;
+        for (; i + 16 <= len; i += 16)
+            acc = _mm_add_epi64 (acc, _mm_sad_epu8 (_mm_loadu_si128 ((const __m128i *)&buf[i]), zero));
+        sum = _mm_cvtsi128_si32 (acc) + _mm_cvtsi128_si32 (_mm_srli_si128 (acc, 8));
+    }
+#endif
+    for (; i < len; i++)
+        sum += buf[i];
+    return (sum);
+}
+
+static inline int hexDigit (unsigned char c)
+{
+    if (c >= '0' && c <= '9') return (c - '0');
+    if (c >= 'A' && c <= 'F') return (c - 'A' + 10);
+    if (c >= 'a' && c <= 'f') return (c - 'a' + 10);
+    return (-1);
+}
+
+
+// 16 bit sum, sent as a big-endian binary short (xbow, TSIP)
+struct sum16_be
+{
+    enum { SENT_LEN = 2 };
+    static bool Match (unsigned sum, const unsigned char *sent)
+        { return ((sum & 0xFFFF) == (unsigned)((sent[0] << 8) + sent[1])); }
+    static void Put (unsigned sum, unsigned char *out)
+        { out[0] = (sum >> 8) & 0xFF; out[1] = sum & 0xFF; }
+};
+
+// 8 bit sum, one's complement, sent as one byte (GRT)
+struct sum8_inverted
+{
+    enum { SENT_LEN = 1 };
+    static bool Match (unsigned sum, const unsigned char *sent)
+        { return ((~sum & 0xFF) == sent[0]); }
+    static void Put (unsigned sum, unsigned char *out)
+        { out[0] = ~sum & 0xFF; }
+};
+
+// 8 bit sum as two ASCII hex digits (SL70)
+struct sum8_hex
+{
+    enum { SENT_LEN = 2 };
+    static bool Match (unsigned sum, const unsigned char *sent)
+        {
+            int hi = hexDigit (sent[0]);
+            int lo = hexDigit (sent[1]);
+            return (hi >= 0 && lo >= 0 && (sum & 0xFF) == (unsigned)((hi << 4) + lo));
+        }
+    static void Put (unsigned sum, unsigned char *out)
+        {
+            static const char digits[] = "0123456789ABCDEF";
+            out[0] = digits[(sum >> 4) & 0x0F];
+            out[1] = digits[sum & 0x0F];
+        }
+};
+
+// 8 bit sum as two nibbles each added to '0', so A-F come out as ':'-'?'
+// (SL40)
+struct sum8_nibbles
+{
+    enum { SENT_LEN = 2 };
+    static bool Match (unsigned sum, const unsigned char *sent)
+        { return (sent[0] == ((sum >> 4) & 0x0F) + '0' && sent[1] == (sum & 0x0F) + '0'); }
+    static void Put (unsigned sum, unsigned char *out)
+        { out[0] = ((sum >> 4) & 0x0F) + '0'; out[1] = (sum & 0x0F) + '0'; }
+};
+
+// 8 bit sum as "Digits" ASCII decimal digits (Shadin Z)
+template <int Digits>
+struct sum8_decimal
+{
+    enum { SENT_LEN = Digits };
+    static bool Match (unsigned sum, const unsigned char *sent)
+        {
+            unsigned value = 0;
+            for (int i = 0; i < Digits; i++)
+            {
+                if (sent[i] < '0' || sent[i] > '9')
+                    return (false);
+                value = value * 10 + sent[i] - '0';
+            }
+            return (value == (sum & 0xFF));
+        }
+    static void Put (unsigned sum, unsigned char *out)
+        {
+            sum &= 0xFF;
+            for (int i = Digits - 1; i >= 0; i--, sum /= 10)
+                out[i] = '0' + sum % 10;
+        }
+};
+
+
+// checksum: Checks or fills in the checksum of a frame. Bytes "start"
+// through "stop" are summed and the checksum sits at "idx".
+template <class Policy>
+struct checksum
+{
+    static bool Ok (const unsigned char *frame, int start, int stop, int idx)
+        { return (Policy::Match (byteSum (&frame[start], stop - start + 1), &frame[idx])); }
+    static void Put (unsigned char *frame, int start, int stop, int idx)
+        { Policy::Put (byteSum (&frame[start], stop - start + 1), &frame[idx]); }
+};
+
+// checksum_accumulator: The same sum built up as the bytes go by
+template <class Policy>
+class checksum_accumulator
+{
+    public:
+        checksum_accumulator (void) { sum = 0; }
+
+        void    Reset (void)                                    { sum = 0; }
+        void    Add (unsigned char c)                           { sum += c; }
+        void    Add (const unsigned char *buf, int len)         { sum += byteSum (buf, len); }
+        unsigned Sum (void) const                               { return (sum); }
+        bool    Ok (const unsigned char *sent) const            { return (Policy::Match (sum, sent)); }
+        void    Put (unsigned char *out) const                  { Policy::Put (sum, out); }
+
+    protected:
+        unsigned        sum;
+};
+
+#endif /* CHECKSUM_H */
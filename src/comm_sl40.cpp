@@ -27,6 +27,8 @@
 #include "exceptions.h"
 #include "constants.h"
 #include "comm_sl40.h"
+#include "checksum.h"
+#include "framescan.h"
 
 #define TRANSCEIVER_STATUS_MSG_ID "01"
 #define SOFTWARE_VERSION_MSG_ID   "03"
@@ -45,6 +47,7 @@ comm_sl40::comm_sl40(const char *port)
     good = FALSE;
     serialPtr = new serial(port, TRUE);
     initialize();
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
 }
 
 
@@ -126,30 +129,53 @@ void comm_sl40::parseMessage(char *framePtr) {
 }
 
 
+// 8 bit sum (carries ignored), each nibble sent as hex 30 + nibble
 void comm_sl40::calculateChecksum(char *ptr, int startIdx, int stopIdx, char *checksum2Char) {
-  unsigned short checksum = 0;
-  for (int i=startIdx; i <= stopIdx; i++) {
-    //checksum = checksum ^ ptr[i]; // It says to ignore carry (by bit or byte?)
-    checksum = checksum + ptr[i]; // It says to ignore carry (by bit or byte?)
-  }
-  unsigned char checkbyte = checksum && 0x00FF; // mask off first byte of two
-
-  checksum2Char[0] = ((checkbyte && 0xF0)>>4) + 0x30; // Take most sig nibble, shift and add hex 30
-  checksum2Char[1] = (checkbyte && 0x0F) + 0x30; // Take least sig nibble and add hex 30
+  unsigned sum = byteSum((unsigned char *)&ptr[startIdx], stopIdx - startIdx + 1);
+  sum8_nibbles::Put(sum, (unsigned char *)checksum2Char);
 }
 
 
 bool  comm_sl40::checksumOk(char *msg, int startIdx, int stopIdx, int checksumIdx) {
-  char checksum[2];
-  calculateChecksum(msg, startIdx, stopIdx, checksum);
-
-  if (strncmp(&msg[checksumIdx], checksum, 2) != 0) {
-    if (DEBUG) printf("BAD CHECKSUM calc:extracted  %2s:%2s\n", checksum, &msg[checksumIdx]);
+  if (!checksum<sum8_nibbles>::Ok((unsigned char *)msg, startIdx, stopIdx, checksumIdx)) {
+    if (DEBUG) printf("BAD CHECKSUM extracted %.2s\n", &msg[checksumIdx]);
     return FALSE;
   }
   return TRUE;
 }
 
+
+int comm_sl40::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  static const char header[] = SL40_NMEA0183_HEADER;
+  const int hdrLen = sizeof(header) - 1;
+  int frames = 0;
+  int at;
+  covered = 0;
+
+  for (int i=0; (at = findHeader(&buf[i], len - i, (const unsigned char *)header, hdrLen)) >= 0; ) {
+    const unsigned char *msg = &buf[i + at];
+    int avail = len - i - at;
+    // Last byte summed; the two checksum chars and the CR follow it
+    int stop = 0;
+    if (avail >= hdrLen + 2) {
+      if (memcmp(&msg[hdrLen], TRANSCEIVER_STATUS_MSG_ID, 2) == 0) stop = 13;
+      else if (memcmp(&msg[hdrLen], SOFTWARE_VERSION_MSG_ID, 2) == 0) stop = 11;
+    }
+    int msgLen = stop + 4;
+    if (stop > 0 && msgLen <= avail && msg[msgLen - 1] == '\r' &&
+	checksum<sum8_nibbles>::Ok(msg, hdrLen, stop, stop + 1)) {
+      frames++;
+      covered += msgLen;
+      i += at + msgLen;
+    }
+    else {
+      i += at + 1;
+    }
+  }
+  return frames;
+}
+
 int comm_sl40::getActiveFrequencyKhz() {
   return this->activeFrequencyKhz;
 }
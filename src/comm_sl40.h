@@ -53,6 +53,19 @@ class comm_sl40 {
 	// Constructor
         comm_sl40(const char *port);
 
+        /**
+         * Recognize
+         * DESCRIPTION:     Counts the $PMRRC status and version messages with
+         *                  good checksums in bytes heard on a port (see
+         *                  port_detect.h)
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of bytes in those messages
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	static int      // Good messages found
+	  Recognize(const unsigned char *buf, int len, int &covered);
+
 	void parseMessage(char *framePtr);
 
 	void calculateChecksum(char *ptr, int startIdx, int stopIdx, char *checksum);
@@ -20,6 +20,7 @@
 #include <stdio.h>
 
 #include "exceptions.h"
+#include "utilities.h"
 
 #include "compass.h"
 
@@ -40,21 +41,22 @@ void compass::Update (void)
         ThrowException (NO_IO_BOARD);
     if (hw->Sample (x, y, z))
     {
-        float   dhe;
         float   newheading = x;
+        unsigned stamp = hw->SampleStamp ();
+        if (stamp == 0)
+            stamp = monotonic_us ();
 
         if (heading - newheading > 180)
             newheading += 360;
         else if (newheading - heading > 180)
             newheading -= 360;
-        diff->AddSample ((int) roundf (newheading));
+        diff.AddSample ((int) roundf (newheading), stamp);
         while (newheading > 360)
             newheading -= 360;
         while (newheading < 1)
             newheading += 360;
         heading = newheading;
-        dhe = diff->Differentiate();
-        heading_prime = (dhe * sample_rate);      // degrees / s
+        heading_prime = diff.Rate ();      // degrees / s
         //printf ("heading = %d, heading' = %f\n", heading, heading_prime);
         good = TRUE;
     }
@@ -80,19 +82,7 @@ compass::ReadCalHeadings
 
 compass::compass (void)
 {
-    static float        cps_filt [8];
-    unsigned            i;
-    float               tap;
-
-    tap = .5;
-    for (i = 0; i < NELEMENTS(cps_filt)-1; i++)
-    {
-        cps_filt [i] = tap;
-        tap /= 2;
-    }
-    cps_filt [NELEMENTS(cps_filt)-1] = cps_filt [NELEMENTS(cps_filt)-2]; 
     hw = NULL;
-    diff = new differentiate (100, cps_filt, NELEMENTS(cps_filt));
 }
 
 /**
@@ -19,7 +19,7 @@
 #ifndef COMPASS_H
 #define COMPASS_H
 
-#include "differentiate.h"
+#include "fixed_differentiate.h"
 #include "syntax_error.h"
 #include "exceptions.h"
 
@@ -97,7 +97,7 @@ class compass {
 
     protected:
         compass_hardware       *hw;
-        differentiate          *diff;
+        fixed_differentiate<100, halving_taps<8> > diff;
         float                   sample_rate;
 };
 
@@ -141,10 +141,25 @@ class compass_hardware
             ThrowException (NO_IO_BOARD);
         }
 
-        compass_hardware (void) : cps_scale (1.0) {}
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the data returned by the last successful
+         *                  Sample arrived (monotonic_us), or 0 if this
+         *                  hardware doesn't know.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
+        compass_hardware (void) : sample_stamp (0), cps_scale (1.0) {}
 
     protected:
         int             io_board_fd;            // File descriptor to I/O board reading
+        unsigned        sample_stamp;           // See SampleStamp
         float           cps_scale;
 };
 
@@ -43,6 +43,7 @@ class compass_xplane : public compass_hardware
                 if (ahrs->good == FALSE)
                     return (FALSE);
                 x = ahrs->heading * cps_scale;
+                sample_stamp = ahrs->SampleStamp ();
                 y = z = 0;
                 return (TRUE);
             }
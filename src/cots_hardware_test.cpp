@@ -31,61 +31,245 @@
 #include "xpdr_sl70r.h"
 #include "adahrs_grtaa301.h"
 #include "comm_sl40.h"
+#include "reactor.h"
+#include "capture.h"
+#include "port_detect.h"
+#include "utilities.h"
 
 
 gps            *TheGPS                  = NULL;
 compass        *TheCompass              = NULL;
 
-int main (int argc, char *argv[])
+// Give up on a replay this long after the file ran out and nothing new came in
+#define REPLAY_IDLE_USECS       500000
+
+// Time stamp of the newest sample, for the classes that keep one
+static unsigned sampleStamp(ahrs_xbow *dev) { return dev->SampleStamp(); }
+static unsigned sampleStamp(gps_ff *dev)    { return dev->SampleStamp(); }
+static unsigned sampleStamp(fad_fdatasystems *dev) { return dev->SampleStamp(); }
+static unsigned sampleStamp(adahrs_grtaa301 *dev) { return dev->ahrs_hardware::SampleStamp(); }
+template <class T> static unsigned sampleStamp(T *) { return 0; }
+
+// Readings a Sample() that returned TRUE brought in. The AHRS hardware
+// queues one per frame for the filter; take them all, as the filter would.
+static unsigned takeSamples(ahrs_hardware *dev) {
+  unsigned n = 0;
+  while (dev->NextSample()) n++;
+  return n;
+}
+static unsigned takeSamples(ahrs_xbow *dev) { return takeSamples((ahrs_hardware *)dev); }
+static unsigned takeSamples(adahrs_grtaa301 *dev) { return takeSamples((ahrs_hardware *)dev); }
+template <class T> static unsigned takeSamples(T *) { return 1; }
+
+/**
+ * pollDevice
+ * DESCRIPTION:     Samples the device every sleepusecs. Against a live port
+ *                  this runs until killed; against a replayed capture it
+ *                  stops once the capture is used up and prints throughput
+ *                  and, where the device stamps its samples, latency from
+ *                  the read to Sample() seeing it.
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+template <class T>
+static void pollDevice(T *dev, long sleepusecs, capture_replay *replay)
 {
-  if (argc != 4) {
-    fprintf(stderr, "Please enter <classname> <port> <poll_sleep_interval_microsecs> on cmd line\n");
-    fprintf(stderr,
-	    "  (Classnames supported: ahrs_xbow, fad_fdatasystems, gps_ff, xpdr_sl70r, adahrs_grtaa301, comm_sl40.h)\n");
-    exit(-1);
-  }
+  unsigned samples = 0, stamped = 0;
+  double latencySum = 0;
+  unsigned latencyMax = 0;
+  unsigned start = monotonic_us();
+  unsigned lastNew = start;
 
-  char *classname = argv[1];
-  char *port      = argv[2];
-  long sleepusecs = atoi(argv[3]);
+  if (replay != NULL) replay->Start();
+
+  while (1) {
+    bool newDataFlag = dev->Sample();
+    unsigned now = monotonic_us();
+    if (newDataFlag) {
+      samples += takeSamples(dev);
+      lastNew = now;
+      unsigned stamp = sampleStamp(dev);
+      if (stamp != 0) {
+	unsigned latency = now - stamp;
+	latencySum += latency;
+	if (latency > latencyMax) latencyMax = latency;
+	stamped++;
+      }
+    }
+    if (replay == NULL) {
+      printf(newDataFlag ? "FOUND New data\n" : "No new data\n");
+    }
+    else if (replay->done && now - lastNew > REPLAY_IDLE_USECS) {
+      break;
+    }
+    if (sleepusecs > 0) usleep(sleepusecs); // Simulate poll
+  }
 
-  fad_fdatasystems *fd;
-  adahrs_grtaa301 *adahrs;
-  xpdr_sl70r *xpdr;
-  gps_ff *gps;
-  ahrs_xbow *ahrs;
-  comm_sl40 *comm;
+  double secs = (lastNew - start) / 1e6;
+  if (secs <= 0) secs = 1e-6;
+  printf("%u samples from %llu bytes in %.3f s: %.1f samples/s, %.0f bytes/s\n",
+	 samples, replay->bytesSent, secs, samples / secs, replay->bytesSent / secs);
+  if (stamped > 0) {
+    printf("Latency read->Sample(): mean %.1f us, max %u us over %u samples\n",
+	   latencySum / stamped, latencyMax, stamped);
+  }
+  replay->Wait();
+}
 
+/**
+ * testDevice
+ * DESCRIPTION:     Opens the driver called "classname" on "port" and polls it
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static bool    // FALSE if there is no such class
+testDevice(const char *classname, const char *port, long sleepusecs, capture_replay *replay)
+{
   if (strcmp(classname, "fad_fdatasystems") == 0) {
-    fd = new fad_fdatasystems(port);
+    pollDevice(new fad_fdatasystems(port), sleepusecs, replay);
   }
   else if (strcmp(classname, "adahrs_grtaa301") == 0) {
-    adahrs = new adahrs_grtaa301(port);
-
-    while (1) {
-      //printf("Calling sample\n");
-      bool newDataFlag = adahrs->Sample();
-      if (!newDataFlag) {
-	printf("No new data\n");
-      }
-      else {
-	printf("FOUND New data\n");
-      }
-      usleep(sleepusecs); // Simulate poll
-    }
+    pollDevice(new adahrs_grtaa301(port), sleepusecs, replay);
   }
   else if (strcmp(classname, "xpdr_sl70r") == 0) {
-    xpdr = new xpdr_sl70r(port);
+    pollDevice(new xpdr_sl70r(port), sleepusecs, replay);
   }
   else if (strcmp(classname, "gps_ff") == 0) {
-    gps = new gps_ff(port);
+    pollDevice(new gps_ff(port), sleepusecs, replay);
   }
   else if (strcmp(classname, "ahrs_xbow") == 0) {
-    ahrs = new ahrs_xbow(port);
+    pollDevice(new ahrs_xbow(port), sleepusecs, replay);
   }
   else if (strcmp(classname, "comm_sl40") == 0) {
-    comm = new comm_sl40(port);
+    pollDevice(new comm_sl40(port), sleepusecs, replay);
   }
+  else {
+    return FALSE;
+  }
+  return TRUE;
+}
 
+static char detectedPort[80];
+
+/**
+ * detect
+ * DESCRIPTION:     Probes "ports" ("all", or names separated by commas),
+ *                  prints what is on each and picks the port the detector
+ *                  is surest of
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: detectedPort is the port picked
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static const char *    // Class name of the driver picked, NULL if none
+detect(const char *ports)
+{
+  static const char *defaultPorts[] = DETECT_DEFAULT_PORTS;
+  const char *names[MAX_STATS_PORTS];
+  int numPorts = 0;
+  char list[1024];
+
+  if (strcmp(ports, "all") == 0) {
+    for (unsigned i=0; i<NELEMENTS(defaultPorts); i++) names[numPorts++] = defaultPorts[i];
+  }
+  else {
+    strncpy(list, ports, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    char *save = NULL;
+    for (char *p = strtok_r(list, ",", &save); p != NULL && numPorts < (int)NELEMENTS(names);
+	 p = strtok_r(NULL, ",", &save)) {
+      names[numPorts++] = p;
+    }
+  }
+
+  portDetection results[MAX_STATS_PORTS];
+  unsigned start = monotonic_us();
+  detectPorts(names, numPorts, results);
+  printf("Probed %d ports in %.3f s\n", numPorts, (monotonic_us() - start) / 1e6);
+
+  const portDetection *best = NULL;
+  for (int i=0; i<numPorts; i++) {
+    const portDetection &r = results[i];
+    if (r.err != 0) {
+      printf("  %-16s %s\n", r.port, strerror(r.err));
+    }
+    else if (r.driver == NULL) {
+      printf("  %-16s nothing recognised (%d bytes heard)\n", r.port, r.bytes);
+    }
+    else {
+      printf("  %-16s %-18s %6d baud  %3d frames  confidence %.2f%s\n", r.port, r.driver->name,
+	     baudRate(r.baud), r.frames, r.confidence,
+	     (r.baud != r.driver->baud) ? "  (not the driver's baud)" : "");
+      if (best == NULL || r.confidence > best->confidence) best = &r;
+    }
+  }
+  if (best == NULL) {
+    fprintf(stderr, "No known device found\n");
+    return NULL;
+  }
+  strncpy(detectedPort, best->port, sizeof(detectedPort) - 1);
+  printf("Testing %s on %s\n", best->driver->name, detectedPort);
+  return best->driver->name;
 }
 
+int main (int argc, char *argv[])
+{
+  bool useReactor = FALSE;
+  double speed = 0;
+  bool argsOK = (argc >= 4);
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "reactor") == 0) useReactor = TRUE;
+    else if (strncmp(argv[i], "speed=", 6) == 0) speed = atof(argv[i] + 6);
+    else argsOK = FALSE;
+  }
+  if (!argsOK) {
+    fprintf(stderr, "Please enter <classname> <port|capture file> <poll_sleep_interval_microsecs> [reactor] [speed=N] on cmd line\n");
+    fprintf(stderr,
+	    "  (Classnames supported: ahrs_xbow, fad_fdatasystems, gps_ff, xpdr_sl70r, adahrs_grtaa301, comm_sl40.h)\n");
+    fprintf(stderr, "  (Classname auto probes the ports (\"all\" or port,port,...) and tests the device found)\n");
+    fprintf(stderr, "  (\"reactor\" reads the port on the I/O reactor thread instead of polling it)\n");
+    fprintf(stderr, "  (A capture file from $%s is replayed through a pty, as fast as it is read\n", CAPTURE_DIR_ENV);
+    fprintf(stderr, "   unless speed=N gives N times the captured rate)\n");
+    exit(-1);
+  }
+
+  const char *classname = argv[1];
+  const char *port = argv[2];
+  long sleepusecs = atoi(argv[3]);
+
+  if (strcmp(classname, "auto") == 0) {
+    if (captureFile::IsCapture(port)) {
+      fprintf(stderr, "auto probes live ports, not capture files\n");
+      exit(-1);
+    }
+    classname = detect(port);
+    if (classname == NULL) exit(-1);
+    port = detectedPort;
+  }
+
+  capture_replay *replay = NULL;
+  if (captureFile::IsCapture(port)) {
+    replay = new capture_replay();
+    if (!replay->Open(port, speed, 1)) exit(-1);
+    port = replay->SlaveName();
+    printf("Replaying %s through %s\n", argv[2], port);
+  }
+
+  if (useReactor) {
+    TheReactor = new io_reactor();
+    TheReactor->Start();
+  }
+
+  // The replay starts only once the driver has opened (and flushed) the port
+  if (!testDevice(classname, port, sleepusecs, replay)) {
+    fprintf(stderr, "Unknown class %s\n", classname);
+    exit(-1);
+  }
+
+  if (TheReactor != NULL) TheReactor->Stop();
+  delete replay;
+}
@@ -17,80 +17,29 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "differentiate.h"
 
-
-/**
- * Differentiate
- * DESCRIPTION:     Returns the 1st derivative.
- *                  able to compute the first derivative of those samples.
- *                  If the first derivative is
- *                  small, this class will look back in history
- *                  far enough to get at least 2 significant
- *                  digits, or until the history buffer is exhausted.
- * PRE-CONDITIONS:  None
- * POST-CONDITIONS: None
- * EXCEPTIONS THROWN:  NO_DATA
- * EXCEPTIONS HANDLED: None
- */
-float  // See Description
-    differentiate::Differentiate (void) const
+differentiate::differentiate
+(
+ const unsigned     hist_size,
+ const float       *filt,
+ const unsigned     ntaps
+)
 {
-    double      accumulator;
-    unsigned    index, count;
-    bool        nonzero;
+    // Zeroed so the entries not yet filled add nothing to the sums
+    buf.history = (int*) calloc (hist_size, sizeof(int));
+    buf.intervals = (unsigned*) calloc (hist_size, sizeof(unsigned));
+    assert ((buf.history != NULL) && (buf.intervals != NULL));
+    buf.size = hist_size;
+    buf.taps = filt;
+    buf.ntaps = ntaps;
+    buf.window = (ntaps < hist_size) ? ntaps : hist_size;
 
-    count = 0;
-    index = t0_index;
-    accumulator = 0;
-    nonzero = FALSE;
-    while (count < filter_ntaps)
-    {
-        int     h = history_buffer [index];
-        if (count >= elements_filled)
-            break;
-        if ((h < -1) || (h > 1))
-            nonzero = TRUE;
-        accumulator += (filter_taps [count++] * h);
-        if (index == 0)
-            index = history_size - 1;
-        else
-            --index;
-    }
-    if ((nonzero == FALSE) && (elements_filled > filter_ntaps))
-    {
-        bool    positive, negative;
-        // We have to search further back in history to get a small
-        // reading for the first derivative
-        count = 0;
-        index = t0_index;
-        accumulator = 0;
-        positive = negative = FALSE;
-        while (count < elements_filled)
-        {
-            int     h = history_buffer [index];
-            if ((h < -1) || (h > 1))
-                break;
-            if (h == 1)
-            {
-                if (negative)
-                    break;
-                positive = TRUE;
-            }
-            if (h == -1)
-            {
-                if (positive)
-                    break;
-                negative = TRUE;
-            }
-            accumulator += h;
-            if (index == 0)
-                index = history_size - 1;
-            else
-                --index;
-            count++;
-        }
-        accumulator /= count;
-    }
-    return ((float)accumulator);
+    buf.halving = (ntaps >= 2 && ntaps <= MAX_HALVING_TAPS && ntaps <= hist_size &&
+                   filt [ntaps - 1] == filt [ntaps - 2]);
+    for (unsigned i = 0; buf.halving && i < ntaps - 1; i++)
+        if (filt [i] != ldexpf (1, -(int)(i + 1)))
+            buf.halving = FALSE;
+    buf.last_weight = ldexp (1, -(int)ntaps);
 }
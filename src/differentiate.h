@@ -23,11 +23,106 @@
 
 #include "constants.h"
 
-// differentiate class: An abstraction for storing historical samples and being
-// able to compute the first derivative of those samples. If the first derivative is
-// small, this class will look back in history far enough to get at least 2 significant
-// digits, or until the history buffer is exhausted.
-class differentiate
+// The quiet stretch a derivative falls back on when its taps show nothing but
+// noise: the newest differences, all within +/-1 and never both +1 and -1.
+// Kept as running sums as the differences arrive.
+struct quiet_stretch
+{
+    unsigned            length;
+    unsigned            positive;               // +1 entries
+    unsigned            negative;               // -1 entries
+    long long           value;
+    unsigned long long  time;
+    unsigned            zeros;                  // 0 entries since the newest +/-1
+    unsigned long long  zeros_time;
+
+    void Reset (void)
+    {
+        length = positive = negative = zeros = 0;
+        value = 0;
+        time = zeros_time = 0;
+    }
+
+    // The newest difference
+    void Add (int h, unsigned interval)
+    {
+        if ((h < -1) || (h > 1))
+            Reset ();
+        else if (((h == 1) && (negative != 0)) || ((h == -1) && (positive != 0)))
+        {
+            // A change of direction: the stretch starts over from the newest
+            // opposite entry, which leaves this one and the 0's after it
+            length = zeros + 1;
+            positive = (h == 1);
+            negative = (h == -1);
+            value = h;
+            time = zeros_time + interval;
+            zeros = 0;
+            zeros_time = 0;
+        }
+        else
+        {
+            length++;
+            value += h;
+            time += interval;
+            if (h == 1)
+                positive++;
+            if (h == -1)
+                negative++;
+            if (h == 0)
+            {
+                zeros++;
+                zeros_time += interval;
+            }
+            else
+            {
+                zeros = 0;
+                zeros_time = 0;
+            }
+        }
+    }
+
+    // The oldest difference, as it leaves a history the stretch fills
+    void DropOldest (int h, unsigned interval)
+    {
+        value -= h;
+        time -= interval;
+        if (h == 1)
+            positive--;
+        if (h == -1)
+            negative--;
+        if (zeros == length)
+        {
+            zeros--;
+            zeros_time -= interval;
+        }
+        length--;
+    }
+};
+
+// Longest halving filter run as a recursion. Its sums stay exact in a
+// double (so equal to the tap by tap sums) for differences and intervals
+// under 2^24, which float taps need anyway.
+#define MAX_HALVING_TAPS        20
+
+// differentiate_core: the history and the sums behind a 1st derivative,
+// shared by differentiate (sizes and taps given at run time) and
+// fixed_differentiate (fixed at compile time). Buffers holds the history
+// and says what the filter is:
+//
+//   history, intervals         the differences and the uS each took
+//   Size ()                    entries in each
+//   NTaps (), Tap (k)          the filter, newest difference first
+//   Window ()                  entries the taps cover
+//   Halving ()                 taps are 1/2, 1/4, ... 2^-(n-1), 2^-(n-1)
+//   LastWeight ()              2^-n, with halving taps
+//
+// If the first derivative is small, this looks back in history far enough
+// to get at least 2 significant digits, or until the history buffer is
+// exhausted. The sums for both are kept as the samples are added, so
+// neither depends on how far back that is.
+template <class Buffers>
+class differentiate_core
 {
     public:
         /**
@@ -43,18 +138,32 @@ class differentiate
              int        value
             )
             {
-                assert (history_buffer != NULL);
-                // Increment and wrap t0_index
-                ++t0_index;
-                if (t0_index >= history_size)
-                    t0_index = 0;
+                Push ((elements_filled == 0) ? 0 : value - last_value, 0);
+                last_value = value;
+            }
+
+        /**
+         * AddSample
+         * DESCRIPTION:     Adds a sample taken at "stamp" (monotonic_us) to the
+         *                  history buffer, so Rate can use the real spacing
+         *                  of the samples.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void AddSample
+            (
+             int        value,
+             unsigned   stamp
+            )
+            {
                 if (elements_filled == 0)
-                    history_buffer [t0_index] = 0;
+                    Push (0, 0);
                 else
-                    history_buffer [t0_index] = value - last_value;
-                if (elements_filled < history_size)
-                    elements_filled++;
+                    Push (value - last_value, stamp - last_stamp);
                 last_value = value;
+                last_stamp = stamp;
             }
 
         /**
@@ -68,53 +177,227 @@ class differentiate
         unsigned  // See Description
             HistoryDepth (void) const
             {
-                return (history_size);
+                return (buf.Size ());
             }
 
         /**
          * Differentiate
          * DESCRIPTION:     Returns the 1st derivative.
-         *                  able to compute the first derivative of those samples.
          *                  If the first derivative is
          *                  small, this class will look back in history
          *                  far enough to get at least 2 significant
          *                  digits, or until the history buffer is exhausted.
          * PRE-CONDITIONS:  None
          * POST-CONDITIONS: None
-         * EXCEPTIONS THROWN:  NO_DATA
+         * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-        float  // See Description
-            Differentiate (void) const;
+        float  // Change in value per sample
+            Differentiate (void) const
+            {
+                double      value_sum, time_sum;
+                unsigned    count;
 
-        differentiate
-            (
-             const unsigned     hist_size,
-             const float       *filt,
-             const unsigned     ntaps
-            ) : history_size(hist_size), filter_taps(filt), filter_ntaps(ntaps)
+                Accumulate (value_sum, time_sum, count);
+                if (count != 0)
+                    value_sum /= count;
+                return ((float)value_sum);
+            }
+
+        /**
+         * Rate
+         * DESCRIPTION:     Returns the 1st derivative per second, from the
+         *                  same history entries Differentiate uses but
+         *                  divided by the time they actually spanned rather
+         *                  than an assumed sample period.
+         * PRE-CONDITIONS:  Samples added with time stamps
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        float  // Change in value per second, or 0 with no time span yet
+            Rate (void) const
             {
-                elements_filled = 0;
-                history_buffer = (int*) malloc (sizeof(int) * history_size);
-                t0_index = 0;
+                double      value_sum, time_sum;
+                unsigned    count;
+
+                Accumulate (value_sum, time_sum, count);
+                if (time_sum <= 0)
+                    return (0);
+                return ((float)(value_sum * 1000000.0 / time_sum));
             }
-        ~differentiate (void)
+
+    protected:
+        differentiate_core (void)
         {
-            if (history_buffer != NULL)
-                free (history_buffer);
+            last_value = 0;
+            last_stamp = 0;
+            elements_filled = 0;
+            t0_index = 0;
+            big_in_window = 0;
+            halving_value = halving_time = 0;
+            quiet.Reset ();
         }
-    protected:
+
+        Buffers         buf;
         int             last_value;             // The last value given
-        const unsigned  history_size;
-        unsigned        elements_filled;        // Starts at 0 and counts up to history_size
+        unsigned        last_stamp;             // Time stamp of the last sample
+        unsigned        elements_filled;        // Starts at 0 and counts up to Size ()
                                                 // as samples are added. Permanently saturates
-                                                // at history_size.
-        int            *history_buffer;         // Stores the historical differences
+                                                // at Size ().
         unsigned        t0_index;               // History index of most recent reading
                                                 // Wraps around continuously as new
                                                 // samples arrive
-        const float    *filter_taps;            // Filter for computing 1st derivative
-        const unsigned  filter_ntaps;           // Number of taps in the filter
+
+        // Kept up to date by Push so that Differentiate and Rate never walk
+        // the history
+        unsigned        big_in_window;          // Entries the taps cover outside +/-1
+        double          halving_value;          // With halving taps, the filter sum
+        double          halving_time;           // without the last tap's entry
+        quiet_stretch   quiet;                  // What Accumulate falls back on
+
+        // The entry "back" places before "index" in the history
+        unsigned Back (unsigned index, unsigned back) const
+        {
+            return ((index >= back) ? index - back : index + buf.Size () - back);
+        }
+
+        /**
+         * Push
+         * DESCRIPTION:     Stores a difference and the interval it took in the
+         *                  history, and updates what Accumulate returns so it
+         *                  doesn't have to look back through the history for it
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void Push (int h, unsigned interval)
+        {
+            unsigned    next, oldest;
+
+            next = t0_index + 1;
+            if (next >= buf.Size ())
+                next = 0;
+
+            // The oldest entry the taps see is about to drop out of their window
+            oldest = Back (next, buf.Window ());
+            if ((buf.history [oldest] < -1) || (buf.history [oldest] > 1))
+                big_in_window--;
+
+            // And the oldest in the history, out of the quiet stretch if it's in it
+            if ((elements_filled == buf.Size ()) && (quiet.length == buf.Size ()))
+                quiet.DropOldest (buf.history [next], buf.intervals [next]);
+
+            t0_index = next;
+            buf.history [t0_index] = h;
+            buf.intervals [t0_index] = interval;
+            if (elements_filled < buf.Size ())
+                elements_filled++;
+            if ((h < -1) || (h > 1))
+                big_in_window++;
+
+            if (buf.Halving ())
+            {
+                // Every entry moves one tap further on, at half the weight. The
+                // one reaching the last tap, which has the same weight as the one
+                // before, is added back by Accumulate.
+                unsigned    last = Back (t0_index, buf.NTaps () - 1);
+                halving_value = (h + halving_value) * 0.5 - buf.LastWeight () * buf.history [last];
+                halving_time = (interval + halving_time) * 0.5 - buf.LastWeight () * buf.intervals [last];
+            }
+
+            quiet.Add (h, interval);
+        }
+
+        // Filters the newest history through the taps. If that shows no change
+        // bigger than the noise (+/-1), uses the quiet stretch further back instead
+        // and returns its plain sums (count = entries summed, otherwise 0).
+        void Accumulate (double &value_sum, double &time_sum, unsigned &count_out) const
+        {
+            count_out = 0;
+            if ((big_in_window == 0) && (elements_filled > buf.NTaps ()))
+            {
+                value_sum = (double) quiet.value;
+                time_sum = (double) quiet.time;
+                count_out = quiet.length;
+                return;
+            }
+
+            if (buf.Halving ())
+            {
+                unsigned    last = Back (t0_index, buf.NTaps () - 1);
+                float       tap = buf.Tap (buf.NTaps () - 1);
+                value_sum = halving_value + (tap * buf.history [last]);
+                time_sum = halving_time + (tap * buf.intervals [last]);
+                return;
+            }
+
+            unsigned    index, count;
+
+            count = 0;
+            index = t0_index;
+            value_sum = time_sum = 0;
+            while ((count < buf.NTaps ()) && (count < elements_filled))
+            {
+                time_sum += (buf.Tap (count) * buf.intervals [index]);
+                value_sum += (buf.Tap (count++) * buf.history [index]);
+                if (index == 0)
+                    index = buf.Size () - 1;
+                else
+                    --index;
+            }
+        }
+};
+
+// The history of a differentiate, allocated when it's made
+struct runtime_buffers
+{
+    int                *history;
+    unsigned           *intervals;
+    unsigned            size;
+    const float        *taps;
+    unsigned            ntaps;
+    unsigned            window;
+    bool                halving;
+    double              last_weight;
+
+    unsigned Size (void) const { return (size); }
+    unsigned NTaps (void) const { return (ntaps); }
+    float Tap (unsigned k) const { return (taps [k]); }
+    unsigned Window (void) const { return (window); }
+    bool Halving (void) const { return (halving); }
+    double LastWeight (void) const { return (last_weight); }
+
+    runtime_buffers (void) : history (NULL), intervals (NULL), size (0), taps (NULL),
+                             ntaps (0), window (0), halving (FALSE), last_weight (0) {}
+    ~runtime_buffers (void)
+    {
+        if (history != NULL)
+            free (history);
+        if (intervals != NULL)
+            free (intervals);
+    }
+
+    private:
+        // Owns its buffers
+        runtime_buffers (const runtime_buffers &);
+        runtime_buffers &operator= (const runtime_buffers &);
+};
+
+// differentiate class: An abstraction for storing historical samples and being
+// able to compute the first derivative of those samples, with the history
+// depth and filter given when it's made. Instruments whose history depth and
+// taps are fixed use fixed_differentiate (fixed_differentiate.h) instead.
+class differentiate : public differentiate_core<runtime_buffers>
+{
+    public:
+        differentiate
+            (
+             const unsigned     hist_size,
+             const float       *filt,
+             const unsigned     ntaps
+            );
 };
 
 #endif /* DIFFERENTIATE_H */
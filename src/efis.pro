@@ -28,6 +28,10 @@ SOURCES	+= efis.cpp \
 #        gps_xplane.cpp \
 #        autopilot_xplane.cpp \
         serial.cpp\
+        framescan.cpp\
+        reactor.cpp\
+        capture.cpp\
+        port_stats.cpp\
         eis/eis.cpp\
         eis/eis_tach.cpp\
         eis/eis_map.cpp\
@@ -68,9 +72,18 @@ HEADERS	+= efis.h \
         constants.h \
         gps_ff.h \
         serial.h \
+        framescan.h \
+        reactor.h \
+        spsc_queue.h \
+        capture.h \
+        checksum.h \
+        wire_fields.h \
+        port_stats.h \
         eis/eis.h \
         stamp_sensors.h
 
+LIBS	+= -lrt
+
 unix {
   UI_DIR = .ui
   MOC_DIR = .moc
@@ -0,0 +1,179 @@
+// efis_stat.cpp: Prints the port counters a running efis publishes
+//
+// Maps the port_stats page read-only, so it can be run at any rate, or left
+// running, without disturbing the ports.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "constants.h"
+#include "port_stats.h"
+
+static void usage (void)
+{
+    fprintf (stderr, "usage: efis-stat [-n shm_name] [-i secs] [-g] [-a]\n");
+    fprintf (stderr, "  -n N   read page N (default $%s or %s)\n", PORT_STATS_NAME_ENV, PORT_STATS_SHM_NAME);
+    fprintf (stderr, "  -i N   print every N seconds, with rates, until interrupted\n");
+    fprintf (stderr, "  -g     also print each port's inter-frame gap histogram\n");
+    fprintf (stderr, "  -a     include ports that have been closed (marked *)\n");
+    exit (-1);
+}
+
+// Every counter is read once into a local copy, so a line is consistent
+// with itself even while the ports carry on counting.
+static void snapshot (const portStatsPage *page, portStatsPage *copy)
+{
+    const uint32_t *from = (const uint32_t *)page;
+    uint32_t *to = (uint32_t *)copy;
+    for (unsigned i = 0; i < sizeof (portStatsPage) / sizeof (uint32_t); i++)
+        to [i] = __atomic_load_n (&from [i], __ATOMIC_RELAXED);
+}
+
+static void printGaps (const portStats *s)
+{
+    printf ("    gaps:");
+    for (int b = 0; b < PORT_GAP_BUCKETS; b++)
+    {
+        if (s->gapHist [b] == 0)
+            continue;
+        if (b == 0)
+            printf (" 0us:%u", s->gapHist [b]);
+        else if (b == PORT_GAP_BUCKETS - 1)
+            printf (" >=%uus:%u", 1u << (b - 1), s->gapHist [b]);
+        else
+            printf (" <%uus:%u", 1u << b, s->gapHist [b]);
+    }
+    printf ("\n");
+}
+
+static void printTypes (const portStats *s)
+{
+    if (s->numTypes == 0)
+        return;
+    printf ("    types:");
+    for (unsigned t = 0; t < s->numTypes && t < MAX_STATS_TYPES; t++)
+        printf (" 0x%x:%u", s->typeIds [t], s->framesByType [t]);
+    printf ("\n");
+}
+
+static void printWrites (const portStats *s)
+{
+    if (s->writeDrops == 0 && s->partialWrites == 0 && s->writeErrors == 0)
+        return;
+    printf ("    tx: %u dropped, %u partial, %u errors\n", s->writeDrops,
+            s->partialWrites, s->writeErrors);
+}
+
+static void print (const portStatsPage *now, const portStatsPage *last, double secs,
+                   bool gaps, bool closed)
+{
+    printf ("pid %u, %u driver checksum failures\n", now->pid, now->checksumFails);
+    printf (" %-27s %10s %10s %9s %9s %7s %7s %6s %6s", "port", "rx bytes", "tx bytes",
+            "frames", "delivered", "badsum", "resync", "ovfl", "drops");
+    if (last != NULL)
+        printf (" %9s %8s", "rx B/s", "frames/s");
+    printf ("\n");
+
+    for (unsigned i = 0; i < now->numPorts && i < MAX_STATS_PORTS; i++)
+    {
+        const portStats *s = &now->ports [i];
+        if (!s->inUse && (!closed || s->name [0] == '\0'))
+            continue;
+        printf ("%c%-27.27s %10u %10u %9u %9u %7u %7u %6u %6u", s->inUse ? ' ' : '*',
+                s->name, s->bytesRead, s->bytesWritten, s->frames, s->framesDelivered,
+                s->checksumRejects, s->resyncs, s->overflows, s->queueDrops);
+        if (last != NULL)
+        {
+            const portStats *l = &last->ports [i];
+            if (strcmp (l->name, s->name) != 0)
+                l = s;          // Port was reopened; no rate this time
+            printf (" %9.0f %8.1f", (s->bytesRead - l->bytesRead) / secs,
+                    (s->frames - l->frames) / secs);
+        }
+        printf ("\n");
+        printTypes (s);
+        printWrites (s);
+        if (gaps)
+            printGaps (s);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    const char *name = getenv (PORT_STATS_NAME_ENV);
+    int         interval = 0;
+    bool        gaps = FALSE;
+    bool        closed = FALSE;
+    int         opt;
+
+    if (name == NULL)
+        name = PORT_STATS_SHM_NAME;
+    while ((opt = getopt (argc, argv, "n:i:ga")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':   name = optarg;              break;
+            case 'i':   interval = atoi (optarg);   break;
+            case 'g':   gaps = TRUE;                break;
+            case 'a':   closed = TRUE;              break;
+            default:    usage ();
+        }
+    }
+    if (optind != argc || interval < 0)
+        usage ();
+
+    int fd = shm_open (name, O_RDONLY, 0);
+    if (fd == -1)
+    {
+        fprintf (stderr, "efis-stat: %s: %s\n", name, strerror (errno));
+        exit (-1);
+    }
+    void *map = mmap (NULL, sizeof (portStatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf (stderr, "efis-stat: %s: %s\n", name, strerror (errno));
+        exit (-1);
+    }
+    const portStatsPage *page = (const portStatsPage *)map;
+    if (__atomic_load_n (&page->magic, __ATOMIC_ACQUIRE) != PORT_STATS_MAGIC ||
+        page->version != PORT_STATS_VERSION)
+    {
+        fprintf (stderr, "efis-stat: %s is not a version %d stats page\n", name, PORT_STATS_VERSION);
+        exit (-1);
+    }
+
+    static portStatsPage now, last;
+    snapshot (page, &now);
+    print (&now, NULL, 0, gaps, closed);
+    while (interval > 0)
+    {
+        sleep (interval);
+        last = now;
+        snapshot (page, &now);
+        printf ("\n");
+        print (&now, &last, interval, gaps, closed);
+        fflush (stdout);
+    }
+    return (0);
+}
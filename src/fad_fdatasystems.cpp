@@ -27,15 +27,20 @@
 #include "exceptions.h"
 #include "constants.h"
 #include "fad_fdatasystems.h"
-#include "shadinZ.h"
+
+#define STX 0x02
+#define ETX 0x03
 
 using namespace std;
 
 fad_fdatasystems::fad_fdatasystems(const char *port)
 {
     good = FALSE;
+    sample_stamp = 0;
+    memset(&data, 0, sizeof(data));
     serialPtr = new serial(port, TRUE);
     initialize();
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
 }
 
 
@@ -53,6 +58,29 @@ void fad_fdatasystems::initialize() {
 }
 
 
+int fad_fdatasystems::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  shadinZ zParser;
+  shadinZData zData;
+  int frames = 0;
+  int blockStart = -1;
+  covered = 0;
+  memset(&zData, 0, sizeof(zData));
+
+  // Fed a block at a time, so each good one can be counted
+  for (int i=0, from=0; i<len; i++) {
+    if (buf[i] == STX) blockStart = i;
+    if (buf[i] != ETX) continue;
+    if (zParser.Parse(&buf[from], i + 1 - from, zData) && blockStart >= from) {
+      frames++;
+      covered += i + 1 - blockStart;
+    }
+    from = i + 1;
+  }
+  return frames;
+}
+
+
 /**
  * Sample
  * DESCRIPTION:     Sample gps data.
@@ -68,13 +96,18 @@ fad_fdatasystems::Sample()
 {
   bool foundAtLeastOneDataFrame = FALSE;
   unsigned char framePtr[256];
+  int frameLen;
+  unsigned stamp;
   // Keep reading frames as longs as returning good ones...
   try {
-    while(serialPtr->getFrame(framePtr) == TRUE) {
+    while(serialPtr->getFrame(framePtr, frameLen, &stamp) == TRUE) {
       /*for (int i=0; i<256; i++) {
 	printf("%02x: ", framePtr[i]);
 	}*/
-      parseDataFrame(framePtr);
+      if (parser.Parse(framePtr, frameLen, data)) {
+	foundAtLeastOneDataFrame = TRUE;
+	sample_stamp = stamp;
+      }
     } 
   }
   catch(string errStr) {
@@ -82,20 +115,11 @@ fad_fdatasystems::Sample()
     return FALSE;
   }
 
-  return(foundAtLeastOneDataFrame);
-}
-
-void fad_fdatasystems::parseDataFrame(unsigned char *framePtr) {
-  shadinZ *shadinZPtr = NULL;
-  try {
-    shadinZPtr = new shadinZ((char *)framePtr);
-    // TODO: set member variables
-    shadinZPtr->printValues(); // TODO: remove debug later
-  }
-  catch(string errStr) {
-    if (shadinZPtr != NULL) delete(shadinZPtr); // Cleanup
-    ThrowException(errStr); // Rethrow
+  if (foundAtLeastOneDataFrame) {
+    good = TRUE;
+    if (DEBUG) shadinZ::printValues(data);
   }
+  return(foundAtLeastOneDataFrame);
 }
 
 
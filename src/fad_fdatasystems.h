@@ -21,15 +21,19 @@
 
 
 #include "serial.h"
+#include "shadinZ.h"
 
 
 class fad_fdatasystems {
     // Members
     public:
         bool            good;           // A known good reading has been taken
+        shadinZData     data;           // Latest air data and fuel values, read
+                                        // directly by their consumers
     protected:
         serial *serialPtr;
-        //shadinZ *shadinZPtr;
+        shadinZ parser;
+        unsigned sample_stamp;
     // Funcs
     public:
         /**
@@ -45,28 +49,44 @@ class fad_fdatasystems {
                         // of calling this function.
             Sample (void);
 
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the block behind the current data arrived
+         *                  (monotonic_us), or 0 if none has yet.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
         fad_fdatasystems(const char *port);
 
-    protected:   
         /**
-         * initialize
-         * DESCRIPTION:    Conditions device/comm port for reading data
+         * Recognize
+         * DESCRIPTION:     Counts the Z format blocks that shadinZ accepts
+         *                  in bytes heard on a port (see port_detect.h)
          * PRE-CONDITIONS:  None
-         * POST-CONDITIONS: None
+         * POST-CONDITIONS: covered is the number of bytes, STX to ETX, in
+         *                  those blocks
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-	void initialize(void);
+        static int      // Good blocks found
+            Recognize (const unsigned char *buf, int len, int &covered);
 
+    protected:   
         /**
-         * parseDataFrame
-         * DESCRIPTION:    Extracts data from serial frame and sets members
+         * initialize
+         * DESCRIPTION:    Conditions device/comm port for reading data
          * PRE-CONDITIONS:  None
          * POST-CONDITIONS: None
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-	void parseDataFrame(unsigned char *framePtr);
+	void initialize(void);
 };
 
 #endif
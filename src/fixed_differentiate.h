@@ -0,0 +1,94 @@
+// fixed_differentiate.h: Differentiator with its history size and taps fixed at compile time
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef FIXED_DIFFERENTIATE_H
+#define FIXED_DIFFERENTIATE_H
+
+#include <math.h>
+#include <string.h>
+
+#include "constants.h"
+#include "differentiate.h"
+
+// fixed_differentiate<HistorySize, Taps> computes what differentiate does,
+// for instruments whose history depth and filter are the same every time.
+// The history lives in the object itself and the sizes are constants, so
+// nothing is allocated and the wrap-arounds need no divides. The taps come
+// from a table class:
+//
+//   NTAPS                      number of taps
+//   HALVING                    1 if the taps are halving_taps<NTAPS>
+//   Tap (k)                    weight of the k'th newest difference
+//
+// Halving taps are run as differentiate runs them, as a recursion costing
+// the same whatever NTAPS is; others tap by tap. differentiate stays for
+// filters only known at run time.
+//
+// Each instrument keeps its own, engine channels included. A bank doing a
+// group of channels sampled together a column at a time (one ring head and
+// one set of intervals per group, the quiet stretches without branches) gave
+// the same results but was no faster at 6 or 16 channels, and slower for
+// the instruments' groups of 1 or 2.
+
+// 1/2, 1/4, ... 2^-(N-1), 2^-(N-1): the filter the instruments build
+template <unsigned N>
+struct halving_taps
+{
+    enum { NTAPS = N, HALVING = 1 };
+    static float Tap (unsigned k)
+    {
+        return (ldexpf (1, -(int)((k < N - 1) ? k + 1 : N - 1)));
+    }
+};
+
+// The history of a fixed_differentiate, in the object
+template <unsigned HistorySize, class Taps>
+struct fixed_buffers
+{
+    int                 history [HistorySize];
+    unsigned            intervals [HistorySize];
+    double              last_weight;
+
+    unsigned Size (void) const { return (HistorySize); }
+    unsigned NTaps (void) const { return (Taps::NTAPS); }
+    float Tap (unsigned k) const { return (Taps::Tap (k)); }
+    unsigned Window (void) const { return (Taps::NTAPS); }
+    bool Halving (void) const { return (Taps::HALVING != 0); }
+    double LastWeight (void) const { return (last_weight); }
+
+    fixed_buffers (void)
+    {
+        // Zeroed so the entries not yet filled add nothing to the sums
+        memset (history, 0, sizeof (history));
+        memset (intervals, 0, sizeof (intervals));
+        last_weight = ldexp (1, -(int)Taps::NTAPS);
+    }
+
+    // The taps must fit in the history, and a halving filter be one
+    // the recursion keeps exact
+    typedef char taps_fit [(Taps::NTAPS >= 1 && Taps::NTAPS <= HistorySize) ? 1 : -1];
+    typedef char halving_fits [(!Taps::HALVING ||
+                                (Taps::NTAPS >= 2 && Taps::NTAPS <= MAX_HALVING_TAPS)) ? 1 : -1];
+};
+
+// All of it is differentiate_core's
+template <unsigned HistorySize, class Taps>
+class fixed_differentiate : public differentiate_core<fixed_buffers<HistorySize, Taps> >
+{
+};
+
+#endif /* FIXED_DIFFERENTIATE_H */
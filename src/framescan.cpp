@@ -0,0 +1,227 @@
+// framescan.cpp: Fast searches for frame start bytes in received serial data
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "framescan.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define FRAMESCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef int (*findHeaderFn) (const unsigned char *, int, const unsigned char *, int);
+typedef int (*findAnyByteFn) (const unsigned char *, int, const unsigned char *, int);
+
+static findHeaderFn  findHeaderImpl = NULL;
+static findAnyByteFn findAnyByteImpl = NULL;
+static const char   *implName = "scalar";
+
+
+int findHeaderScalar (const unsigned char *buf, int len,
+                      const unsigned char *hdr, int hdrLen)
+{
+    int last = len - hdrLen; // Last place a whole header fits
+    int i = 0;
+    while (i <= last)
+    {
+        const unsigned char *p = (const unsigned char *)memchr (&buf[i], hdr[0], last - i + 1);
+        if (p == NULL)
+            return (-1);
+        i = p - buf;
+        if (memcmp (p + 1, hdr + 1, hdrLen - 1) == 0)
+            return (i);
+        i++;
+    }
+    return (-1);
+}
+
+
+int findAnyByteScalar (const unsigned char *buf, int len,
+                       const unsigned char *set, int numSet)
+{
+    if (numSet == 1)
+    {
+        const unsigned char *p = (const unsigned char *)memchr (buf, set[0], len);
+        return ((p == NULL) ? -1 : p - buf);
+    }
+    for (int i = 0; i < len; i++)
+    {
+        for (int j = 0; j < numSet; j++)
+        {
+            if (buf[i] == set[j])
+                return (i);
+        }
+    }
+    return (-1);
+}
+
+
+#ifdef FRAMESCAN_X86
+
+// Each pass looks at 16 candidate start positions. Only when one of them
+// has the right first byte are the rest of the header bytes compared, each
+// with one more unaligned load shifted over by a byte.
+__attribute__((target("sse2")))
+static int findHeaderSSE2 (const unsigned char *buf, int len,
+                           const unsigned char *hdr, int hdrLen)
+{
+    int last = len - hdrLen;
+    int i = 0;
+    __m128i first = _mm_set1_epi8 ((char)hdr[0]);
+    for (; i + 15 <= last; i += 16)
+    {
+        __m128i match = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *)&buf[i]), first);
+        if (_mm_movemask_epi8 (match) == 0)
+            continue;
+        for (int j = 1; j < hdrLen; j++)
+        {
+            __m128i bytes = _mm_loadu_si128 ((const __m128i *)&buf[i + j]);
+            match = _mm_and_si128 (match, _mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ((char)hdr[j])));
+        }
+        unsigned mask = _mm_movemask_epi8 (match);
+        if (mask != 0)
+            return (i + __builtin_ctz (mask));
+    }
+    int idx = findHeaderScalar (&buf[i], len - i, hdr, hdrLen);
+    return ((idx < 0) ? -1 : i + idx);
+}
+
+
+__attribute__((target("avx2")))
+static int findHeaderAVX2 (const unsigned char *buf, int len,
+                           const unsigned char *hdr, int hdrLen)
+{
+    int last = len - hdrLen;
+    int i = 0;
+    __m256i first = _mm256_set1_epi8 ((char)hdr[0]);
+    for (; i + 31 <= last; i += 32)
+    {
+        __m256i match = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *)&buf[i]), first);
+        if (_mm256_movemask_epi8 (match) == 0)
+            continue;
+        for (int j = 1; j < hdrLen; j++)
+        {
+            __m256i bytes = _mm256_loadu_si256 ((const __m256i *)&buf[i + j]);
+            match = _mm256_and_si256 (match, _mm256_cmpeq_epi8 (bytes, _mm256_set1_epi8 ((char)hdr[j])));
+        }
+        unsigned mask = _mm256_movemask_epi8 (match);
+        if (mask != 0)
+            return (i + __builtin_ctz (mask));
+    }
+    int idx = findHeaderSSE2 (&buf[i], len - i, hdr, hdrLen);
+    return ((idx < 0) ? -1 : i + idx);
+}
+
+
+__attribute__((target("sse2")))
+static int findAnyByteSSE2 (const unsigned char *buf, int len,
+                            const unsigned char *set, int numSet)
+{
+    int i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128 ((const __m128i *)&buf[i]);
+        __m128i match = _mm_setzero_si128 ();
+        for (int j = 0; j < numSet; j++)
+            match = _mm_or_si128 (match, _mm_cmpeq_epi8 (bytes, _mm_set1_epi8 ((char)set[j])));
+        unsigned mask = _mm_movemask_epi8 (match);
+        if (mask != 0)
+            return (i + __builtin_ctz (mask));
+    }
+    int idx = findAnyByteScalar (&buf[i], len - i, set, numSet);
+    return ((idx < 0) ? -1 : i + idx);
+}
+
+
+__attribute__((target("avx2")))
+static int findAnyByteAVX2 (const unsigned char *buf, int len,
+                            const unsigned char *set, int numSet)
+{
+    int i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256 ((const __m256i *)&buf[i]);
+        __m256i match = _mm256_setzero_si256 ();
+        for (int j = 0; j < numSet; j++)
+            match = _mm256_or_si256 (match, _mm256_cmpeq_epi8 (bytes, _mm256_set1_epi8 ((char)set[j])));
+        unsigned mask = _mm256_movemask_epi8 (match);
+        if (mask != 0)
+            return (i + __builtin_ctz (mask));
+    }
+    int idx = findAnyByteSSE2 (&buf[i], len - i, set, numSet);
+    return ((idx < 0) ? -1 : i + idx);
+}
+
+#endif /* FRAMESCAN_X86 */
+
+
+// Pick the best implementation the CPU supports. Every thread that races
+// through here picks the same one, so no locking is needed.
+static void pickImpl (void)
+{
+    findHeaderFn  headerFn = findHeaderScalar;
+    findAnyByteFn anyByteFn = findAnyByteScalar;
+    implName = "scalar";
+#ifdef FRAMESCAN_X86
+    if (getenv ("FRAMESCAN_SCALAR") == NULL)
+    {
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("avx2"))
+        {
+            headerFn = findHeaderAVX2;
+            anyByteFn = findAnyByteAVX2;
+            implName = "avx2";
+        }
+        else if (__builtin_cpu_supports ("sse2"))
+        {
+            headerFn = findHeaderSSE2;
+            anyByteFn = findAnyByteSSE2;
+            implName = "sse2";
+        }
+    }
+#endif
+    findAnyByteImpl = anyByteFn;
+    findHeaderImpl = headerFn;
+}
+
+
+int findHeader (const unsigned char *buf, int len,
+                const unsigned char *hdr, int hdrLen)
+{
+    if (findHeaderImpl == NULL)
+        pickImpl ();
+    return (findHeaderImpl (buf, len, hdr, hdrLen));
+}
+
+
+int findAnyByte (const unsigned char *buf, int len,
+                 const unsigned char *set, int numSet)
+{
+    if (findAnyByteImpl == NULL)
+        pickImpl ();
+    return (findAnyByteImpl (buf, len, set, numSet));
+}
+
+
+const char *framescanImpl (void)
+{
+    if (findHeaderImpl == NULL)
+        pickImpl ();
+    return (implName);
+}
@@ -0,0 +1,76 @@
+// framescan.h: Fast searches for frame start bytes in received serial data
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef FRAMESCAN_H
+#define FRAMESCAN_H
+
+// On x86 the searches below pick an AVX2 or SSE2 version the first time
+// they are called, depending on what the CPU has. Everywhere else (or with
+// FRAMESCAN_SCALAR set in the environment) they fall back to memchr/memcmp.
+
+/**
+ * findHeader
+ * DESCRIPTION:     Finds the first complete copy of "hdr" in "buf". Every
+ *                  header byte is compared 16 or 32 candidate positions at
+ *                  a time.
+ * PRE-CONDITIONS:  hdrLen >= 1
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+int     // Offset of the header in buf, or -1 if there is none
+    findHeader (const unsigned char *buf, int len,
+                const unsigned char *hdr, int hdrLen);
+
+/**
+ * findAnyByte
+ * DESCRIPTION:     Finds the first byte in "buf" that is one of the "numSet"
+ *                  bytes in "set" (e.g. the first bytes of several headers).
+ * PRE-CONDITIONS:  numSet >= 1
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+int     // Offset of the byte in buf, or -1 if there is none
+    findAnyByte (const unsigned char *buf, int len,
+                 const unsigned char *set, int numSet);
+
+/**
+ * findHeaderScalar / findAnyByteScalar
+ * DESCRIPTION:     The portable versions of the above; used when there is no
+ *                  vector unit and by the benchmark for comparison.
+ * PRE-CONDITIONS:  As above
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+int findHeaderScalar (const unsigned char *buf, int len,
+                      const unsigned char *hdr, int hdrLen);
+int findAnyByteScalar (const unsigned char *buf, int len,
+                       const unsigned char *set, int numSet);
+
+/**
+ * framescanImpl
+ * DESCRIPTION:     Name of the implementation in use ("avx2", "sse2", "scalar")
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+const char *framescanImpl (void);
+
+#endif /* FRAMESCAN_H */
@@ -38,20 +38,16 @@ void gps::Update (void)
     //if (hw->Sample (lat, lng, ground_track, ground_speed, unix_time))
     if (hw->Sample())
     {
-        dv->AddSample (ground_speed);
-        float x = dv->Differentiate();
+        dv.AddSample (ground_speed);
+        float x = dv.Differentiate();
         delta_v = x * sample_rate;
         good = TRUE;
     }
 }
 
-static float    deltav_filt [] =
-{ 0.6, 0.3, 0.07, 0.03};
-
 gps::gps (void)
 {
     hw = NULL;
-    dv = new differentiate (NELEMENTS(deltav_filt), deltav_filt, NELEMENTS(deltav_filt));
     good = FALSE;
 }
 
@@ -96,6 +92,7 @@ gps::DutyCycle
 gps_hardware::gps_hardware(void)
 {
     good = FALSE;
+    sample_stamp = 0;
     lat = 0;
     lng = 0;
     track = 0;
@@ -19,12 +19,23 @@
 #ifndef GPS_H
 #define GPS_H
 
-#include "differentiate.h"
+#include "fixed_differentiate.h"
 
 #define GPS_IDEAL_SAMPLE_PERIOD    500000
 
 class gps_hardware;
 
+// Filter for the ground speed differences that make delta_v
+struct deltav_taps
+{
+    enum { NTAPS = 4, HALVING = 0 };
+    static float Tap (unsigned k)
+    {
+        static const float  taps [NTAPS] = { 0.6, 0.3, 0.07, 0.03 };
+        return (taps [k]);
+    }
+};
+
 class gps {
     public:
         double          lat, lng;       // Position in degrees
@@ -83,7 +94,7 @@ class gps {
 
     protected:
         gps_hardware           *hw;
-        differentiate          *dv;     // 1st deriviative of speed for delta_v
+        fixed_differentiate<4, deltav_taps> dv;     // 1st deriviative of speed for delta_v
         float                   sample_rate;
 };
 
@@ -119,6 +130,20 @@ class gps_hardware
         virtual float   // See Description
             TimeBase (void) const;
 
+        /**
+         * SampleStamp
+         * DESCRIPTION:     When the data returned by the last successful
+         *                  Sample arrived (monotonic_us), or 0 if this
+         *                  hardware doesn't know.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        unsigned  // See Description
+            SampleStamp (void) const
+            {return (sample_stamp);}
+
         gps_hardware(void);
 
     public:
@@ -132,6 +157,7 @@ class gps_hardware
 
     protected:
         int             io_board_fd;            // File descriptor to I/O board reading
+        unsigned        sample_stamp;           // See SampleStamp
 };
 
 #endif
@@ -25,6 +25,17 @@
 
 #include "constants.h"
 #include "gps_ff.h"
+#include "wire_fields.h"
+#include "checksum.h"
+
+// Navigation packet (NAV_PACKET_ID), IEEE floats sent big-endian
+//         name               offset  type      order    scale
+WIRE_FIELD(navState,          2,      uint8_t,  WIRE_BE, 1);
+WIRE_FIELD(navTimeOfFix,      5,      float,    WIRE_BE, 1);       // Secs since beg of UTC day that pos was computed
+WIRE_FIELD(navLat,            9,      double,   WIRE_BE, 180/M_PI); // degrees
+WIRE_FIELD(navLng,            17,     double,   WIRE_BE, 180/M_PI);
+WIRE_FIELD(navAlt,            25,     double,   WIRE_BE, 1);
+WIRE_FIELD(navUtcTime,        33,     float,    WIRE_BE, 1);       // Secs since beg of UTC day
 
 #define NAV_PACKET_ID 0x51
 #define NAV_PACKET_LEN 91
@@ -33,6 +44,9 @@
 #define GWSS_STATUS_PACKET_ID 0x5e
 #define GWSS_STATUS_PACKET_LEN 10
 
+#define DLE 0x10
+#define ETX 0x03
+
  // TODO: autodetect architecture so don't assume little endian (intel, etc.)
 
 gps_ff::gps_ff(const char *port)
@@ -50,6 +64,7 @@ gps_ff::gps_ff(const char *port)
     serialPtr->setFrameStart(startArray, sizeof(startArray));
     serialPtr->setFrameEnd(stopArray, sizeof(stopArray));
     serialPtr->setMinMaxFrameLen(10, 91);
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
 }
 
 gps_ff::gps_ff()
@@ -62,6 +77,67 @@ void gps_ff::initialize() {
 }
 
 
+// Every packet Sample parses: its decoded length (with the DLE at the front
+// and the DLE ETX at the end) and the last byte of each summed run, whose
+// 16 bit checksum follows it.
+static const struct {
+  unsigned char id;
+  int           len;
+  int           stop[2];        // -1 if there is only one checksum
+} tsipPackets[] = {
+  { NAV_PACKET_ID,           NAV_PACKET_LEN,           { 36, 86 } },
+  { PFDE_RESPONSE_PACKET_ID, PFDE_RESPONSE_PACKET_LEN, { 30, -1 } },
+  { GWSS_STATUS_PACKET_ID,   GWSS_STATUS_PACKET_LEN,   { 5,  -1 } }
+};
+
+int gps_ff::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  unsigned char pkt[NAV_PACKET_LEN];
+  int frames = 0;
+  covered = 0;
+
+  for (int i=0; i+1<len; i++) {
+    // A DLE starts a packet unless it is a stuffed one or the end of one
+    if (buf[i] != DLE || buf[i+1] == DLE || buf[i+1] == ETX) continue;
+
+    // Take out the stuffing up to the DLE ETX
+    int n = 0;
+    int j = i + 1;
+    pkt[n++] = DLE;
+    while (j < len && n < (int)sizeof(pkt)) {
+      if (buf[j] != DLE) {
+	pkt[n++] = buf[j++];
+      }
+      else if (j + 1 < len && buf[j+1] == DLE) {
+	pkt[n++] = DLE;
+	j += 2;
+      }
+      else {
+	break;
+      }
+    }
+    if (j + 1 >= len || buf[j] != DLE || buf[j+1] != ETX || n + 2 > (int)sizeof(pkt)) continue;
+    pkt[n++] = DLE;
+    pkt[n++] = ETX;
+
+    for (unsigned p=0; p<NELEMENTS(tsipPackets); p++) {
+      if (pkt[1] != tsipPackets[p].id || n != tsipPackets[p].len) continue;
+      bool ok = checksum<sum16_be>::Ok(pkt, 0, tsipPackets[p].stop[0], tsipPackets[p].stop[0] + 1);
+      if (ok && tsipPackets[p].stop[1] >= 0) {
+	ok = checksum<sum16_be>::Ok(pkt, 0, tsipPackets[p].stop[1], tsipPackets[p].stop[1] + 1);
+      }
+      if (ok) {
+	frames++;
+	covered += j + 2 - i;
+	i = j + 1;
+      }
+      break;
+    }
+  }
+  return frames;
+}
+
+
 /**
  * Sample
  * DESCRIPTION:     Sample gps data.
@@ -77,35 +153,38 @@ gps_ff::Sample()
 {
   bool foundAtLeastOneDataFrame = FALSE;
   unsigned char framePtr[256];
+  int frameLen;
+  unsigned stamp;
   // Keep reading frames as longs as returning good ones...
-  while(serialPtr->getFrame(framePtr) == TRUE) {
+  while(serialPtr->getFrame(framePtr, frameLen, &stamp) == TRUE) {
 
     unsigned char packetIdByte = framePtr[1]; // Packet id byte is always the second one.
     switch (packetIdByte) {
     case NAV_PACKET_ID:
       if (DEBUG) {
 	printf("Found NAV_PACKET_ID\n");
-	for (unsigned int a=0; a<NAV_PACKET_LEN; a++) {
+	for (int a=0; a<frameLen; a++) {
 	  printf("%02x ",framePtr[a]);
 	}
 	printf("\n");
       }
       foundAtLeastOneDataFrame = TRUE;
-      parseNavPacket(framePtr);
+      parseNavPacket(framePtr, frameLen);
+      sample_stamp = stamp;
       break;
     case PFDE_RESPONSE_PACKET_ID:
       if (DEBUG) printf("Found PFDE_RESPONSE_PACKET_ID\n");
-      parsePfdeResponsePacket(framePtr);
+      parsePfdeResponsePacket(framePtr, frameLen);
       break;
     case GWSS_STATUS_PACKET_ID:
       if (DEBUG) {
 	printf("Found GWSS_STATUS_PACKET_ID\n");
-	for (unsigned int a=0; a<GWSS_STATUS_PACKET_LEN; a++) {
+	for (int a=0; a<frameLen; a++) {
 	  printf("%02x ",framePtr[a]);
 	}
 	printf("\n");
       }
-      parseGwssStatusPacket(framePtr);
+      parseGwssStatusPacket(framePtr, frameLen);
       break;
     default:
       printf("ERROR - Unrecognized packet id: %x\n", packetIdByte);
@@ -119,18 +198,19 @@ gps_ff::Sample()
 
 
 
-bool gps_ff::parseNavPacket(unsigned char *pktPtr) {
+bool gps_ff::parseNavPacket(unsigned char *pktPtr, int len) {
+  if (len < NAV_PACKET_LEN) return FALSE; // Cut short
 
-  if (serial::checksumGood(pktPtr,0, 36, 37) == FALSE) return FALSE;
+  if (serialPtr->portChecksumGood(pktPtr,0, 36, 37) == FALSE) return FALSE;
   // There's two checksums in this packet
-  if (serial::checksumGood(pktPtr,0, 86, 87) == FALSE) return FALSE;
-
-  unsigned char nav_state = pktPtr[2];
-  float time_of_fix = parseFloatFromPacket(pktPtr, 5); // Secs since beg of UTC day that pos was computed
-  lat = parseDoubleFromPacket(pktPtr, 9) * 180/M_PI;
-  lng = parseDoubleFromPacket(pktPtr, 17) * 180/M_PI;
-  gps_altitude = parseDoubleFromPacket(pktPtr, 25);
-  float utc_time = parseFloatFromPacket(pktPtr, 33); // Secs since beg of UTC day
+  if (serialPtr->portChecksumGood(pktPtr,0, 86, 87) == FALSE) return FALSE;
+
+  unsigned char nav_state = navState::Raw(pktPtr);
+  float time_of_fix = navTimeOfFix::Raw(pktPtr);
+  lat = navLat::Get(pktPtr);
+  lng = navLng::Get(pktPtr);
+  gps_altitude = navAlt::Raw(pktPtr);
+  float utc_time = navUtcTime::Raw(pktPtr);
   
 
   if (DEBUG) printf("Lat=%f Lon=%f Alt=%f NavState=%d\n", lat, lng, gps_altitude, nav_state);
@@ -140,34 +220,21 @@ bool gps_ff::parseNavPacket(unsigned char *pktPtr) {
 }
 
 
-bool gps_ff::parsePfdeResponsePacket(unsigned char *pktPtr) {
-  if (serial::checksumGood(pktPtr, 0, 30, 31) == FALSE) return FALSE;
+bool gps_ff::parsePfdeResponsePacket(unsigned char *pktPtr, int len) {
+  if (len < PFDE_RESPONSE_PACKET_LEN) return FALSE;
+  if (serialPtr->portChecksumGood(pktPtr, 0, 30, 31) == FALSE) return FALSE;
   return TRUE;
 }
 
-bool gps_ff::parseGwssStatusPacket(unsigned char *pktPtr) {
-  if (serial::checksumGood(pktPtr, 0, 5, 6) == FALSE) return FALSE;
+bool gps_ff::parseGwssStatusPacket(unsigned char *pktPtr, int len) {
+  if (len < GWSS_STATUS_PACKET_LEN) return FALSE;
+  if (serialPtr->portChecksumGood(pktPtr, 0, 5, 6) == FALSE) return FALSE;
 
 
   return TRUE;
 }
 
 
-float gps_ff::parseFloatFromPacket(unsigned char *pktPtr, int startIdx) {
-  float floatFoo = 0;
-  memcpy(&floatFoo,  &pktPtr[startIdx], 4);
-  serialPtr->byteswap((void *)&floatFoo, 4); // Change from big-endian to little
-  return floatFoo;
-}
-
-double gps_ff::parseDoubleFromPacket(unsigned char *pktPtr, int startIdx) {
-  double dblFoo = 0;
-  memcpy(&dblFoo,  &pktPtr[startIdx], 8);
-  serialPtr->byteswap((void *)&dblFoo, 8); // Change from big-endian to little
-  return dblFoo;
-}
-
-
 /**
  * TimeBase
  * DESCRIPTION:     Returns how many times per second a new history entry
@@ -19,9 +19,6 @@
 #include "gps.h"
 
 
-#define FRAME_BUF_SIZE 20000 // TODO: move this buffer stuff in the serial class???
-// TODO: ...because I have this declared in two header files so far - could cause confusion
-
 // This class interfaces with the gps/waas tso c145 confroming device that provides
 // "cooked" gps data with fault detection, exclusion, and raim.
 class gps_ff : public gps_hardware
@@ -30,7 +27,6 @@ class gps_ff : public gps_hardware
         //int good; // TODO: Take out when inherit from parent
 
     protected:
-	unsigned char frameDataBuf[FRAME_BUF_SIZE]; // TODO: sized correctly?
         serial *serialPtr;
         double gps_altitude;
 
@@ -52,6 +48,19 @@ class gps_ff : public gps_hardware
         gps_ff(void);
         gps_ff(const char *port);
 
+        /**
+         * Recognize
+         * DESCRIPTION:     Counts the DLE framed packets of known id, length
+         *                  and checksums in bytes heard on a port (see
+         *                  port_detect.h). Stuffed DLEs are taken out first.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of raw bytes in those packets
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        static int      // Good packets found
+            Recognize (const unsigned char *buf, int len, int &covered);
+
 
      protected:
         /**
@@ -80,15 +89,14 @@ class gps_ff : public gps_hardware
         /**
          * parseNavPacket
          * DESCRIPTION:    Extracts data from serial frame and sets members
-         * PRE-CONDITIONS:  None
+         * PRE-CONDITIONS:  len is the frame's decoded length from
+         *                  serial::getFrame; short frames are rejected
          * POST-CONDITIONS: None
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-	bool parseNavPacket(unsigned char*);
-	bool parsePfdeResponsePacket(unsigned char *);
-	bool parseGwssStatusPacket(unsigned char *);
-	double parseDoubleFromPacket(unsigned char * pktPtr, int startIdx);
-	float parseFloatFromPacket(unsigned char *, int startIdx);
+	bool parseNavPacket(unsigned char*, int len);
+	bool parsePfdeResponsePacket(unsigned char *, int len);
+	bool parseGwssStatusPacket(unsigned char *, int len);
 };
 
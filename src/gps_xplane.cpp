@@ -38,8 +38,6 @@
 #include "airspeed_xplane.h"
 #include "gps_xplane.h"
 
-extern char    rcv_buffer [1500];
-
 /**
  * Sample
  * DESCRIPTION:     Sample sensor data.
@@ -53,67 +51,57 @@ bool    // Returns TRUE if new data was available
                 // of calling this function.
 gps_xplane::Sample ()
 {
-    struct sockaddr_in          lp;
-    int                         size, fromlen;
     int                         type;
+    const unsigned char        *record;
+    unsigned                    n;
+    unsigned                    stamp;
     bool                        ret;
 
-    lp.sin_family = AF_INET;
-    lp.sin_port = 49000;
-    lp.sin_addr.s_addr = INADDR_LOOPBACK;
-
-    fromlen = sizeof (lp);
-
     assert (sizeof(int) == sizeof(float));
     ret = FALSE;
-    while (1)
+    while (source->Next (type, record, stamp, n))
     {
-        size = recvfrom (io_board_fd, rcv_buffer, sizeof (rcv_buffer), 0,
-                         (struct sockaddr*) &lp, (socklen_t*)&fromlen);
-        if (size == -1)
-            break;
-
-        memcpy (&type, rcv_buffer, sizeof(type));
         switch (type)
         {
             case XPT_LAT_LONG_ALT:
                 //printf ("LAT, LONG, ALT:\n"
                 //        "  %15f%15f%15f%15f\n"
                 //        "  %15f%15f%15f%15f\n",
-                //        ((float*)rcv_buffer) [1],
-                //        ((float*)rcv_buffer) [2],
-                //        ((float*)rcv_buffer) [3],
-                //        ((float*)rcv_buffer) [4],
-                //        ((float*)rcv_buffer) [5],
-                //        ((float*)rcv_buffer) [6],
-                //        ((float*)rcv_buffer) [7],
-                //        ((float*)rcv_buffer) [8]);
-                if (++oversample_counter >= XP_FRAME_RATE)
+                //        xplaneValue (record, 0),
+                //        xplaneValue (record, 1),
+                //        xplaneValue (record, 2),
+                //        xplaneValue (record, 3),
+                //        xplaneValue (record, 4),
+                //        xplaneValue (record, 5),
+                //        xplaneValue (record, 6),
+                //        xplaneValue (record, 7));
+                if ((oversample_counter += n) >= XP_FRAME_RATE)
                 {
                     ret = TRUE;
                     oversample_counter = 0;
                     tm = time(0);
-                    lat = ((float*) rcv_buffer) [1];
-                    lng = ((float*) rcv_buffer) [2];
+                    lat = xplaneValue (record, 0);
+                    lng = xplaneValue (record, 1);
                     track = 0;
                     if (as != NULL)
                         speed = (unsigned) roundf (as->vgrnd);
                 }
-                altitude = ((float*) rcv_buffer) [3];
+                altitude = xplaneValue (record, 2);
+                sample_stamp = stamp;
                 good = TRUE;
                 break;
             case XPT_GPS:
                 //printf ("GPS:\n"
                 //        "  %15f%15f%15f%15f\n"
                 //        "  %15f%15f%15f%15f\n",
-                //        ((float*)rcv_buffer) [1],
-                //        ((float*)rcv_buffer) [2],
-                //        ((float*)rcv_buffer) [3],
-                //        ((float*)rcv_buffer) [4],
-                //        ((float*)rcv_buffer) [5],
-                //        ((float*)rcv_buffer) [6],
-                //        ((float*)rcv_buffer) [7],
-                //        ((float*)rcv_buffer) [8]);
+                //        xplaneValue (record, 0),
+                //        xplaneValue (record, 1),
+                //        xplaneValue (record, 2),
+                //        xplaneValue (record, 3),
+                //        xplaneValue (record, 4),
+                //        xplaneValue (record, 5),
+                //        xplaneValue (record, 6),
+                //        xplaneValue (record, 7));
                 break;
             default:
                 ThrowException (INVALID_MSG);
@@ -142,8 +130,6 @@ float   // See Description
 
 gps_xplane::gps_xplane ()
 {
-    struct sockaddr_in  lcl;
-
     ::gps_hardware();
 
     altitude = 0;
@@ -152,16 +138,6 @@ gps_xplane::gps_xplane ()
 
     oversample_counter = 0;
 
-    io_board_fd = socket (PF_INET, SOCK_DGRAM, 0);
-    if (io_board_fd == -1)
-    {
-        perror ("gps_xplane: socket");
-        ThrowException(errno);
-    }
-    lcl.sin_family = AF_INET;
-    lcl.sin_port = htons(48000);
-    lcl.sin_addr.s_addr = INADDR_ANY;
-
-    bind (io_board_fd, (struct sockaddr*) &lcl, sizeof (lcl));
-    fcntl (io_board_fd, F_SETFL, O_NONBLOCK);
+    source = new xplane_source (XPLANE_GPS, 48000, "gps_xplane");
+    io_board_fd = source->Fd ();
 }
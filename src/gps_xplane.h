@@ -16,6 +16,7 @@
 //
 //
 
+#include "xplane_ingest.h"
 #include "differentiate.h"
 #include "gps.h"
 
@@ -66,6 +67,7 @@ class gps_xplane : public gps_hardware
 
         gps_xplane (void);
     protected:
+        xplane_source  *source;
         unsigned        oversample_counter;
         airspeed_xplane*as;
 };
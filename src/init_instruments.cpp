@@ -81,6 +81,10 @@ void InitInstruments (void)
             /* No Xplane stuff
             if (!strcmp (hardware_name, "xplane"))
             {
+                // X-Plane's packets come straight to us; no relay
+                if (TheXPlane == NULL)
+                    TheXPlane               = new xplane_ingest ();
+
                 // Instantiate and bind all avionics classes
                 TheAHRS                     = new ahrs_cooked ();
                 ahrs_xplane        *ax      = new ahrs_xplane ();
@@ -22,6 +22,9 @@
 #include <qapplication.h>
 #include <qmessagebox.h>
 #include <qgl.h>
+#include <stdio.h>
+
+#include "reactor.h"
 
 void InitInstruments (void);
 
@@ -41,6 +44,19 @@ int main( int argc, char **argv )
     mainWindow.resize( 1024, 768 );
     mainWindow.show();
 
+    // The ports the instruments open receive on the reactor thread, so it
+    // has to be running before they are made. Without it they poll.
+    try {
+        TheReactor = new io_reactor ();
+        TheReactor->Start ();
+    }
+    catch (const int code)
+    {
+        fprintf (stderr, "No reactor thread (exception %d); the instruments will poll\n", code);
+        delete TheReactor;
+        TheReactor = NULL;
+    }
+
     InitInstruments ();
     
 //    QMessageBox::information( &mainWindow, "EFIS 0.1.0",
@@ -53,6 +69,10 @@ int main( int argc, char **argv )
     
     a.connect( &a, SIGNAL(lastWindowClosed()), &a, SLOT(quit()) );
 
-    return a.exec();
+    int status = a.exec();
+
+    if (TheReactor != NULL)
+        TheReactor->Stop ();
+    return status;
     
 }
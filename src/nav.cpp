@@ -61,10 +61,10 @@ void nav::Update (void)
         }
 
         gsi = rawgsi;
-        cdi_diff->AddSample (cdi);
-        gsi_diff->AddSample (rawgsi);
-        float c = cdi_diff->Differentiate();
-        float g = gsi_diff->Differentiate();
+        cdi_diff.AddSample (cdi);
+        gsi_diff.AddSample (rawgsi);
+        float c = cdi_diff.Differentiate();
+        float g = gsi_diff.Differentiate();
         cdi_prime = c * sample_rate;
         gsi_prime = g * sample_rate;
         cdi_good = TRUE;
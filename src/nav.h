@@ -16,7 +16,7 @@
 //
 //
 
-#include "differentiate.h"
+#include "fixed_differentiate.h"
 
 #define NAV_IDEAL_SAMPLE_PERIOD    1000000
 
@@ -64,8 +64,8 @@ class nav {
         nav (void) {cdi_good = gsi_good = FALSE;}
     protected:
         nav_hardware   *hw;
-        differentiate  *cdi_diff;
-        differentiate  *gsi_diff;
+        fixed_differentiate<100, halving_taps<8> > cdi_diff;
+        fixed_differentiate<100, halving_taps<8> > gsi_diff;
         float           sample_rate;
 };
 
@@ -37,8 +37,6 @@
 
 #include "nav_xplane.h"
 
-extern char    rcv_buffer [1500];
-
 /**
  * Sample
  * DESCRIPTION:     Sample sensor data.
@@ -56,36 +54,24 @@ nav_xplane::Sample
  int   &gsi
 )
 {
-    struct sockaddr_in          lp;
-    int                         size, fromlen;
     int                         type;
+    const unsigned char        *record;
+    unsigned                    stamp, n;
     bool                        ret;
 
-    lp.sin_family = AF_INET;
-    lp.sin_port = 49000;
-    lp.sin_addr.s_addr = INADDR_LOOPBACK;
-
-    fromlen = sizeof (lp);
-
     assert (sizeof(int) == sizeof(float));
     ret = FALSE;
-    while (1)
+    while (source->Next (type, record, stamp, n))
     {
-        size = recvfrom (io_board_fd, rcv_buffer, sizeof (rcv_buffer), 0,
-                         (struct sockaddr*) &lp, (socklen_t*)&fromlen);
-        if (size == -1)
-            break;
-
-        memcpy (&type, rcv_buffer, sizeof(type));
         switch (type)
         {
             case XPT_NAV_DEFLECT:
-                if (++oversample_counter >= XP_FRAME_RATE / NAV_SAMPLE_RATE)
+                if ((oversample_counter += n) >= XP_FRAME_RATE / NAV_SAMPLE_RATE)
                 {
                     ret = TRUE;
                     oversample_counter = 0;
-                    cdi = (int)roundf (((float*) rcv_buffer) [1] * cdi_scale);
-                    gsi = (int)roundf (((float*) rcv_buffer) [2] * gsi_scale);
+                    cdi = (int)roundf (xplaneValue (record, 0) * cdi_scale);
+                    gsi = (int)roundf (xplaneValue (record, 1) * gsi_scale);
                 }
                 break;
             default:
@@ -115,22 +101,10 @@ float   // See Description
 
 nav_xplane::nav_xplane ()
 {
-    struct sockaddr_in  lcl;
-
     ::nav_hardware();
 
     oversample_counter = 0;
 
-    io_board_fd = socket (PF_INET, SOCK_DGRAM, 0);
-    if (io_board_fd == -1)
-    {
-        perror ("nav_xplane: socket");
-        ThrowException(errno);
-    }
-    lcl.sin_family = AF_INET;
-    lcl.sin_port = htons (48005);
-    lcl.sin_addr.s_addr = INADDR_ANY;
-
-    bind (io_board_fd, (struct sockaddr*) &lcl, sizeof (lcl));
-    fcntl (io_board_fd, F_SETFL, O_NONBLOCK);
+    source = new xplane_source (XPLANE_NAV, 48005, "nav_xplane");
+    io_board_fd = source->Fd ();
 }
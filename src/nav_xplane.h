@@ -16,6 +16,7 @@
 //
 //
 
+#include "xplane_ingest.h"
 #include "nav.h"
 
 class nav_xplane : public nav_hardware
@@ -53,6 +54,7 @@ class nav_xplane : public nav_hardware
 
         nav_xplane (void);
     protected:
+        xplane_source  *source;
         unsigned        oversample_counter;
 };
 
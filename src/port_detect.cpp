@@ -0,0 +1,311 @@
+// port_detect.cpp: Works out which device is on which serial port, and at what baud
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "utilities.h"
+#include "port_detect.h"
+#include "ahrs_xbow.h"
+#include "adahrs_grtaa301.h"
+#include "gps_ff.h"
+#include "fad_fdatasystems.h"
+#include "xpdr_sl70r.h"
+#include "comm_sl40.h"
+
+// Bytes are scored at most this often while a window is open, to see
+// whether the port can stop early
+#define DETECT_SCORE_MSECS      25
+
+// Confidences this close are as good as equal
+#define DETECT_NATIVE_MARGIN    0.1
+
+// The 1 Hz ones: the GPS's nav packet, the Shadin Z block, and the SL70R
+// and SL40, which may only speak up on a change
+static const detectDriver drivers[] = {
+    { "ahrs_xbow",          B38400, 1e6 / XBOW_FRAME_PERIOD,    ahrs_xbow::Recognize },
+    { "adahrs_grtaa301",    B19200, 1e6 / GRT_FRAME_PERIOD,     adahrs_grtaa301::Recognize },
+    { "gps_ff",             B19200, 1,                          gps_ff::Recognize },
+    { "fad_fdatasystems",   B9600,  1,                          fad_fdatasystems::Recognize },
+    { "xpdr_sl70r",         B9600,  1e6 / XPDR_SAMPLE_PERIOD,   xpdr_sl70r::Recognize },
+    { "comm_sl40",          B9600,  1e6 / COMM_SAMPLE_PERIOD,   comm_sl40::Recognize }
+};
+
+static const struct {
+    speed_t     baud;
+    int         rate;
+} bauds [] = {
+    { B1200, 1200 }, { B2400, 2400 }, { B4800, 4800 }, { B9600, 9600 },
+    { B19200, 19200 }, { B38400, 38400 }, { B57600, 57600 }, { B115200, 115200 }
+};
+
+// One port's probe, run on its own thread
+struct portProbe {
+    portDetection  *result;
+    int             windowMsecs;
+    int             quietMsecs;
+    pthread_t       thread;
+    bool            threaded;
+};
+
+
+const detectDriver *detectDrivers (int &numDrivers)
+{
+    numDrivers = NELEMENTS (drivers);
+    return (drivers);
+}
+
+
+int baudRate (speed_t baud)
+{
+    for (unsigned i = 0; i < NELEMENTS (bauds); i++)
+        if (bauds [i].baud == baud)
+            return (bauds [i].rate);
+    return (0);
+}
+
+
+// Good frames that make a driver sure of what it heard over "heardUsecs"
+static float sureFrames (const detectDriver &driver, unsigned heardUsecs)
+{
+    float sends = ceil (driver.framesPerSec * heardUsecs / 1e6);
+    if (sends < 1)
+        sends = 1;
+    return ((sends < DETECT_SURE_FRAMES) ? sends : DETECT_SURE_FRAMES);
+}
+
+
+// Best driver for one window of bytes heard at "baud", the first of them
+// "heardUsecs" ago
+static void scoreWindow (const unsigned char *buf, int len, speed_t baud, unsigned heardUsecs,
+                         portDetection &best)
+{
+    best.driver = NULL;
+    best.baud = baud;
+    best.frames = 0;
+    best.bytes = len;
+    best.confidence = 0;
+    if (len == 0)
+        return;
+
+    for (unsigned d = 0; d < NELEMENTS (drivers); d++)
+    {
+        int covered;
+        int frames = drivers [d].recognize (buf, len, covered);
+        if (frames == 0)
+            continue;
+        float confidence = (float)covered / len;
+        float sure = sureFrames (drivers [d], heardUsecs);
+        if (frames < sure)
+            confidence = confidence * frames / sure;
+        if (confidence > best.confidence)
+        {
+            best.driver = &drivers [d];
+            best.frames = frames;
+            best.confidence = confidence;
+        }
+    }
+}
+
+
+// Best score wins, but of two within DETECT_NATIVE_MARGIN of each other the
+// one at its driver's own baud does
+static bool better (const portDetection &a, const portDetection &b)
+{
+    if (a.driver == NULL)
+        return (FALSE);
+    if (b.driver == NULL)
+        return (TRUE);
+    bool aNative = (a.baud == a.driver->baud);
+    bool bNative = (b.baud == b.driver->baud);
+    if (aNative != bNative && fabs (a.confidence - b.confidence) <= DETECT_NATIVE_MARGIN)
+        return (aNative);
+    return (a.confidence > b.confidence);
+}
+
+
+static bool setBaud (int fd, speed_t baud)
+{
+    struct termios  t;
+    if (tcgetattr (fd, &t) == -1)
+        return (FALSE);
+    cfmakeraw (&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cflag &= ~CRTSCTS;
+    cfsetispeed (&t, baud);
+    cfsetospeed (&t, baud);
+    if (tcsetattr (fd, TCSANOW, &t) == -1)
+        return (FALSE);
+    // Whatever came in at the old baud is no use
+    tcflush (fd, TCIFLUSH);
+    return (TRUE);
+}
+
+
+/**
+ * listenWindow
+ * DESCRIPTION:     Collects what the port sends for up to "windowMsecs"
+ *                  from the first byte, waiting up to "quietMsecs" for
+ *                  that, and scores it. Ends the window early once a driver
+ *                  is sure at its own baud, or the buffer is full.
+ * PRE-CONDITIONS:  Port is set to "baud"
+ * POST-CONDITIONS: best is the window's best driver, if any
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static void listenWindow (int fd, speed_t baud, int windowMsecs, int quietMsecs,
+                          unsigned char *buf, portDetection &best)
+{
+    unsigned    start = monotonic_us ();
+    unsigned    lastScore = start;
+    unsigned    windowUsecs = windowMsecs * 1000;
+    unsigned    quietUsecs = (quietMsecs > windowMsecs) ? quietMsecs * 1000 : windowUsecs;
+    int         len = 0;
+
+    best.driver = NULL;
+    while (len < DETECT_BUF_LEN)
+    {
+        unsigned now = monotonic_us ();
+        unsigned left = (len == 0) ? quietUsecs - (now - start) : windowUsecs - (now - start);
+        if ((int)left <= 0)
+            break;
+        if (len > 0 && now - lastScore >= DETECT_SCORE_MSECS * 1000)
+        {
+            lastScore = now;
+            scoreWindow (buf, len, baud, now - start, best);
+            if (best.driver != NULL && best.driver->baud == baud && best.confidence >= DETECT_SURE)
+                return;
+        }
+
+        struct pollfd   pfd = { fd, POLLIN, 0 };
+        int wait = (left + 999) / 1000;
+        if (wait > DETECT_SCORE_MSECS)
+            wait = DETECT_SCORE_MSECS;
+        if (poll (&pfd, 1, wait) <= 0)
+            continue;
+        int n = read (fd, &buf [len], DETECT_BUF_LEN - len);
+        if (n > 0)
+        {
+            if (len == 0)
+                start = monotonic_us ();    // The window starts with the talking
+            len += n;
+        }
+        else if (n == -1 && errno != EAGAIN && errno != EINTR)
+            break;
+    }
+    scoreWindow (buf, len, baud, monotonic_us () - start, best);
+}
+
+
+static void *probePort (void *arg)
+{
+    portProbe      *probe = (portProbe *)arg;
+    portDetection  *r = probe->result;
+    unsigned        start = monotonic_us ();
+
+    int fd = open (r->port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd == -1)
+    {
+        r->err = errno;
+        r->usecs = monotonic_us () - start;
+        return (NULL);
+    }
+    struct termios  saved;
+    bool            restore = (tcgetattr (fd, &saved) == 0);
+    unsigned char  *buf = new unsigned char [DETECT_BUF_LEN];
+
+    // Each baud any driver uses, once, in table order
+    for (unsigned d = 0; d < NELEMENTS (drivers); d++)
+    {
+        speed_t baud = drivers [d].baud;
+        bool tried = FALSE;
+        for (unsigned e = 0; e < d; e++)
+            tried = tried || (drivers [e].baud == baud);
+        if (tried)
+            continue;
+        if (!setBaud (fd, baud))
+        {
+            r->err = errno;
+            break;
+        }
+
+        portDetection   window;
+        listenWindow (fd, baud, probe->windowMsecs, probe->quietMsecs, buf, window);
+        if (DEBUG)
+            printf ("port_detect: %s at %d: %d bytes, %s %d frames (%.2f)\n", r->port,
+                    baudRate (baud), window.bytes, window.driver ? window.driver->name : "nothing",
+                    window.frames, window.confidence);
+
+        if (better (window, *r))
+        {
+            r->driver = window.driver;
+            r->baud = window.baud;
+            r->frames = window.frames;
+            r->bytes = window.bytes;
+            r->confidence = window.confidence;
+        }
+        if (window.bytes == 0 && r->driver == NULL)
+            break;      // Quiet this long at one baud is quiet at all of them
+        if (r->driver != NULL && r->baud == r->driver->baud && r->confidence >= DETECT_SURE)
+            break;
+    }
+
+    delete [] buf;
+    if (restore)
+        tcsetattr (fd, TCSANOW, &saved);
+    close (fd);
+    r->usecs = monotonic_us () - start;
+    return (NULL);
+}
+
+
+int detectPorts (const char * const *ports, int numPorts, portDetection *results, int windowMsecs,
+                 int quietMsecs)
+{
+    portProbe  *probes = new portProbe [numPorts];
+
+    for (int i = 0; i < numPorts; i++)
+    {
+        memset (&results [i], 0, sizeof (portDetection));
+        results [i].port = ports [i];
+        probes [i].result = &results [i];
+        probes [i].windowMsecs = windowMsecs;
+        probes [i].quietMsecs = quietMsecs;
+        probes [i].threaded = (pthread_create (&probes [i].thread, NULL, probePort, &probes [i]) == 0);
+        if (!probes [i].threaded)
+            probePort (&probes [i]);        // No thread to spare; do it here
+    }
+
+    int found = 0;
+    for (int i = 0; i < numPorts; i++)
+    {
+        if (probes [i].threaded)
+            pthread_join (probes [i].thread, NULL);
+        if (results [i].driver != NULL)
+            found++;
+    }
+    delete [] probes;
+    return (found);
+}
@@ -0,0 +1,98 @@
+// port_detect.h: Works out which device is on which serial port, and at what baud
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef PORT_DETECT_H
+#define PORT_DETECT_H
+
+#include <termios.h>
+
+// Every port gets its own thread, so ports are probed side by side and the
+// whole job takes as long as the slowest port. On each port the detector
+// listens at every baud a known driver uses, for a short window per baud,
+// and scores what it heard against every driver's framing and checksums
+// (each driver's Recognize). It only listens; nothing is sent to a port.
+//
+// A port stops early once a driver is recognised at its own baud with
+// DETECT_SURE confidence. A window runs from the first byte heard, and
+// waits up to DETECT_QUIET_MSECS for it, long enough for a 1 Hz talker; a
+// port that stays silent that long is given up on as quiet. A driver that
+// sends too seldom to fill DETECT_SURE_FRAMES in a window needs fewer
+// frames to be sure.
+#define DETECT_WINDOW_MSECS     300     // Listen this long at each baud
+#define DETECT_QUIET_MSECS      1100    // Wait this long for a silent port to say something
+#define DETECT_BUF_LEN          8192    // Bytes kept from one window
+#define DETECT_SURE_FRAMES      3       // Fewer good frames than this lowers the confidence
+#define DETECT_SURE             0.9     // Confidence that ends a port's probing
+
+// The ports "all" means: the usual two on the board and four USB adapters
+#define DETECT_DEFAULT_PORTS    { "/dev/ttyS0", "/dev/ttyS1", "/dev/ttyUSB0", \
+                                  "/dev/ttyUSB1", "/dev/ttyUSB2", "/dev/ttyUSB3" }
+
+// detectDriver: A driver the detector can recognise
+struct detectDriver {
+    const char *name;           // Class name, as cots_hardware_test takes it
+    speed_t     baud;           // What its constructor sets the port to
+    float       framesPerSec;   // How often it sends when it is talking
+    int       (*recognize) (const unsigned char *buf, int len, int &covered);
+};
+
+// portDetection: What was found on one port
+struct portDetection {
+    const char         *port;
+    const detectDriver *driver; // NULL if nothing was recognised
+    speed_t             baud;   // Baud the driver was heard at
+    int                 frames; // Good frames it sent in that window
+    int                 bytes;  // Bytes heard in that window
+    float               confidence;     // 0 - 1, see detectPorts
+    int                 err;    // errno if the port couldn't be opened, else 0
+    unsigned            usecs;  // How long the port took
+};
+
+/**
+ * detectPorts
+ * DESCRIPTION:     Probes all "numPorts" ports at once and fills in one
+ *                  result per port. A driver's confidence is the share of
+ *                  the bytes heard that were in its good frames, scaled down
+ *                  if there were fewer of them than DETECT_SURE_FRAMES, or
+ *                  than the driver sends in the time heard if that is fewer
+ *                  (but at least one). On a port where more than one baud
+ *                  scores, the best wins, and of near equals the one at the
+ *                  driver's own baud.
+ * PRE-CONDITIONS:  No driver has the ports open
+ * POST-CONDITIONS: Each port is closed again, its settings put back
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+int     // Number of ports a driver was recognised on
+    detectPorts (const char * const *ports, int numPorts, portDetection *results,
+                 int windowMsecs = DETECT_WINDOW_MSECS,
+                 int quietMsecs = DETECT_QUIET_MSECS);
+
+/**
+ * detectDrivers
+ * DESCRIPTION:     The drivers detectPorts knows, and how many there are
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+const detectDriver *detectDrivers (int &numDrivers);
+
+// Bits per second of a B* baud constant, 0 if unknown
+int baudRate (speed_t baud);
+
+#endif /* PORT_DETECT_H */
@@ -0,0 +1,110 @@
+// port_stats.cpp: Per-port I/O and framing counters, published in shared memory
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "constants.h"
+#include "port_stats.h"
+
+static portStatsPage    privatePage;    // Used if there's no shared memory
+static portStatsPage   *page = NULL;
+static pthread_once_t   pageOnce = PTHREAD_ONCE_INIT;
+
+// Each run starts the page over. It is left in place at exit so the
+// counters can still be read after the process has gone.
+static void openPage (void)
+{
+    const char *name = getenv (PORT_STATS_NAME_ENV);
+    if (name == NULL)
+        name = PORT_STATS_SHM_NAME;
+
+    page = &privatePage;
+    int fd = shm_open (name, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || ftruncate (fd, sizeof (portStatsPage)) == -1)
+    {
+        fprintf (stderr, "port_stats: can't publish %s: %s\n", name, strerror (errno));
+        if (fd != -1)
+            close (fd);
+    }
+    else
+    {
+        void *map = mmap (NULL, sizeof (portStatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close (fd);
+        if (map == MAP_FAILED)
+            fprintf (stderr, "port_stats: can't map %s: %s\n", name, strerror (errno));
+        else
+            page = (portStatsPage *)map;
+    }
+
+    memset (page, 0, sizeof (portStatsPage));
+    page->version = PORT_STATS_VERSION;
+    page->pid = getpid ();
+    // Readers check the magic last of all
+    __atomic_store_n (&page->magic, PORT_STATS_MAGIC, __ATOMIC_RELEASE);
+}
+
+
+portStatsPage *portStatsPageOf (void)
+{
+    pthread_once (&pageOnce, openPage);
+    return (page);
+}
+
+
+portStats *portStatsClaim (const char *name)
+{
+    portStatsPage *p = portStatsPageOf ();
+
+    for (int i = 0; i < MAX_STATS_PORTS; i++)
+    {
+        portStats *slot = &p->ports [i];
+        if (!__sync_bool_compare_and_swap (&slot->inUse, 0, 1))
+            continue;
+
+        // Clear everything but inUse, which now says the slot is ours
+        memset ((char *)slot + sizeof (slot->inUse), 0, sizeof (*slot) - sizeof (slot->inUse));
+        strncpy (slot->name, name, PORT_STATS_NAME_LEN - 1);
+        if (i >= (int)p->numPorts)
+            __atomic_store_n (&p->numPorts, i + 1, __ATOMIC_RELEASE);
+        return (slot);
+    }
+
+    // Out of slots; count in a private one nobody else will see
+    if (DEBUG) printf ("port_stats: no free slot for %s\n", name);
+    portStats *slot = new portStats;
+    memset (slot, 0, sizeof (*slot));
+    strncpy (slot->name, name, PORT_STATS_NAME_LEN - 1);
+    return (slot);
+}
+
+
+void portStatsRelease (portStats *slot)
+{
+    if (slot == NULL)
+        return;
+    if (page != NULL && slot >= &page->ports [0] && slot < &page->ports [MAX_STATS_PORTS])
+        __atomic_store_n (&slot->inUse, 0, __ATOMIC_RELEASE);
+    else
+        delete slot;
+}
@@ -0,0 +1,139 @@
+// port_stats.h: Per-port I/O and framing counters, published in shared memory
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef PORT_STATS_H
+#define PORT_STATS_H
+
+#include <stdint.h>
+
+// Every serial port and UDP socket claims a slot in one page of POSIX
+// shared memory and counts what it sees there. Each counter has exactly
+// one writer thread (the one reading the port, the one sending its transmit
+// queue, or for the "delivered" and "write drops" counts the driver), so
+// updating one is a plain load and store; efis-stat maps the page read-only
+// and can look at any rate without the ports ever knowing.
+//
+// Counters are 32 bits so that they are read whole on every target; readers
+// take differences, which stay right across a wrap.
+#define PORT_STATS_SHM_NAME     "/efis-stats"
+#define PORT_STATS_NAME_ENV     "EFIS_STATS_NAME"   // Overrides the name above
+#define PORT_STATS_MAGIC        0x45465354          // "EFST"
+#define PORT_STATS_VERSION      2
+
+#define MAX_STATS_PORTS         16
+#define PORT_STATS_NAME_LEN     32
+#define MAX_STATS_TYPES         16      // Same as MAX_FRAME_DIALECTS
+
+// Inter-frame gap histogram. Bucket 0 counts gaps of 0 us (frames out of
+// the same read), bucket n gaps of 2^(n-1) to 2^n - 1 us, and the last
+// bucket everything longer.
+#define PORT_GAP_BUCKETS        24
+
+struct portStats {
+    uint32_t    inUse;
+    char        name [PORT_STATS_NAME_LEN];
+    uint32_t    bytesRead;
+    uint32_t    bytesWritten;
+    uint32_t    frames;                 // Frames framed
+    uint32_t    framesDelivered;        // Frames handed to the driver
+    uint32_t    checksumRejects;        // Frames dropped for a bad checksum, by
+                                        // the framer or the driver
+    uint32_t    resyncs;                // Partial frames abandoned for line noise
+    uint32_t    overflows;              // Times the receive ring filled up
+    uint32_t    queueDrops;             // Frames dropped because the driver fell behind
+    uint32_t    writeDrops;             // Commands dropped because the transmit queue was full
+    uint32_t    partialWrites;          // Writes the port took only part of
+    uint32_t    writeErrors;            // Writes that failed (queue thrown away)
+    uint32_t    numTypes;
+    int32_t     typeIds [MAX_STATS_TYPES];      // Dialect type of each framesByType entry
+    uint32_t    framesByType [MAX_STATS_TYPES];
+    uint32_t    gapHist [PORT_GAP_BUCKETS];
+    uint32_t    lastFrameStamp;         // monotonic_us() of the last frame, 0 if none yet
+};
+
+struct portStatsPage {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    pid;                    // Process that owns the page
+    uint32_t    numPorts;               // Slots ever claimed
+    uint32_t    checksumFails;          // serial::checksumGood failures, all ports
+    portStats   ports [MAX_STATS_PORTS];
+};
+
+/**
+ * portStatsClaim
+ * DESCRIPTION:     Zeroes and returns a free slot named "name". The page is
+ *                  created in shared memory the first time; if that can't
+ *                  be done (or the slots run out) the counters still work
+ *                  but are private to the process.
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+portStats *     // Never NULL
+    portStatsClaim (const char *name);
+
+/**
+ * portStatsRelease
+ * DESCRIPTION:     Frees a slot from portStatsClaim. Its counters stay
+ *                  readable until the slot is claimed again.
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+void portStatsRelease (portStats *slot);
+
+// The page this process publishes, for counters that aren't per port
+portStatsPage *portStatsPageOf (void);
+
+// Bump a counter. Only the counter's one writer thread may call these.
+static inline void statAdd (uint32_t &counter, uint32_t n)
+{
+    __atomic_store_n (&counter, counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void statInc (uint32_t &counter)
+{
+    statAdd (counter, 1);
+}
+
+/**
+ * statFrame
+ * DESCRIPTION:     Counts a frame that arrived at "stamp" (monotonic_us)
+ *                  and adds the gap since the one before to the histogram
+ * PRE-CONDITIONS:  Called from the slot's reading thread
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static inline void statFrame (portStats *stats, uint32_t stamp)
+{
+    statInc (stats->frames);
+    if (stats->lastFrameStamp != 0)
+    {
+        uint32_t gap = stamp - stats->lastFrameStamp;
+        int bucket = (gap == 0) ? 0 : 32 - __builtin_clz (gap);
+        if (bucket >= PORT_GAP_BUCKETS)
+            bucket = PORT_GAP_BUCKETS - 1;
+        statInc (stats->gapHist [bucket]);
+    }
+    __atomic_store_n (&stats->lastFrameStamp, (stamp != 0) ? stamp : 1, __ATOMIC_RELAXED);
+}
+
+#endif /* PORT_STATS_H */
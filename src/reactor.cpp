@@ -0,0 +1,208 @@
+// reactor.cpp: Member functions of the I/O reactor thread
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "constants.h"
+#include "exceptions.h"
+#include "reactor.h"
+
+#define MAX_EVENTS_PER_WAKEUP   16
+
+io_reactor     *TheReactor = NULL;
+
+io_reactor::io_reactor (void)
+{
+    wakeups = 0;
+    errors = 0;
+    running = FALSE;
+    removals = 0;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&dispatch_lock, &attr);
+    pthread_mutexattr_destroy (&attr);
+
+    epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+    {
+        perror ("io_reactor: epoll_create1");
+        ThrowException (errno);
+    }
+    stop_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd == -1)
+    {
+        perror ("io_reactor: eventfd");
+        ThrowException (errno);
+    }
+
+    struct epoll_event  ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;         // NULL marks the stop event
+    epoll_ctl (epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+}
+
+
+io_reactor::~io_reactor ()
+{
+    Stop ();
+    close (stop_fd);
+    close (epoll_fd);
+    pthread_mutex_destroy (&dispatch_lock);
+}
+
+
+void io_reactor::Add (reactor_client *client)
+{
+    __atomic_store_n (&client->reactor, this, __ATOMIC_RELEASE);
+    client->ReactorAttached ();
+
+    struct epoll_event  ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | (client->ReactorWriting () ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = client;
+    if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, client->ReactorFd (), &ev) == -1)
+    {
+        // Not attached after all; the client goes back to its own reads
+        int err = errno;
+        perror ("io_reactor: epoll_ctl");
+        __atomic_store_n (&client->reactor, (io_reactor *)NULL, __ATOMIC_RELEASE);
+        ThrowException (err);
+    }
+}
+
+
+void io_reactor::Remove (reactor_client *client)
+{
+    // Once we have the lock the reactor thread isn't in any of the client's
+    // callbacks, and the count makes it throw away any events it has taken
+    // for it but not yet handed out
+    pthread_mutex_lock (&dispatch_lock);
+    epoll_ctl (epoll_fd, EPOLL_CTL_DEL, client->ReactorFd (), NULL);
+    __atomic_store_n (&client->reactor, (io_reactor *)NULL, __ATOMIC_RELEASE);
+    removals++;
+    pthread_mutex_unlock (&dispatch_lock);
+}
+
+
+void io_reactor::WatchWritable (reactor_client *client, bool on)
+{
+    struct epoll_event  ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | (on ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = client;
+    // Fails only if the client has been dropped, when there's nothing to do
+    if (epoll_ctl (epoll_fd, EPOLL_CTL_MOD, client->ReactorFd (), &ev) == -1 && DEBUG)
+        perror ("io_reactor: epoll_ctl");
+}
+
+
+void io_reactor::Start (void)
+{
+    if (running)
+        return;
+    running = TRUE;
+    int err = pthread_create (&thread, NULL, ThreadMain, this);
+    if (err != 0)
+    {
+        running = FALSE;
+        fprintf (stderr, "io_reactor: pthread_create: %s\n", strerror (err));
+        ThrowException (err);
+    }
+}
+
+
+void io_reactor::Stop (void)
+{
+    if (!running)
+        return;
+    unsigned long long  one = 1;
+    if (write (stop_fd, &one, sizeof (one)) != sizeof (one))
+        perror ("io_reactor: eventfd write");
+    pthread_join (thread, NULL);
+    running = FALSE;
+}
+
+
+void *io_reactor::ThreadMain (void *arg)
+{
+    ((io_reactor *)arg)->Run ();
+    return (NULL);
+}
+
+
+void io_reactor::Run (void)
+{
+    struct epoll_event  events [MAX_EVENTS_PER_WAKEUP];
+
+    while (1)
+    {
+        pthread_mutex_lock (&dispatch_lock);
+        unsigned    seen = removals;
+        pthread_mutex_unlock (&dispatch_lock);
+
+        int n = epoll_wait (epoll_fd, events, MAX_EVENTS_PER_WAKEUP, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror ("io_reactor: epoll_wait");
+            return;
+        }
+        wakeups++;
+
+        // A client removed since we last looked may be in this batch, and
+        // may be gone. Anything still readable is reported again (epoll is
+        // level triggered), so the rest of a batch can always be dropped.
+        pthread_mutex_lock (&dispatch_lock);
+        for (int i = 0; i < n && removals == seen; i++)
+        {
+            reactor_client *client = (reactor_client *)events [i].data.ptr;
+            if (client == NULL)
+            {
+                pthread_mutex_unlock (&dispatch_lock);
+                return;         // Stop() was called
+            }
+            try {
+                if (events [i].events & EPOLLOUT)
+                    client->ReactorWritable ();
+                if (events [i].events & ~EPOLLOUT)
+                    client->ReactorReadable ();
+            }
+            catch (...)
+            {
+                // A port that errors out (e.g. unplugged) would wake us
+                // forever; stop watching it, and tell it so it can fall
+                // back on its own thread.
+                fprintf (stderr, "io_reactor: read failed on fd %d, dropping it\n",
+                         client->ReactorFd ());
+                errors++;
+                Remove (client);
+                client->ReactorDropped ();
+            }
+        }
+        pthread_mutex_unlock (&dispatch_lock);
+    }
+}
@@ -0,0 +1,160 @@
+// reactor.h: Class definition for the I/O reactor thread
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+
+#include "constants.h"
+
+class io_reactor;
+
+// reactor_client: Anything with a file descriptor the reactor can watch.
+// ReactorReadable runs on the reactor thread whenever the descriptor has
+// data; the client decodes it there and queues the results for whoever
+// consumes them.
+class reactor_client
+{
+    public:
+        reactor_client (void) { reactor = NULL; }
+        virtual ~reactor_client () {}
+
+        virtual int     ReactorFd (void) const = 0;
+        virtual void    ReactorReadable (void) = 0;
+
+        // ReactorWritable runs on the reactor thread when the descriptor
+        // can be written, for clients that asked with WatchWritable.
+        // ReactorWriting says whether to watch for that from the start.
+        virtual void    ReactorWritable (void) {}
+        virtual bool    ReactorWriting (void) const { return (FALSE); }
+
+        /**
+         * ReactorAttached
+         * DESCRIPTION:     Called by io_reactor::Add before the descriptor is
+         *                  watched, so the client can set up its queues.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        virtual void    ReactorAttached (void) {}
+
+        /**
+         * ReactorDropped
+         * DESCRIPTION:     Called on the reactor thread when it stops watching
+         *                  the client because a read or write threw. Reactor ()
+         *                  is already NULL, so the client's own thread can go
+         *                  back to polling the descriptor or report it bad.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        virtual void    ReactorDropped (void) {}
+
+        // The reactor watching us, or NULL. Safe from any thread.
+        io_reactor     *Reactor (void) const
+        {
+            return (__atomic_load_n (&reactor, __ATOMIC_ACQUIRE));
+        }
+
+    protected:
+        friend class io_reactor;
+        io_reactor     *reactor;        // Reactor watching us, or NULL
+};
+
+// io_reactor class: One thread that sleeps in epoll until one of the
+// registered ports or sockets has data, then lets its client decode it.
+class io_reactor
+{
+    public:
+        io_reactor (void);
+        ~io_reactor ();
+
+        /**
+         * Add
+         * DESCRIPTION:     Start watching a client. The client must be fully
+         *                  set up; from here on its input side belongs to
+         *                  the reactor thread.
+         * PRE-CONDITIONS:  Client has a valid descriptor
+         * POST-CONDITIONS: ReactorReadable is called whenever it has data
+         * EXCEPTIONS THROWN:  errno if epoll refuses the descriptor, when
+         *                     the client's Reactor () is left NULL
+         * EXCEPTIONS HANDLED: None
+         */
+        void    Add (reactor_client *client);
+
+        /**
+         * Remove
+         * DESCRIPTION:     Stop watching a client. Waits for the reactor thread
+         *                  to finish with it, so it can be deleted as soon as
+         *                  this returns. Can be called from any thread,
+         *                  including from the client's own callbacks.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: No callback of the client's is running or will run
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void    Remove (reactor_client *client);
+
+        /**
+         * WatchWritable
+         * DESCRIPTION:     Start or stop calling the client's ReactorWritable
+         *                  whenever its descriptor can be written. Can be
+         *                  called from any thread.
+         * PRE-CONDITIONS:  Client was added
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void    WatchWritable (reactor_client *client, bool on);
+
+        /**
+         * Start/Stop
+         * DESCRIPTION:     Start or stop the reactor thread
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  errno if the thread can't be created
+         * EXCEPTIONS HANDLED: None
+         */
+        void    Start (void);
+        void    Stop (void);
+
+        unsigned        wakeups;        // Times epoll returned with data
+        unsigned        errors;         // Clients dropped because their read failed
+
+    protected:
+        int             epoll_fd;
+        int             stop_fd;        // eventfd used to wake the thread to stop it
+        pthread_t       thread;
+        bool            running;
+        // Held by the reactor thread while it calls clients, and by Remove.
+        // Recursive so a client can remove itself from a callback.
+        pthread_mutex_t dispatch_lock;
+        unsigned        removals;       // Counts Removes, so a batch of events
+                                        // taken before one is thrown away
+
+        static void    *ThreadMain (void *arg);
+        void            Run (void);
+};
+
+// The one reactor, if the program wants one. Drivers attach themselves to
+// it when they are constructed; with no reactor they poll their ports.
+extern io_reactor      *TheReactor;
+
+#endif /* REACTOR_H */
@@ -0,0 +1,84 @@
+// replay_capture.cpp: Plays a serial capture file into a pseudo-terminal
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "constants.h"
+#include "capture.h"
+
+static void usage (void)
+{
+    fprintf (stderr, "usage: replay_capture [-s speed | -f] [-n loops] [-l link] [-d delay_secs] file.cap\n");
+    fprintf (stderr, "  -s N   play at N times the captured rate (default 1)\n");
+    fprintf (stderr, "  -f     play as fast as the reader takes it\n");
+    fprintf (stderr, "  -n N   play the file N times\n");
+    fprintf (stderr, "  -l L   symlink L to the pty so a fixed port name can be configured\n");
+    fprintf (stderr, "  -d N   wait N seconds before playing, to give the reader time to open the pty\n");
+    exit (-1);
+}
+
+int main (int argc, char *argv[])
+{
+    double      speed = 1;
+    int         loops = 1;
+    int         delay = 0;
+    const char *link = NULL;
+    int         opt;
+
+    while ((opt = getopt (argc, argv, "s:fn:l:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':   speed = atof (optarg);  break;
+            case 'f':   speed = 0;              break;
+            case 'n':   loops = atoi (optarg);  break;
+            case 'l':   link = optarg;          break;
+            case 'd':   delay = atoi (optarg);  break;
+            default:    usage ();
+        }
+    }
+    if (optind != argc - 1 || speed < 0 || loops < 1)
+        usage ();
+
+    capture_replay      replay;
+    if (!replay.Open (argv [optind], speed, loops))
+        exit (-1);
+
+    if (link != NULL)
+    {
+        unlink (link);
+        if (symlink (replay.SlaveName (), link) == -1)
+        {
+            perror ("replay_capture: symlink");
+            exit (-1);
+        }
+    }
+    printf ("%s\n", replay.SlaveName ());
+    fflush (stdout);
+
+    if (delay > 0)
+        sleep (delay);
+    replay.Run ();
+    printf ("%u records, %llu bytes\n", replay.recordsSent, replay.bytesSent);
+
+    if (link != NULL)
+        unlink (link);
+    return (0);
+}
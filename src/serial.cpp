@@ -8,12 +8,18 @@
 #include <termios.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/uio.h>
 #include <string>
 
 
 #include "serial.h"
+#include "framescan.h"
 #include "exceptions.h"
 #include "constants.h"
+#include "utilities.h"
+#include "capture.h"
+#include "checksum.h"
+#include "port_stats.h"
 
 #define _POSIX_SOURCE 1
 
@@ -27,18 +33,39 @@
 #define DEFAULT_CHAR_READ_TIMEOUT_TENTHSECS 0;   /* inter-character timer unused */
 #define DEFAULT_NUM_CHARS_BLOCK_READ 0;   /* block or signal read until/when N chars received */
 #define SER_READ_BUF_SIZE 2048; /* TODO: will data frames ever be larger than this? */
-#define MAX_NUM_TO_READ_PER_SAMPLE 2048
 
 using namespace std;
 
+unsigned serial::checksumFailCnt = 0;
+
 serial::serial(const char* portPtr, int asyncFlg) {
     numRead  = -1;
     numWrote = -1;
+    numDialects = numDialectFirst = 0;
+    rxQueue = NULL;
+    frameHeld = FALSE;
+    txHead = txTail = txArmed = 0;
+    framerState = FRAMER_HUNT;
+    framerPos = framerDecodedLen = framerMatched = 0;
+    memset(dialectFirstByte, 0, sizeof(dialectFirstByte));
+    ringHead = ringTail = 0;
+    readStampHead = readStampTail = 0;
+    fixedFrameLen = minFrameLen = maxFrameLen = 0;
+    fd = -1;
+    captureFd = -1;
     //readCharBuf =;
     //portName = (char *)malloc(80);
     strcpy(portName, portPtr);
+    stats = portStatsClaim(portName);
     asyncFlag = asyncFlg;
     initializePort();
+
+    const char *captureDir = getenv(CAPTURE_DIR_ENV);
+    if (captureDir != NULL) {
+      const char *base = strrchr(portName, '/');
+      string path = string(captureDir) + "/" + ((base != NULL) ? base + 1 : portName) + CAPTURE_SUFFIX;
+      startCapture(path.c_str());
+    }
 }
 
 serial::serial(const char* portPtr) {
@@ -46,12 +73,17 @@ serial::serial(const char* portPtr) {
 }
 
 serial::~serial() {
+  if (Reactor() != NULL) Reactor()->Remove(this);
   closePort();
+  stopCapture();
+  delete rxQueue;
+  portStatsRelease(stats);
 }
 
 
 void serial::initializePort() {
   if (fd>=0) {
+    if (Reactor() != NULL) Reactor()->Remove(this);
     closePort(); // Just in case it was open previously
   }
 
@@ -64,6 +96,7 @@ void serial::initializePort() {
   }
 
   openPort(); 
+  if (Reactor() != NULL) Reactor()->Add(this); // Reopened - watch the new fd
   if (DEBUG) printf("INITIALIZED PORT >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>\n"); // TODO: remove dbug
 }
 
@@ -77,11 +110,9 @@ void serial::openPort() {
       ThrowException( string(strerror(errno)) ); //return;
     }
 
-    if (asyncFlag == TRUE) {
-      /* Make the file descriptor asynchronous (the manual page says only 
-	 O_APPEND and O_NONBLOCK, will work with F_SETFL...) */
-      fcntl(fd, F_SETFL, FASYNC);
-    }
+    // Async ports were also set FASYNC here, but nothing ever handled the
+    // SIGIO that asks for and F_SETFL replaced the O_NONBLOCK given to
+    // open(). O_NONBLOCK is all a polled or reactor driven port needs.
 
     memset(&newtio, '\0', sizeof(newtio));
     newtio.c_cflag = DEFAULT_CFLAG;
@@ -137,18 +168,83 @@ int serial::readPort(int numChars) {
     if (numRead <0) {
       ThrowException(strerror(errno)); //return;
     }
+    if (numRead > 0) {
+      statAdd(stats->bytesRead, numRead);
+      if (captureFd != -1) captureWrite(captureFd, readCharBuf, numRead);
+    }
 
     return numRead;
 }
 
-int serial::writePort(char *buf, int numChars) {
-    numWrote = write(this->fd, buf, numChars);
-    if (numWrote <0) {
-      perror("WRITE ERROR:"); // TODO: remove debug
-      //initializePort(); // Reinitialize port (cable reconnect etc.)
-      ThrowException(strerror(errno)); //return;
+// Runs on the driver's thread. Never blocks and never throws: a full UART
+// or a full queue must not hold up or unwind the sampling loop.
+int serial::writePort(const char *buf, int numChars) {
+    unsigned head = __atomic_load_n(&txHead, __ATOMIC_ACQUIRE);
+    if (numChars > TX_BUF_SIZE - (int)(txTail - head)) {
+      statInc(stats->writeDrops);
+      if (DEBUG) printf("serial transmit queue full, dropped %d bytes (%s)\n", numChars, portName);
+      numWrote = 0;
+      return 0;
+    }
+    int tailIdx = txTail & TX_BUF_MASK;
+    int first = TX_BUF_SIZE - tailIdx;
+    if (first > numChars) first = numChars;
+    memcpy(&txBuf[tailIdx], buf, first);
+    memcpy(txBuf, buf + first, numChars - first);
+    __atomic_store_n(&txTail, txTail + numChars, __ATOMIC_SEQ_CST);
+    numWrote = numChars;
+
+    if (Reactor() != NULL) armWriter();
+    else flushWrites();
+    return numChars;
+}
+
+
+bool serial::flushWrites(void) {
+  while (1) {
+    unsigned head = txHead;
+    int pending = (int)(__atomic_load_n(&txTail, __ATOMIC_ACQUIRE) - head);
+    if (pending == 0) return TRUE;
+
+    // Everything queued goes in one write, in two pieces if it wraps
+    struct iovec iov[2];
+    int headIdx = head & TX_BUF_MASK;
+    int first = TX_BUF_SIZE - headIdx;
+    if (first > pending) first = pending;
+    iov[0].iov_base = &txBuf[headIdx];
+    iov[0].iov_len = first;
+    iov[1].iov_base = txBuf;
+    iov[1].iov_len = pending - first;
+    int n = writev(fd, iov, (pending > first) ? 2 : 1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) return FALSE; // Port's full; try again later
+      // Port is gone (cable pulled etc.); reading it will say so too
+      statInc(stats->writeErrors);
+      if (DEBUG) perror("WRITE ERROR:");
+      __atomic_store_n(&txHead, head + pending, __ATOMIC_RELEASE);
+      return TRUE;
     }
-    return numWrote;
+    statAdd(stats->bytesWritten, n);
+    __atomic_store_n(&txHead, head + n, __ATOMIC_RELEASE);
+    if (n < pending) {
+      statInc(stats->partialWrites);
+      return FALSE;
+    }
+  }
+}
+
+
+// The driver arms the writer after queueing and the reactor disarms it
+// once the queue is empty, then looks again; whichever of them is last
+// sees the other's bytes, so a command can't be left sitting in the queue.
+void serial::armWriter(void) {
+  io_reactor *r = Reactor();
+  // Dropped since the caller looked: the driver flushes from now on
+  if (r == NULL) return;
+  if (__atomic_exchange_n(&txArmed, 1, __ATOMIC_SEQ_CST) == 0) {
+    r->WatchWritable(this, TRUE);
+  }
 }
 
 void serial::setFrameStart(unsigned char* startChars, int numChars) {
@@ -165,16 +261,37 @@ void serial::setFrameEnd(unsigned char* stopChars, int numChars) {
 }
 
 void serial::readAvailableData() {
-  // TODO: Is it possible for the read to spend too much time here or get stuck??
-  while (readPort(MAX_NUM_TO_READ_PER_SAMPLE) > 0) { // Keep grabbing data until no bytes
-    if (DEBUG) printf("\nreadPort/numRead=%d\n", numRead);
-    if (numInFrameBuf + numRead > (int)sizeof(frameDataBuf)) {
-      // Wrap buffer if about to exceed it!
-      // TODO: To be most correct take partial frame data with you when wrapping.
-      numInFrameBuf = 0;
+  // Read straight into the free space of the ring. If the ring fills up we
+  // stop reading and leave the rest queued in the driver (backpressure)
+  // rather than throwing away data that is already buffered.
+  while (1) {
+    int freeSpace = RING_BUF_SIZE - bytesInBuf();
+    if (freeSpace == 0) {
+      statInc(stats->overflows);
+      if (DEBUG) printf("serial ring buffer full (%s)\n", portName);
+      break;
+    }
+    int tailIdx = ringTail & RING_BUF_MASK;
+    int contiguous = RING_BUF_SIZE - tailIdx;
+    if (contiguous > freeSpace) contiguous = freeSpace;
+
+    numRead = read(fd, &ringBuf[tailIdx], contiguous);
+    if (numRead < 0) {
+      if (errno == EAGAIN || errno == EINTR) break;
+      ThrowException(strerror(errno));
     }
-    memcpy(&frameDataBuf[numInFrameBuf], readCharBuf, numRead); // Append to frame Buffer
-    numInFrameBuf += numRead;
+    if (numRead == 0) break; // Keep grabbing data until no bytes
+    if (DEBUG) printf("\nreadAvailableData/numRead=%d\n", numRead);
+    if (captureFd != -1) captureWrite(captureFd, &ringBuf[tailIdx], numRead);
+    statAdd(stats->bytesRead, numRead);
+    ringTail += numRead;
+
+    // Note when these bytes arrived. If the reads outrun the frames, merge
+    // the oldest record into the next (its frames get stamped a bit late).
+    if (readStampTail - readStampHead == READ_STAMP_LEN) readStampHead++;
+    readStamp &rs = readStamps[readStampTail++ & (READ_STAMP_LEN - 1)];
+    rs.tail = ringTail;
+    rs.stamp = monotonic_us();
   }
 }
 
@@ -184,179 +301,387 @@ int serial::getStartCharsBufIdx(unsigned char *startChars,
 				int startCharCnt, 
 				unsigned char *stopChars, 
 				int stopCharCnt) {
-  bool found = FALSE;
-  int i;
-  for (i=0; i<numInFrameBuf-startCharCnt; i++) { 
-    // For above you subtract startFrameCharCnt because of "peeking" ahead in code below
-    int matchedCharCnt = 0;
-    for (int j=0; j<startCharCnt; j++) {
-      if (frameDataBuf[i+j] == startChars[j]) {
-	//if (DEBUG) printf("\nframeDataBuf: %02x\n", frameDataBuf[i+j]);
-	// If one/more of start framing chars match then look
-        // at the next char ahead in the buf to make sure it's
-        // not escaped. (e.g. if start char is DLE and you see
-        // two DLEs together then this is not a start frame - but
-        // COMPRESS the chars together when you do find complete frame.)
-	if (frameDataBuf[i+j] == frameDataBuf[i+j+1]) {
-          i++; // Skip over this char back at top of loop
-          break;
-	}
-	matchedCharCnt++;
-	//if (DEBUG) printf("Matched hdr char_cnt/idx/hex_char: %d/%d/%x\n", matchedCharCnt, i+j, frameDataBuf[i+j]);
-      }
-      else {
-	break; // Prevents looking at next start frame char if first char didn't match
-      }
-    }
+  // With DLE framing (start DLE, stop DLE ETX) a DLE followed by a DLE is
+  // escaped data and one followed by ETX is the end of a frame, not a start.
+  bool dleFraming = (startCharCnt == 1 && stopChars != NULL &&
+		     stopCharCnt > 1 && stopChars[0] == startChars[0]);
+  int i = 0;
+  while ((i = findInBuf(startChars, startCharCnt, i)) >= 0) {
+    if (!dleFraming) break;
+    if (i + 1 >= bytesInBuf()) return -1; // Can't tell yet
+    unsigned char next = bufAt(i+1);
+    if (next != startChars[0] && next != stopChars[1]) break;
+    i += 2;
+  }
 
-    // Make sure end of frame doesn't fool it if end-of-frame marker looks
-    // like start of frame. (e.g. DLE.....DLE ETX)
-    if (stopChars != NULL && stopCharCnt > 0) { // Sanity check to make sure stop chars exist/needed.
-      if (startCharCnt == 1 && 
-	  stopCharCnt > 1   && 
-	  frameDataBuf[i+1] == stopChars[1] ) { // Just check 2nd stop char for now TODO:??
-	continue; // Go around you found a stop frame not a start...
-      }
-    }
+  if (i >= 0 && DEBUG) printf("FOUND START OF PACKET/FRAME (i/numInBuf=%d/%d)\n", i, bytesInBuf());
+  return i;
+}
+
+
+int serial::findInBuf(const unsigned char *chars, int numChars, int from) const {
+  int numInBuf = bytesInBuf();
+  if (from + numChars > numInBuf) return -1;
 
-     if (matchedCharCnt < startCharCnt) continue; // Keep lookin - no frame start found yet.
- 
-    found = TRUE;
-    break;
+  frameView view;
+  viewBuf(view, from, numInBuf - from);
+  int idx = findHeader(view.seg1, view.len1, chars, numChars);
+  if (idx >= 0) return from + idx;
+  if (view.len2 == 0) return -1;
+
+  // Matches that straddle the end of the ring
+  int i = view.len1 - numChars + 1;
+  if (i < 0) i = 0;
+  for (; i < view.len1 && i + numChars <= view.len; i++) {
+    int j;
+    for (j=0; j<numChars && view.at(i+j) == chars[j]; j++);
+    if (j == numChars) return from + i;
   }
 
-  if (found) {
-    if (DEBUG) printf("FOUND START OF PACKET/FRAME (i/numInFrameBuf=%d/%d)\n", i, numInFrameBuf);
-    return i; 
+  idx = findHeader(view.seg2, view.len2, chars, numChars);
+  return (idx < 0) ? -1 : from + view.len1 + idx;
+}
+
+
+int serial::findAnyInBuf(const unsigned char *set, int numSet, int from) const {
+  int numInBuf = bytesInBuf();
+  if (from >= numInBuf) return -1;
+
+  frameView view;
+  viewBuf(view, from, numInBuf - from);
+  int idx = findAnyByte(view.seg1, view.len1, set, numSet);
+  if (idx >= 0) return from + idx;
+  if (view.len2 == 0) return -1;
+  idx = findAnyByte(view.seg2, view.len2, set, numSet);
+  return (idx < 0) ? -1 : from + view.len1 + idx;
+}
+
+
+bool serial::getFrame(unsigned char* framePtr, unsigned *stamp) {
+  int len;
+  return getFrame(framePtr, len, stamp);
+}
+
+
+bool serial::getFrame(unsigned char* framePtr, int &len, unsigned *stamp) {
+  frameView view;
+  if (getFrameView(view) == FALSE) return FALSE;
+  // The framer has already taken out any DLE escapes
+  view.copyTo(framePtr);
+  len = view.len;
+  if (stamp != NULL) *stamp = view.stamp;
+  return TRUE;
+}
+
+
+bool serial::getFrameView(frameView &view) {
+  bool gotFrame = FALSE;
+  if (rxQueue != NULL) {
+    gotFrame = popQueuedFrame(view);
+    // Dropped by the reactor (see ReactorDropped): once its frames are used
+    // up, read the port here again, which reports whatever went wrong
+    if (!gotFrame && Reactor() == NULL) {
+      delete rxQueue;
+      rxQueue = NULL;
+    }
   }
-  return -1;
+  if (rxQueue == NULL && !gotFrame) {
+    if (txTail != txHead) flushWrites(); // Whatever the port couldn't take before
+    readAvailableData(); // Read all available data into the ring buffer
+    gotFrame = frameFromBuf(view);
+  }
+  if (gotFrame) statInc(stats->framesDelivered);
+  return gotFrame;
 }
 
 
-bool serial::getFrame(unsigned char* framePtr) {
-  readAvailableData(); // Read all available data in member buf variable
+bool serial::frameFromBuf(frameView &view) {
+  bool gotFrame;
+  if (numDialects > 0) gotFrame = dialectFrameFromBuf(view);
+  // Variable length frames go through the streaming framer
+  else if (fixedFrameLen == 0) gotFrame = streamFrame(view);
+  else gotFrame = fixedFrameFromBuf(view);
+
+  if (gotFrame) statFrame(stats, view.stamp);
+  return gotFrame;
+}
+
+
+bool serial::fixedFrameFromBuf(frameView &view) {
   int i;
-  while((i=getStartCharsBufIdx(startFrameChars, startFrameCharCnt, stopFrameChars, stopFrameCharCnt)) != -1) {
+  if ((i=getStartCharsBufIdx(startFrameChars, startFrameCharCnt, stopFrameChars, stopFrameCharCnt)) != -1) {
+    // Nothing in front of a frame start can ever be part of a frame so
+    // release it now; the frame start is then always at offset 0.
+    consumeBuf(i);
+
     if (DEBUG) { 
-      if (DEBUG) printf("2 (i=%d)>>>>> ",i);
-      for (unsigned int a=0; a<256; a++) {
-	if (DEBUG) printf("%02x ",frameDataBuf[a]);
+      printf("2 >>>>> ");
+      for (int a=0; a<256 && a<bytesInBuf(); a++) {
+	printf("%02x ", bufAt(a));
       }
-      if (DEBUG) printf("\n");
+      printf("\n");
     }
 
-    int numLeftInBufMinusStartChars = numInFrameBuf - i;
-
-    // FIRST: Handle fixed-length frame case
     // Now if you are using a fixed frame length then see if you can grab enough for fixed frame and return
     // TODO: consider start char escaping (e.g. DLE/DLE pairs)
     // Can we assume fixed length frames have 2 char start headers so that no char escaping
     // is needed for this case?
-    if (fixedFrameLen != 0 ) {
-      if (numLeftInBufMinusStartChars+startFrameCharCnt < fixedFrameLen) return FALSE;
-      getFrameFromBufAndShift(framePtr, i, fixedFrameLen);
-      /*
-      if (DEBUG) printf("FFL>>>>> ");
-      for (unsigned int a=0; a<256; a++) {
-	if (DEBUG) printf("%02x ",frameDataBuf[a]);
-      }
-      if (DEBUG) printf("\n");
-      */
-      if (DEBUG) printf("FOUND FIXED LENGTH FRAME (i/numInFrameBuf=%d/%d)\n", i, numInFrameBuf);
-      return TRUE;
-    }
+    int numInBuf = bytesInBuf();
+    if (numInBuf < fixedFrameLen) return FALSE;
+    viewBuf(view, 0, fixedFrameLen);
+    view.stamp = frameStamp(fixedFrameLen);
+    consumeBuf(fixedFrameLen);
+    if (DEBUG) printf("FOUND FIXED LENGTH FRAME (numInBuf=%d)\n", numInBuf);
+    return TRUE;
+  }
 
-    // NEXT: Handle variable-length frame case
-    // (If you are here it is a variable length frame)
+  // No frame start anywhere; keep only what could be the front of one
+  if (bytesInBuf() > startFrameCharCnt + 1) {
+    consumeBuf(bytesInBuf() - (startFrameCharCnt + 1));
+  }
+  return(FALSE);
+}
 
-    if (minFrameLen != 0 && 
-        (numLeftInBufMinusStartChars+startFrameCharCnt) < minFrameLen) {
-      // Sanity check - Get outa here if not enough bytes for minimum frame
-      return FALSE;
-    }
-    
-    bool foundNextFrameStart = FALSE;
-    int k;
-    for (k=i+1; k<numInFrameBuf-startFrameCharCnt; k++) {
-      // Look for next start of header char(s) to make sure you
-      // have one full frame before escaped char reduction, etc.
-      int matchedCharCnt = 0;
-      for (int m=0; m<startFrameCharCnt; m++) {
-	if (frameDataBuf[k+m] == startFrameChars[m]) matchedCharCnt++;
+
+// Byte-at-a-time framer for variable length frames. All of its state lives
+// in the framer* members so a frame that is only partly received picks up
+// where it left off on the next call; every byte is examined once.
+//
+// With DLE framing (start is DLE, stop is DLE ETX) a doubled DLE is data,
+// DLE ETX ends the frame and a DLE followed by anything else starts a new
+// frame. Otherwise the frame runs from the start chars to the stop chars,
+// or up to the next start chars if there are no stop chars.
+//
+// A frame in progress always begins at the head of the ring (anything in
+// front of it is consumed), so framerPos is also the raw frame length.
+// With DLE framing the escapes are squeezed out in the same pass: each
+// byte kept is written back at framerDecodedLen, which trails framerPos by
+// the number of escapes seen, so the frame handed out is already decoded.
+bool serial::streamFrame(frameView &view) {
+  int numInBuf = bytesInBuf();
+  bool dleFraming = (startFrameCharCnt == 1 && stopFrameCharCnt == 2 &&
+		     stopFrameChars[0] == startFrameChars[0]);
+  unsigned char dle = startFrameChars[0];
+
+  while (framerPos < numInBuf) {
+    unsigned char c = bufAt(framerPos);
+
+    switch (framerState) {
+    case FRAMER_HUNT:
+      if (c != startFrameChars[0]) {
+	// Skip straight to the next candidate start char
+	framerPos = findAnyInBuf(startFrameChars, 1, framerPos);
+	if (framerPos < 0) framerPos = numInBuf;
+	break;
+      }
+      // Possible start - drop everything in front of it
+      consumeBuf(framerPos);
+      numInBuf -= framerPos;
+      framerPos = 1;
+      framerDecodedLen = 1;
+      framerMatched = (startFrameCharCnt > 1) ? 1 : 0;
+      framerState = (dleFraming) ? FRAMER_DLE_START :
+	(startFrameCharCnt > 1) ? FRAMER_START : FRAMER_IN_FRAME;
+      break;
+
+    case FRAMER_START:
+      // Rest of a multi-char start sequence
+      if (c != startFrameChars[framerMatched]) {
+	framerState = FRAMER_HUNT; // Look at this byte again as a possible start
+	break;
+      }
+      framerPos++;
+      framerDecodedLen++;
+      if (++framerMatched == startFrameCharCnt) {
+	framerMatched = 0;
+	framerState = FRAMER_IN_FRAME;
+      }
+      break;
+
+    case FRAMER_DLE_START:
+      // DLE DLE is escaped data and DLE ETX the end of some frame we
+      // missed the front of - neither is a frame start.
+      framerPos++;
+      if (c == dle || c == stopFrameChars[1]) {
+	framerState = FRAMER_HUNT;
+	break;
+      }
+      framerDecodedLen++;
+      framerState = FRAMER_IN_FRAME;
+      break;
+
+    case FRAMER_IN_FRAME:
+      framerPos++;
+      if (dleFraming) {
+	if (c == dle) {
+	  framerState = FRAMER_DLE_ESCAPE;
+	  break;
+	}
+	putBufAt(framerDecodedLen, c);
+      }
+      else if (stopFrameCharCnt == 0) {
+	if (c == startFrameChars[0]) {
+	  // No stop chars - the next start ends this frame
+	  framerPos--;
+	  if (framerPos >= minFrameLen) return emitFrame(view);
+	  framerState = FRAMER_HUNT;
+	  break;
+	}
       }
-      if (matchedCharCnt == startFrameCharCnt &&
-          (k-i) >= minFrameLen ) {
-	// Also check that the frame end doesn't look like the start (e.g. DLE....DLE ETX)
-        if (stopFrameCharCnt > 1 && 
-	    startFrameChars[0] == stopFrameChars[0] &&
-            frameDataBuf[k+1] == stopFrameChars[1] ) {
-	  continue;
+      else if (c == stopFrameChars[framerMatched]) {
+	framerDecodedLen++;
+	if (++framerMatched == stopFrameCharCnt) {
+	  if (framerDecodedLen >= minFrameLen) return emitFrame(view);
+	  dropFrame(); // Runt
+	  numInBuf = bytesInBuf();
 	}
-	foundNextFrameStart = TRUE;
 	break;
       }
-    }
-    if (foundNextFrameStart == FALSE) return FALSE;
-    // If you are here - you have found a complete frame
-    int uncompressedFrameLen = k-i;
-    if (DEBUG) printf("FOUND END(next start) OF VARIABLE LEN FRAME (idx %d)\n", k);
-
-    if (DEBUG) {
-      printf("3 (i=%d>>>>> ", i);
-      for (unsigned int a=0; a<256; a++) {
-	printf("%d/%02x ", a, frameDataBuf[a]);
+      else if (c == startFrameChars[0] && startFrameCharCnt == 1) {
+	// Start char where none belongs - a new frame began and the last
+	// one was cut short. Restart here rather than rescanning.
+	statInc(stats->resyncs);
+	consumeBuf(framerPos - 1);
+	numInBuf = bytesInBuf();
+	framerPos = framerDecodedLen = 1;
+	framerMatched = 0;
+	break;
       }
-      printf("\n");
-    }
-
-    getFrameFromBufAndShift(framePtr, i, uncompressedFrameLen);    
-
-    if (DEBUG) {
-      printf("PFB>>>>> ");
-      for (unsigned int a=0; a<256; a++) {
-	//printf("%02X ",framePtr[a]);
-	printf("%c",framePtr[a]);
+      else {
+	framerMatched = (c == stopFrameChars[0]) ? 1 : 0;
       }
-      printf("\n");
-    }
-
-    // If needed, compress double startFrame char that is not part of framing (i.e. data byte)
-    if (startFrameCharCnt == 1) {
-      int tmpFrameLen = uncompressedFrameLen;
-      for (int n=startFrameCharCnt-1; n<uncompressedFrameLen-1; n++) {
-	if (framePtr[n] == startFrameChars[0] &&
-	    framePtr[n] == framePtr[n+1] ) {
-	  memmove(&framePtr[n], &framePtr[n+1], tmpFrameLen - (n+1));
-	  tmpFrameLen--; // Set new frame len
+      if (++framerDecodedLen > maxFrameLen && maxFrameLen != 0) {
+	statInc(stats->resyncs);
+	dropFrame(); // Too long - can't be a real frame
+	numInBuf = bytesInBuf();
+      }
+      break;
+
+    case FRAMER_DLE_ESCAPE:
+      framerPos++;
+      if (c == dle) {
+	// Escaped data DLE - keep one of the two
+	putBufAt(framerDecodedLen, dle);
+	framerState = FRAMER_IN_FRAME;
+	if (++framerDecodedLen > maxFrameLen && maxFrameLen != 0) {
+	  statInc(stats->resyncs);
+	  dropFrame();
+	  numInBuf = bytesInBuf();
 	}
       }
+      else if (c == stopFrameChars[1]) {
+	putBufAt(framerDecodedLen, dle);
+	putBufAt(framerDecodedLen + 1, c);
+	framerDecodedLen += 2; // DLE ETX
+	if (framerDecodedLen >= minFrameLen) return emitFrame(view);
+	dropFrame(); // Runt
+	numInBuf = bytesInBuf();
+      }
+      else {
+	// DLE <id> - a new frame started before this one ended
+	statInc(stats->resyncs);
+	consumeBuf(framerPos - 2);
+	numInBuf = bytesInBuf();
+	framerPos = framerDecodedLen = 2;
+	framerState = FRAMER_IN_FRAME;
+      }
+      break;
     }
+  }
 
-    return TRUE;
-  } // End of while()
-  
-  return(FALSE);
+  // Nothing examined while hunting can be part of a frame
+  if (framerState == FRAMER_HUNT) {
+    consumeBuf(framerPos);
+    framerPos = 0;
+  }
+  return FALSE;
 }
 
 
+// Hand the frame the framer just finished back as a view and reset it.
+// The view is the decoded frame; the raw bytes it came from are consumed.
+bool serial::emitFrame(frameView &view) {
+  if (DEBUG) printf("FOUND VARIABLE LEN FRAME (len %d, %d raw)\n", framerDecodedLen, framerPos);
+  viewBuf(view, 0, framerDecodedLen);
+  view.stamp = frameStamp(framerPos);
+  consumeBuf(framerPos);
+  framerPos = 0;
+  framerMatched = 0;
+  framerState = FRAMER_HUNT;
+  return TRUE;
+}
 
-void serial::getFrameFromBufAndShift(unsigned char *pktBuf, 
-                                      int bufIdx, 
-                                      int packetLen) {
-  if (DEBUG) {
-    printf("PFD idx=%d  packetLen=%d\n", bufIdx, packetLen);
-    printf("BUF_B4_SHIFT=");
-    for (int i=0; i<numInFrameBuf; i++) printf("%X:%d ", frameDataBuf[i], frameDataBuf[i]);
-    printf("\n");
+
+// Throw away everything the framer has looked at and go back to hunting
+void serial::dropFrame(void) {
+  consumeBuf(framerPos);
+  framerPos = 0;
+  framerMatched = 0;
+  framerState = FRAMER_HUNT;
+}
+
+
+
+unsigned serial::frameStamp(int len) {
+  // Frames come out in ring order, so reads that ended before this frame
+  // did are of no further use.
+  unsigned end = ringHead + len;
+  while (readStampTail - readStampHead > 1 &&
+	 (int)(readStamps[readStampHead & (READ_STAMP_LEN - 1)].tail - end) < 0) {
+    readStampHead++;
   }
-  memcpy(pktBuf, &frameDataBuf[bufIdx], packetLen);
-  if (numInFrameBuf == bufIdx+packetLen) {
-    numInFrameBuf = 0; // i.e. The packet border ended at the end of buffer - no byte shifting needed.
+  if (readStampTail == readStampHead) return monotonic_us();
+  return readStamps[readStampHead & (READ_STAMP_LEN - 1)].stamp;
+}
+
+
+void serial::viewBuf(frameView &view, int offset, int len) const {
+  int headIdx = (ringHead + offset) & RING_BUF_MASK;
+  view.len  = len;
+  view.type = -1;
+  view.stamp = 0;
+  view.seg1 = &ringBuf[headIdx];
+  if (headIdx + len <= RING_BUF_SIZE) {
+    view.len1 = len;
+    view.seg2 = NULL;
+    view.len2 = 0;
   }
   else {
-    memmove(frameDataBuf, &frameDataBuf[bufIdx+packetLen], numInFrameBuf-bufIdx+packetLen);
-    numInFrameBuf -= packetLen;
+    // Frame wraps around the end of the ring
+    view.len1 = RING_BUF_SIZE - headIdx;
+    view.seg2 = ringBuf;
+    view.len2 = len - view.len1;
+  }
+}
+
+
+void serial::getFrameFromBuf(unsigned char *pktBuf, 
+                             int bufIdx, 
+                             int packetLen) {
+  if (DEBUG) {
+    printf("PFD idx=%d  packetLen=%d\n", bufIdx, packetLen);
   }
+  frameView view;
+  viewBuf(view, bufIdx, packetLen);
+  view.copyTo(pktBuf);
+  consumeBuf(bufIdx + packetLen);
+}
+
+
+bool serial::startCapture(const char *path) {
+  stopCapture();
+  captureFd = captureOpen(path);
+  if (captureFd == -1) {
+    fprintf(stderr, "serial: can't capture %s to %s: %s\n", portName, path, strerror(errno));
+    return FALSE;
+  }
+  if (DEBUG) printf("Capturing %s to %s\n", portName, path);
+  return TRUE;
+}
+
+void serial::stopCapture(void) {
+  if (captureFd != -1) close(captureFd);
+  captureFd = -1;
 }
 
 
@@ -375,20 +700,25 @@ void serial::setFixedFrameLen(int len) {
 bool serial::checksumGood(unsigned char *pktPtr, int dataIdxStart, int dataIdxStop, int checksumIdx) {
   //int numBytes = sizeof(pktPtr);
   //printf("MSB:%x LSB: %x\n", pktPtr[24], pktPtr[25]);
-  unsigned short checksum = (pktPtr[checksumIdx] << 8) + pktPtr[checksumIdx+1];
-  unsigned short sum_checked = 0;
-  for (int i=dataIdxStart; i<=dataIdxStop; i++) {
-    sum_checked += pktPtr[i];
-  }
-  //sum_checked = sum_checked;// % 0xFFFF;
-  if (checksum != sum_checked) {
-    printf("BAD CHECKSUM ** Checksum/Sumchecked: %d/%d\n", checksum, sum_checked);
+  unsigned sum_checked = byteSum(&pktPtr[dataIdxStart], dataIdxStop - dataIdxStart + 1);
+  if (!sum16_be::Match(sum_checked, &pktPtr[checksumIdx])) {
+    checksumFailCnt++;
+    __sync_fetch_and_add(&portStatsPageOf()->checksumFails, 1);
+    if (DEBUG) printf("BAD CHECKSUM ** Checksum/Sumchecked: %d/%d\n",
+		      (pktPtr[checksumIdx] << 8) + pktPtr[checksumIdx+1], sum_checked & 0xFFFF);
     return FALSE;
   }
   //printf("GOOD CHECKSUM -- Checksum/Sumchecked: %d/%d\n", checksum, sum_checked);
   return TRUE;
 }
 
+// Same, for a frame off this port, so the port's stats count the reject
+bool serial::portChecksumGood(unsigned char *pktPtr, int dataIdxStart, int dataIdxStop, int checksumIdx) {
+  if (checksumGood(pktPtr, dataIdxStart, dataIdxStop, checksumIdx)) return TRUE;
+  statInc(stats->checksumRejects);
+  return FALSE;
+}
+
 
 
 void serial::byteswap(void *ptr, int len)
@@ -402,18 +732,212 @@ void serial::byteswap(void *ptr, int len)
 }
 
 
-// This function looks for frames that have start-chars, no end-chars, and
-// a fixed length. 
-int serial::peekBufForStartCharsPlusFrameLength( unsigned char *peekChars, 
-						 int numPeekChars, 
-						 int minCharsNeeded) {
-  readAvailableData(); // Read all available data in member buf variable
-  int idx = getStartCharsBufIdx(peekChars,numPeekChars, NULL, 0);
-  if (idx >= 0 && (numInFrameBuf-idx >= minCharsNeeded) ) {
-    return idx; // Enough data for a frame so return idx of startChars
+void serial::addFrameDialect(const frameDialect &dialect) {
+  if (numDialects >= MAX_FRAME_DIALECTS) {
+    ThrowException(string("Too many frame dialects"));
+  }
+  dialects[numDialects] = dialect;
+  if (dialectFirstByte[dialect.header[0]] == 0) {
+    dialectFirstSet[numDialectFirst++] = dialect.header[0];
+  }
+  dialectFirstByte[dialect.header[0]] |= 1 << numDialects;
+  stats->typeIds[numDialects] = dialect.type;
+  numDialects++;
+  __atomic_store_n(&stats->numTypes, numDialects, __ATOMIC_RELEASE);
+}
+
+
+bool serial::dialectFrameFromBuf(frameView &view) {
+  int numInBuf = bytesInBuf();
+  int pos = 0;
+  for (; pos<numInBuf; pos++) {
+    // Skip straight to the next byte that can start any dialect
+    if ((pos = findAnyInBuf(dialectFirstSet, numDialectFirst, pos)) < 0) {
+      pos = numInBuf;
+      break;
+    }
+    unsigned candidates = dialectFirstByte[bufAt(pos)];
+
+    bool needMore = FALSE;
+    for (int d=0; candidates != 0; d++, candidates >>= 1) {
+      if ((candidates & 1) == 0) continue;
+      int frameLen = matchDialect(dialects[d], pos, numInBuf - pos);
+      if (frameLen < 0) {
+	needMore = TRUE;
+	continue;
+      }
+      if (frameLen == 0) continue;
+
+      consumeBuf(pos); // Line noise in front of the frame
+      viewBuf(view, 0, frameLen);
+      view.type = dialects[d].type;
+      view.stamp = frameStamp(frameLen);
+      statInc(stats->framesByType[d]);
+      consumeBuf(frameLen);
+      return TRUE;
+    }
+    // A frame may still be arriving here. Everything in front of it has
+    // been ruled out so drop that and pick up from here next time.
+    if (needMore) break;
+  }
+  consumeBuf(pos);
+  return FALSE;
+}
+
+
+int serial::matchDialect(const frameDialect &dialect, int offset, int avail) {
+  for (int i=1; i<dialect.headerLen; i++) {
+    if (i >= avail) return -1;
+    if (bufAt(offset + i) != dialect.header[i]) return 0;
+  }
+
+  int frameLen = dialect.frameLen;
+  if (frameLen == 0) {
+    if (dialect.lengthIdx >= avail) return -1;
+    frameLen = bufAt(offset + dialect.lengthIdx) + dialect.lengthBias;
+  }
+  if (frameLen > avail) return -1;
+
+  frameView view;
+  viewBuf(view, offset, frameLen);
+  if (!dialectChecksumOk(dialect, view)) {
+    statInc(stats->checksumRejects);
+    if (DEBUG) printf("BAD CHECKSUM on dialect frame type %d\n", dialect.type);
+    return 0;
+  }
+  return frameLen;
+}
+
+
+// Sum of frame bytes "start" through "stop", a segment at a time
+static unsigned viewSum(const frameView &view, int start, int stop) {
+  int len = stop - start + 1;
+  if (start >= view.len1) return byteSum(&view.seg2[start - view.len1], len);
+  int len1 = view.len1 - start;
+  if (len <= len1) return byteSum(&view.seg1[start], len);
+  return byteSum(&view.seg1[start], len1) + byteSum(view.seg2, len - len1);
+}
+
+template <class Policy>
+static bool viewChecksumOk(const frameDialect &dialect, const frameView &view) {
+  unsigned char sent[Policy::SENT_LEN];
+  for (int i=0; i<Policy::SENT_LEN; i++) sent[i] = view.at(dialect.checksumIdx + i);
+  return Policy::Match(viewSum(view, dialect.checksumStart, dialect.checksumStop), sent);
+}
+
+static bool noChecksum(const frameDialect &, const frameView &) {
+  return TRUE;
+}
+
+// Indexed by CHECKSUM_*
+static bool (* const dialectChecksums[])(const frameDialect &, const frameView &) = {
+  noChecksum,
+  viewChecksumOk<sum16_be>,
+  viewChecksumOk<sum8_inverted>,
+  viewChecksumOk<sum8_hex>
+};
+
+bool serial::dialectChecksumOk(const frameDialect &dialect, const frameView &view) {
+  if ((unsigned)dialect.checksumKind >= NELEMENTS(dialectChecksums)) return FALSE;
+  return dialectChecksums[dialect.checksumKind](dialect, view);
+}
+
+
+int serial::scanDialects(const frameDialect *dialects, int numDialects,
+			 const unsigned char *buf, int len, int &covered) {
+  int frames = 0;
+  covered = 0;
+  for (int i=0; i<len; ) {
+    int frameLen = 0;
+    for (int d=0; d<numDialects && frameLen == 0; d++) {
+      const frameDialect &dialect = dialects[d];
+      if (i + dialect.headerLen > len ||
+	  memcmp(&buf[i], dialect.header, dialect.headerLen) != 0) continue;
+      int n = dialect.frameLen;
+      if (n == 0) {
+	if (i + dialect.lengthIdx >= len) continue;
+	n = buf[i + dialect.lengthIdx] + dialect.lengthBias;
+      }
+      // Too short to hold its own checksum, or cut off by the end of buf
+      if (n <= dialect.checksumIdx || i + n > len) continue;
+      frameView view = { &buf[i], n, NULL, 0, n, dialect.type, 0 };
+      if (dialectChecksumOk(dialect, view)) frameLen = n;
+    }
+    if (frameLen > 0) {
+      frames++;
+      covered += frameLen;
+      i += frameLen;
+    }
+    else {
+      i++;
+    }
+  }
+  return frames;
+}
+
+
+void serial::ReactorAttached(void) {
+  if (rxQueue == NULL) rxQueue = new spsc_queue<queuedFrame, FRAME_QUEUE_LEN>;
+  // Anything still queued from before is sent as soon as the fd is watched
+  __atomic_store_n(&txArmed, (writePending() > 0) ? 1 : 0, __ATOMIC_SEQ_CST);
+}
+
+
+// Runs on the reactor thread: read what arrived, frame it and queue every
+// complete frame for the driver.
+void serial::ReactorReadable(void) {
+  readAvailableData();
+
+  frameView view;
+  while (frameFromBuf(view)) {
+    queuedFrame *slot = rxQueue->WriteSlot();
+    if (slot == NULL || view.len > MAX_QUEUED_FRAME_LEN) {
+      statInc(stats->queueDrops);
+      if (DEBUG) printf("serial frame queue dropped a frame (%s)\n", portName);
+      continue;
+    }
+    slot->type = view.type;
+    slot->len = view.len;
+    slot->stamp = view.stamp;
+    view.copyTo(slot->data);
+    rxQueue->Push();
   }
-  return -1; // Indicates not enough data and/or no start chars found
 }
 
 
+// Runs on the reactor thread: send what the driver queued
+void serial::ReactorWritable(void) {
+  if (!flushWrites()) return; // Still more; wait for the port to drain
+  reactor->WatchWritable(this, FALSE);
+  __atomic_store_n(&txArmed, 0, __ATOMIC_SEQ_CST);
+  if (writePending() > 0) armWriter();
+}
+
 
+// Runs on the reactor thread once it has stopped watching us. The driver
+// sees Reactor() is NULL and goes back to reading and writing the port
+// itself; nothing is watching for the fd to be writable any more.
+void serial::ReactorDropped(void) {
+  __atomic_store_n(&txArmed, 0, __ATOMIC_SEQ_CST);
+}
+
+
+// Driver side of the reactor queue. The frame handed out last time stays
+// in its slot (so the view needs no copy) until the driver asks again.
+bool serial::popQueuedFrame(frameView &view) {
+  if (frameHeld) {
+    rxQueue->Pop();
+    frameHeld = FALSE;
+  }
+  queuedFrame *frame = rxQueue->ReadSlot();
+  if (frame == NULL) return FALSE;
+  frameHeld = TRUE;
+
+  view.seg1 = frame->data;
+  view.len1 = view.len = frame->len;
+  view.seg2 = NULL;
+  view.len2 = 0;
+  view.type = frame->type;
+  view.stamp = frame->stamp;
+  return TRUE;
+}
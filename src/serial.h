@@ -18,20 +18,126 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
-#define FRAME_BUF_SIZE 20000
+#include <string.h>
 
-class serial {
+#include "reactor.h"
+#include "spsc_queue.h"
+#include "port_stats.h"
+
+// Size of the receive ring buffer. MUST be a power of two so that the
+// free-running head/tail counters can simply be masked into the buffer.
+#define RING_BUF_SIZE 32768
+#define RING_BUF_MASK (RING_BUF_SIZE - 1)
+
+// Size of the transmit queue, also a power of two. Commands to the units
+// are a few dozen bytes, so this holds many more than ever pile up.
+#define TX_BUF_SIZE 1024
+#define TX_BUF_MASK (TX_BUF_SIZE - 1)
+
+// frameView: A read-only window onto a frame that is still sitting in the
+// serial ring buffer. A frame that straddles the end of the ring comes back
+// as two segments (otherwise seg2 is NULL and len2 is 0). A view is only
+// good until the next call that reads the port.
+struct frameView {
+    const unsigned char *seg1;
+    int                  len1;
+    const unsigned char *seg2;
+    int                  len2;
+    int                  len;   // Total frame length (len1 + len2)
+    int                  type;  // frameDialect type it matched (-1 if none)
+    unsigned             stamp; // monotonic_us() when its last byte was read
+
+    // Byte "i" of the frame regardless of where the ring wrapped
+    unsigned char at(int i) const {
+        return (i < len1) ? seg1[i] : seg2[i - len1];
+    }
+
+    // Copy the whole frame out into "dst" (at least "len" bytes)
+    void copyTo(unsigned char *dst) const {
+        memcpy(dst, seg1, len1);
+        if (len2 > 0) memcpy(dst + len1, seg2, len2);
+    }
+
+    // Contiguous pointer to the frame. Only copies (into "scratch") in the
+    // rare case that the frame wrapped around the end of the ring.
+    const unsigned char *linear(unsigned char *scratch) const {
+        if (len2 == 0) return seg1;
+        copyTo(scratch);
+        return scratch;
+    }
+};
+
+// Checksum styles the serial layer can verify on behalf of a frame dialect
+enum {
+    CHECKSUM_NONE = 0,
+    CHECKSUM_SUM16_BE,      // 16 bit sum, sent as a big-endian binary short
+    CHECKSUM_SUM8_INVERTED, // 8 bit sum, one's complement, sent as one byte
+    CHECKSUM_SUM8_HEX       // 8 bit sum, sent as two ASCII hex digits
+};
+
+// States of the streaming framer used for variable length frames
+enum {
+    FRAMER_HUNT = 0,   // Looking for the first start char
+    FRAMER_START,      // Matching the rest of the start chars
+    FRAMER_DLE_START,  // Saw a DLE while hunting; is it a frame start?
+    FRAMER_IN_FRAME,   // Collecting frame bytes
+    FRAMER_DLE_ESCAPE  // Saw a DLE inside a frame
+};
+
+// Frames decoded on the reactor thread wait here for the driver. Longest
+// frame any driver in the tree receives is well under MAX_QUEUED_FRAME_LEN.
+#define MAX_QUEUED_FRAME_LEN 256
+#define FRAME_QUEUE_LEN      64    // Power of two
+struct queuedFrame {
+    int           type;
+    int           len;
+    unsigned      stamp;
+    unsigned char data[MAX_QUEUED_FRAME_LEN];
+};
+
+// Arrival times of the reads still in the ring, so each frame can be
+// stamped with when its last byte came in.
+#define READ_STAMP_LEN       64    // Power of two
+struct readStamp {
+    unsigned      tail;   // ringTail after the read
+    unsigned      stamp;  // monotonic_us() at the read
+};
+
+#define MAX_FRAME_DIALECTS   16
+#define MAX_DIALECT_HDR_LEN  8
+
+// frameDialect: Describes one kind of frame that can show up on a port.
+// A driver registers one per message type and the serial layer hands back
+// each matching frame tagged with "type". Frame length is either fixed or
+// read from the frame itself (frame[lengthIdx] + lengthBias).
+struct frameDialect {
+    int           type;
+    unsigned char header[MAX_DIALECT_HDR_LEN];
+    int           headerLen;
+    int           frameLen;      // Fixed frame length, or 0 to use lengthIdx
+    int           lengthIdx;
+    int           lengthBias;
+    int           checksumKind;  // CHECKSUM_*
+    int           checksumStart; // First byte summed
+    int           checksumStop;  // Last byte summed
+    int           checksumIdx;   // Where the sent checksum starts
+};
+
+class serial : public reactor_client {
     public:
         int   numRead;
         int   numWrote;
         //unsigned char  *readCharBuf;
         unsigned char  readCharBuf[2048];
+        portStats *stats;         // This port's counters (see port_stats.h)
+        static unsigned checksumFailCnt; // checksumGood failures, all ports
 
     protected:
         char  portName[80];
         int   portOpenFlags;
         int   asyncFlag;
         int   fd;
+        int   captureFd;        // Capture file every read is appended to, or -1
         int   readTimeoutMillis;
         unsigned char *startFrameChars;
         unsigned char *stopFrameChars;
@@ -40,8 +146,36 @@ class serial {
         int minFrameLen;
         int maxFrameLen;
 	int fixedFrameLen;
-	int numInFrameBuf;
-	unsigned char frameDataBuf[FRAME_BUF_SIZE]; // TODO: sized correctly?
+	// Receive ring buffer. ringHead/ringTail are free-running counters,
+	// (ringTail - ringHead) is the number of unconsumed bytes.
+	unsigned ringHead;
+	unsigned ringTail;
+	unsigned char ringBuf[RING_BUF_SIZE];
+	// Registered frame dialects, plus a bit per dialect for every byte
+	// value that a dialect header can start with.
+	frameDialect dialects[MAX_FRAME_DIALECTS];
+	int          numDialects;
+	unsigned     dialectFirstByte[256];
+	unsigned char dialectFirstSet[MAX_FRAME_DIALECTS]; // Distinct first bytes
+	int          numDialectFirst;
+	// Streaming framer state (see streamFrame)
+	int framerState;
+	int framerPos;        // Raw bytes of the current frame examined so far
+	int framerDecodedLen; // Same, less escape chars
+	int framerMatched;    // Start/stop chars matched so far
+	// Read arrival times, oldest first (see frameStamp)
+	readStamp readStamps[READ_STAMP_LEN];
+	unsigned  readStampHead;
+	unsigned  readStampTail;
+	// Set when a reactor reads the port for us (see ReactorAttached)
+	spsc_queue<queuedFrame, FRAME_QUEUE_LEN> *rxQueue;
+	bool frameHeld;       // Driver still has a view of the oldest queued frame
+	// Transmit queue. The driver appends at txTail; whoever flushes (the
+	// reactor thread if there is one, else the driver) sends from txHead.
+	unsigned char txBuf[TX_BUF_SIZE];
+	unsigned txHead;
+	unsigned txTail;
+	unsigned txArmed;     // Reactor is watching for the fd to be writable
 
     public:
         /**
@@ -77,13 +211,41 @@ class serial {
 
         /**
          * writePort
-         * DESCRIPTION:     Writes characters to serial port.
+         * DESCRIPTION:     Queues "numChars" to go out of the port and
+         *                  returns at once. The queue is sent by the reactor
+         *                  thread when the port can take it (or right here
+         *                  and by later writePort/getFrameView calls when
+         *                  there is no reactor); anything queued by then
+         *                  goes out in the same write. A command is queued
+         *                  whole or not at all.
          * PRE-CONDITIONS:  Valid port
          * POST-CONDITIONS: Valid port
-         * EXCEPTIONS THROWN:  TODO: ????
+         * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-        int writePort(char* charBuf, int numChars);
+        int     // numChars, or 0 if the queue had no room for them
+            writePort(const char* charBuf, int numChars);
+
+        /**
+         * flushWrites
+         * DESCRIPTION:     Writes as much of the transmit queue as the port
+         *                  will take without blocking. A short write leaves
+         *                  the rest queued and counts in stats->partialWrites;
+         *                  a write error throws the queue away and counts in
+         *                  stats->writeErrors.
+         * PRE-CONDITIONS:  Called from the thread that sends for this port
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // TRUE if the queue is now empty
+            flushWrites(void);
+
+	// Bytes queued by writePort that haven't been written yet
+	int writePending(void) const {
+	  return (int)(__atomic_load_n(&txTail, __ATOMIC_ACQUIRE) -
+		       __atomic_load_n(&txHead, __ATOMIC_ACQUIRE));
+	}
 
         /**
          * setBaud
@@ -124,15 +286,70 @@ class serial {
          */
         void initializePort();
 
+        /**
+         * startCapture/stopCapture
+         * DESCRIPTION:     Append every chunk read from the port, time
+         *                  stamped, to a capture file (see capture.h) for
+         *                  later replay. Capture starts by itself for ports
+         *                  opened while $EFIS_CAPTURE_DIR is set.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool startCapture(const char *path);
+        void stopCapture(void);
+
         void setHwFlowControl(int tenthsOfSecs);
 	void setMinMaxFrameLen(int shortest, int longest);
 	void setFixedFrameLen(int frameLen);
 	void setFrameStart(unsigned char* startChars, int numChars);
 	void setFrameEnd(unsigned char* endChars, int numChars);
-	int peekBufForStartCharsPlusFrameLength(unsigned char *peekChars, 
-					   int numPeekChars, 
-					   int minCharsNeeded);
-        bool getFrame(unsigned char* framePtr);
+
+        /**
+         * addFrameDialect
+         * DESCRIPTION:     Registers a kind of frame for getFrameView to
+         *                  look for.
+         * PRE-CONDITIONS:  Fewer than MAX_FRAME_DIALECTS registered
+         * POST-CONDITIONS: Dialect is matched from now on
+         * EXCEPTIONS THROWN:  string if the table is full
+         * EXCEPTIONS HANDLED: None
+         */
+	void addFrameDialect(const frameDialect &dialect);
+
+        /**
+         * getFrame
+         * DESCRIPTION:     Copies the next frame into framePtr, with DLE
+         *                  escapes removed
+         * PRE-CONDITIONS:  Framing has been set up
+         * POST-CONDITIONS: len is the frame's length after the escapes came
+         *                  out. If stamp is given it gets the frame's arrival
+         *                  time (monotonic_us)
+         * EXCEPTIONS THROWN:  Read errors from readPort
+         * EXCEPTIONS HANDLED: None
+         */
+        bool getFrame(unsigned char* framePtr, int &len, unsigned *stamp = NULL);
+        bool getFrame(unsigned char* framePtr, unsigned *stamp = NULL);
+
+        /**
+         * getFrameView
+         * DESCRIPTION:     Same as getFrame but hands back a view of the frame
+         *                  where it sits in the ring buffer (or, when a reactor
+         *                  reads the port, in the frame queue) instead of a
+         *                  copy. The frame is consumed; the view stays good
+         *                  until the next call to getFrameView/getFrame.
+         *                  With DLE framing the escapes have already been
+         *                  taken out, so view.len is the decoded length.
+         *                  If frame dialects are registered the next frame of
+         *                  any of them with a good checksum is returned and
+         *                  view.type says which dialect it was.
+         * PRE-CONDITIONS:  Framing has been set up (start chars, lengths or
+         *                  dialects)
+         * POST-CONDITIONS: view describes the frame if TRUE was returned
+         * EXCEPTIONS THROWN:  Read errors from readPort
+         * EXCEPTIONS HANDLED: None
+         */
+        bool getFrameView(frameView &view);
 	int getStartCharsBufIdx(unsigned char *startChars, 
 				int startCharCnt, 
 				unsigned char *stopChars, 
@@ -143,20 +360,76 @@ class serial {
 			  int startCheckIdx,
 			  int endCheckIdx,
 			  int checksumIdx);
+	// checksumGood for a frame from this port: a bad one also counts in
+	// the port's checksumRejects
+	bool portChecksumGood(unsigned char *framePtr,
+			      int startCheckIdx,
+			      int endCheckIdx,
+			      int checksumIdx);
+
+        /**
+         * scanDialects
+         * DESCRIPTION:     Counts the frames of any of "dialects" in "buf"
+         *                  whose checksums are good, the way the framer
+         *                  would find them. Used to tell what is talking on
+         *                  a port from a sample of its bytes.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of bytes those frames take
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	static int    // Good frames found
+	  scanDialects(const frameDialect *dialects, int numDialects,
+		       const unsigned char *buf, int len, int &covered);
 
 	static void byteswap(void *, int);
 
         /**
-         * getFrameFromBufAndShift
-         * DESCRIPTION:    Extracts packets from serial buffer and shifts buffer
-         * PRE-CONDITIONS:  None
+         * getFrameFromBuf
+         * DESCRIPTION:    Copies a packet out of the ring buffer and releases
+         *                 it along with anything in front of it
+         * PRE-CONDITIONS:  bufIdx/packetLen lie within the buffered data
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	void getFrameFromBuf(unsigned char *pktBuf, 
+                             int bufIdx, 
+                             int packetLen);
+
+        /**
+         * viewBuf
+         * DESCRIPTION:    Describes "len" buffered bytes starting "offset" bytes
+         *                 into the ring buffer without copying them
+         * PRE-CONDITIONS:  offset/len lie within the buffered data
          * POST-CONDITIONS: None
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
-	void getFrameFromBufAndShift(unsigned char *pktBuf, 
-                                      int bufIdx, 
-                                      int packetLen);
+	void viewBuf(frameView &view, int offset, int len) const;
+
+        /**
+         * consumeBuf
+         * DESCRIPTION:    Releases the oldest "len" bytes of the ring buffer
+         * PRE-CONDITIONS:  len <= bytesInBuf()
+         * POST-CONDITIONS: Space is available for more reads
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	void consumeBuf(int len) { ringHead += len; }
+
+	// Number of received bytes not yet consumed
+	int bytesInBuf(void) const { return (int)(ringTail - ringHead); }
+
+	// reactor_client interface. Once attached, the reactor thread reads the
+	// port and frames it; getFrameView/getFrame then only pop the queue.
+	// It also sends the transmit queue whenever the port can take it.
+	int  ReactorFd(void) const { return fd; }
+	void ReactorAttached(void);
+	void ReactorReadable(void);
+	void ReactorWritable(void);
+	bool ReactorWriting(void) const { return txArmed != 0; }
+	void ReactorDropped(void);
 
 
 
@@ -181,6 +454,48 @@ class serial {
          */
         void closePort();
 
+	// Offset of the first complete "chars" / first byte out of "set" at or
+	// after "from" in the ring, or -1
+	int findInBuf(const unsigned char *chars, int numChars, int from) const;
+	int findAnyInBuf(const unsigned char *set, int numSet, int from) const;
+
+	/**
+	 * frameFromBuf
+	 * DESCRIPTION:     Next frame out of what is already in the ring,
+	 *                  without reading the port
+	 * PRE-CONDITIONS:  Framing has been set up
+	 * POST-CONDITIONS: view describes the frame if TRUE was returned
+	 * EXCEPTIONS THROWN:  None
+	 * EXCEPTIONS HANDLED: None
+	 */
+	bool frameFromBuf(frameView &view);
+	bool fixedFrameFromBuf(frameView &view);
+	bool dialectFrameFromBuf(frameView &view);
+	bool popQueuedFrame(frameView &view);
+	// Have the reactor wake us when the fd can take the transmit queue
+	void armWriter(void);
+
+	bool streamFrame(frameView &view);
+	bool emitFrame(frameView &view);
+	// Arrival time of the read that brought in byte "len - 1" of the ring
+	unsigned frameStamp(int len);
+	void dropFrame(void);
+
+	// Length of the dialect frame at "offset", 0 if it is not one, or
+	// -1 if more bytes are needed to tell.
+	int matchDialect(const frameDialect &dialect, int offset, int avail);
+
+	static bool dialectChecksumOk(const frameDialect &dialect,
+				      const frameView &view);
+
+	// Byte "offset" bytes past the oldest unconsumed byte
+	unsigned char bufAt(int offset) const {
+	  return ringBuf[(ringHead + offset) & RING_BUF_MASK];
+	}
+	void putBufAt(int offset, unsigned char c) {
+	  ringBuf[(ringHead + offset) & RING_BUF_MASK] = c;
+	}
+
 
 };
 
@@ -1,4 +1,4 @@
-// shadinZ.cpp: Member functions of AHRS_XBOW class (attitude heading reference system)
+// shadinZ.cpp: Streaming parser for the Shadin Fuel/Air-data Z format
 //
 //  This program is free software; you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
@@ -15,331 +15,219 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
-#include <math.h>
 #include <stdio.h>
-#include <stdlib.h>
-#include <termios.h>
-#include <sys/types.h>
-#include <string.h>
-#include <unistd.h>
-#include <string>
 
+#include "constants.h"
 #include "shadinZ.h"
+#include "checksum.h"
+
+#define STX 0x02
+#define ETX 0x03
+
+enum {
+  SHADIN_HUNT = 0,   // Waiting for STX
+  SHADIN_LINE,       // Waiting for the 'Z' that starts a field
+  SHADIN_LABEL,      // Next char is the field label
+  SHADIN_FIELD,      // Collecting the field's chars
+  SHADIN_SKIP        // Unknown label - skip to the end of the line
+};
+
+// Width of each field's value, by label 'A'..'Y'
+static const unsigned char fieldWidths[] = {
+  3, 3, 3, 5, 5, 3, 3, 3, 3, 3, 4, 3, 4, 5, 4, 5, 3, 5, 3, 3, 6, 4, 7, 8, 3
+};
+
+// The fields each checksum covers. A block with any of them must carry
+// that checksum, and it must match.
+#define AIR_FIELDS      (SHADIN_FIELD('R') - SHADIN_FIELD('A'))
+#define GPS_FIELDS      (SHADIN_FIELD('Y') - SHADIN_FIELD('S'))
+
+// Value of the "Width" chars at "p": decimal digits, after an optional
+// '+' or '-'. FALSE for anything else, e.g. the dashes sent for no data.
+template <int Width>
+static inline bool fixedInt(const unsigned char *p, int &value)
+{
+  int i = 0;
+  int sign = 1;
+  if (p[0] == '+' || p[0] == '-') {
+    sign = (p[0] == '-') ? -1 : 1;
+    i = 1;
+  }
+  int v = 0;
+  for (; i < Width; i++) {
+    unsigned digit = p[i] - '0';
+    if (digit > 9) return FALSE;
+    v = v * 10 + digit;
+  }
+  value = sign * v;
+  return TRUE;
+}
 
-using namespace std;
+// +1 or -1 for a hemisphere char, 0 if it is neither
+static inline int hemisphere(unsigned char c, unsigned char plus, unsigned char minus)
+{
+  return (c == plus) ? 1 : (c == minus) ? -1 : 0;
+}
 
-#define TRUE 1
-#define FALSE 0
+// "<hemisphere><Deg digits><mm><hh>": degrees and decimal minutes
+template <int Deg>
+static inline double position(const unsigned char *p, int sign)
+{
+  int deg, min, hundredths;
+  if (sign == 0 || !fixedInt<Deg>(&p[1], deg) || !fixedInt<2>(&p[1+Deg], min) ||
+      !fixedInt<2>(&p[3+Deg], hundredths)) {
+    return SHADIN_NO_DATA;
+  }
+  return sign * (deg + (min + hundredths / 100.0) / 60.0);
+}
 
 
-shadinZ::shadinZ(const char *unstrippedMsg)
+shadinZ::shadinZ(void)
 {
-  strncpy(rawMsg, unstrippedMsg, MAX_SHADIN_MSG_SIZE);
-  rawMsg[MAX_SHADIN_MSG_SIZE] = '\0'; // Make sure string is terminated
-  parseShadinZFormat();
+  Reset();
 }
 
-// This method doesn't care if it's gps->adc or adc->gps data
-// Since the Z field indentifiers don't overlap.
-void shadinZ::parseShadinZFormat() {
-  // First strip out the STX/ETX chars off of the raw message.
-  int stxIdx = 0;
-  int etxIdx = 0;
-  for (int i=0; i<(int)sizeof(rawMsg); i++) {
-    if (rawMsg[i] == 0x02) { // STX
-      stxIdx = i;
-    }
-    else if (rawMsg[i] == 0x03) { // ETX
-      etxIdx = i;
-    }
-  }
 
-  for (int i=stxIdx; i <= etxIdx; i++) {
-    printf("%c", rawMsg[i]);
-  }
-  printf("\n");
+void shadinZ::Reset(void)
+{
+  state = SHADIN_HUNT;
+  sum = fieldStart = gpsStart = 0;
+  fieldLen = fieldWidth = 0;
+  blockFields = checksGood = 0;
+  broken = FALSE;
+  block.fieldsSeen = 0;
+}
 
-  if (stxIdx == etxIdx) {
-    // TODO: make sure abort sig prob is fixed before enabling
-    //ThrowException(string("SHADIN FORMAT EXCEPTION"));
-  }
 
-  // Create a C++ string to make the parsing easier.
-  //string shadinZStr = string(rawMsg, etxIdx-stxIdx-1);  
-  int checksum1BeginIdx = stxIdx;
-  int checksum2BeginIdx = -1;
-  for (int i=stxIdx+1; i<etxIdx; i++) {
-    if (rawMsg[i] != 'Z') continue;
-    char dataLabel = rawMsg[i+1]; // A, B, C, D, E, ...
-    // From sniffing the protocol I believe all are caps
-    char str[16];
-    //bzero(str, 16);
-    int len = 0;
-    char tmpChars[16];
-    int degTmp;
-    double dblTmp;
-    switch(dataLabel) {
-    case 'A':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      iasKts = atoi(str);
-      // checksum1BeginIdx = i; // Use the stxIdx instead
-      i += 1+len+2; //  Skip over dataLabel + dataLen + <CR><NL>
-      break;
-    case 'B':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      tasKts = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'C':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      mach = atof(str)/1000.0;
-      i += 1+len+2;
-      break;
-    case 'D':
-      len = 5;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      pAlt = atof(str) * 10.0;
-      i += 1+len+2;
-      break;
-    case 'E':
-      len = 5;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      dAlt = atof(str) * 10.0;
-      i += 1+len+2;
-      break;
-    case 'F':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      oatDegC = atof(str);
-      i += 1+len+2;
-      break;
-    case 'G':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      tatDegC = atof(str);
-      i += 1+len+2;
-      break;
-    case 'H':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      // If nothing there (i.e. dashes) then set to non-realistic value (-999999)
-      if (strncmp(str,"---",3) == 0) windDir = -999999;
-      else windDir = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'I':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      // If nothing there (i.e. dashes) then set to non-realistic value (-999999)
-      if (strncmp(str,"---",3) == 0) windSpeedKts = -999999;
-      else windSpeedKts = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'J':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      // If nothing there (i.e. dashes) then set to non-realistic value (-999999)
-      if (strncmp(&str[1],"--",2) == 0) rateTurnDegSec = -999999.0;
-      else rateTurnDegSec = atof(str); // + is right turn, left is -
-      i += 1+len+2;
-      break;
-    case 'K':
-      len = 4;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (strncmp(&str[1],"---",3) == 0) vSpeedFpm = -999999;
-      else vSpeedFpm = atoi(str) * 10; // Orig value is in tens of ft/min
-      i += 1+len+2;
-      break;
-    case 'L':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (strncmp(str,"---",3) == 0) trueHeading = -999999;
-      else trueHeading = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'M':
-      len = 4;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      rightFuelFlowGalHr = atof(str) / 10.0; // Orig is in tenths of gal/hr
-      i += 1+len+2;
-      break;
-    case 'N':
-      len = 5;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      rightFuelUsedGal = atof(str) / 10.0; // Orig is in tenths of gal
-      i += 1+len+2;
-      break;
-    case 'O':
-      len = 4;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (strncmp(str,"----",4) == 0) leftFuelFlowGalHr = -999999; // i.e If you get this then unit is just setup for one fuel flow sensor
-      else leftFuelFlowGalHr = atof(str) / 10.0; // Orig is in tenths of gal/hr
-      i += 1+len+2;
-      break;
-    case 'P':
-      len = 5;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';      
-      if (strncmp(str,"-----",5) == 0) leftFuelUsedGal = -999999; // i.e If you get this then unit is just setup for one fuel flow sensor
-      else leftFuelUsedGal = atof(str) / 10.0; // Orig is in tenths of gal
-      i += 1+len+2;
-      break;
-    case 'Q':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      err = atoi(str); // Error code 001=temp_sensor_fail, 000=no_errors
-      i += 1+len+2;
-      break;
-    case 'R':
-      len = 5;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      printf("Checksum extracted string: %s\n", str);
-      checksum1 = atoi(str); // Error code 001=temp_sensor_fail, 000=no_errors
-      //if ( checksumOk(rawMsg, stxIdx+1, i-1, checksum1) ) {
-      if ( checksumOk(rawMsg, checksum1BeginIdx, i-1, checksum1) ) {
-	// ThrowException("SHADIN CHECKSUM1 EXCEPTION"); TODO: enable this
+bool shadinZ::Parse(const unsigned char *buf, int len, shadinZData &data)
+{
+  bool updated = FALSE;
+
+  for (int i=0; i<len; i++) {
+    unsigned char c = buf[i];
+
+    if (c == STX) {
+      // Start over, from what has been published so far
+      block = data;
+      sum = c;
+      blockFields = checksGood = 0;
+      broken = FALSE;
+      state = SHADIN_LINE;
+      continue;
+    }
+    if (state == SHADIN_HUNT) continue;
+
+    if (c == ETX) {
+      if (state == SHADIN_FIELD) broken = TRUE;
+      unsigned needed = 0;
+      if (blockFields & AIR_FIELDS) needed |= SHADIN_FIELD('R');
+      if (blockFields & GPS_FIELDS) needed |= SHADIN_FIELD('Y');
+      if (!broken && needed != 0 && (checksGood & needed) == needed) {
+	data = block;
+	updated = TRUE;
       }
-      i += 1+len+2;
-      break;
-    case 'S':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      groundSpeedKts = atoi(str);
-      checksum2BeginIdx = i;
-      i += 1+len+2;
-      break;
-    case 'T':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      magTrackDeg = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'U':
-      len = 6;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      distToDestNm = atoi(str);
-      i += 1+len+2;
-      break;
-    case 'V':
-      len = 4;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (str[0] == 'E') {
-	str[0] = '+'; // East is positive
+      state = SHADIN_HUNT;
+      continue;
+    }
+
+    switch (state) {
+    case SHADIN_LINE:
+      if (c == 'Z') {
+	fieldStart = sum;
+	state = SHADIN_LABEL;
       }
-      else { // i.e. == 'W'
-	str[0] = '-'; // West negative
+      break;
+
+    case SHADIN_LABEL:
+      if (c < 'A' || c >= 'A' + (int)sizeof(fieldWidths)) {
+	state = SHADIN_SKIP;
+	break;
       }
-      magVarDeg = atoi(str);
-      i += 1+len+2;
+      label = c;
+      fieldWidth = fieldWidths[c - 'A'];
+      fieldLen = 0;
+      state = SHADIN_FIELD;
       break;
-    case 'W':
-      len = 7;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (str[0] == 'N') {
-	str[0] = '+'; // North is positive for latitude
+
+    case SHADIN_FIELD:
+      if (c == '\r' || c == '\n') {
+	broken = TRUE; // Short field
+	state = SHADIN_LINE;
+	break;
       }
-      else { // i.e. == 'S'
-	str[0] = '-'; // South is negative
+      field[fieldLen++] = c;
+      if (fieldLen == fieldWidth) {
+	storeField();
+	state = SHADIN_LINE;
       }
-
-      memcpy(tmpChars, str, 3);
-      tmpChars[3] = '\0';
-      degTmp = atoi(tmpChars);
-
-      memcpy(tmpChars, &str[3], 2); // Get mm.mm  (decimal minutes)
-      tmpChars[2] = '\0';
-      dblTmp = atof(tmpChars);
-      memcpy(tmpChars, &str[5], 2); // Get mm.mm  (decimal minutes)
-      tmpChars[2] = '\0';
-      dblTmp = dblTmp + atof(tmpChars)/100.0;
-      latDeg = degTmp + dblTmp/60.0;
-
-      i += 1+len+2;
       break;
-    case 'X':
-      len = 8;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      if (str[0] == 'W') str[0] = '+'; // West is positive for longitude
-      else str[0] = '-'; // East is negative  // i.e. == 'E'
-      memcpy(tmpChars, str, 4);
-      tmpChars[4] = '\0';
-      degTmp = atoi(tmpChars);
-
-      memcpy(tmpChars, &str[4], 2); // Get mm.mm  (decimal minutes)
-      tmpChars[2] = '\0';
-      dblTmp = atof(tmpChars);
-      memcpy(tmpChars, &str[6], 2); // Get mm.mm  (decimal minutes)
-      tmpChars[2] = '\0';
-      dblTmp = dblTmp + atof(tmpChars)/100.0;
-      lonDeg = degTmp + dblTmp/60.0;
 
-      i += 1+len+2;
+    case SHADIN_SKIP:
+      if (c == '\n') state = SHADIN_LINE;
       break;
-    case 'Y':
-      len = 3;
-      memcpy(str, &rawMsg[i+2], len);
-      str[len] = '\0';
-      checksum1 = atoi(str); // Error code 001=temp_sensor_fail, 000=no_errors
-      if ( checksumOk(rawMsg, checksum2BeginIdx, i-1, checksum1) ) {
-	// ThrowException("SHADIN CHECKSUM2 EXCEPTION"); TODO: enable this
-      }
-      i += 1+len+2;
-      break;
-    } // END of switch
-  } // END of for
-  
+    }
+    sum += c;
+  }
+  return updated;
 }
 
 
-bool shadinZ::checksumOk(char *pktPtr, int dataIdxStart, 
-                          int dataIdxStop, int checksum) {
-  printf("start/stop: %d/%d\n", dataIdxStart, dataIdxStop);
-  //unsigned short checksum = (pktPtr[checksumIdx] << 8) + pktPtr[checksumIdx+1];
-  unsigned char sum_checked = 0;
-  for (int i=dataIdxStart; i<=dataIdxStop; i++) {
-    sum_checked += pktPtr[i];
-  }
-  //sum_checked = sum_checked;// % 0xFFFF;
-  if (checksum != sum_checked) {
-    printf("BAD SHADIN CHECKSUM ** Checksum/Sumchecked: %d/%d\n", checksum, sum_checked);
-    return FALSE;
+// Convert the field just collected into its member of "block"
+void shadinZ::storeField(void)
+{
+  const unsigned char *f = field;
+  int v;
+
+  switch (label) {
+  case 'A': block.iasKts = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'B': block.tasKts = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'C': block.mach = fixedInt<3>(f, v) ? v / 1000.0 : SHADIN_NO_DATA; break;
+  case 'D': block.pAlt = fixedInt<5>(f, v) ? v * 10.0 : SHADIN_NO_DATA; break;
+  case 'E': block.dAlt = fixedInt<5>(f, v) ? v * 10.0 : SHADIN_NO_DATA; break;
+  case 'F': block.oatDegC = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'G': block.tatDegC = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'H': block.windDir = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'I': block.windSpeedKts = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'J': block.rateTurnDegSec = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'K': block.vSpeedFpm = fixedInt<4>(f, v) ? v * 10 : SHADIN_NO_DATA; break; // Sent in tens of ft/min
+  case 'L': block.trueHeading = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'M': block.rightFuelFlowGalHr = fixedInt<4>(f, v) ? v / 10.0 : SHADIN_NO_DATA; break; // Sent in tenths
+  case 'N': block.rightFuelUsedGal = fixedInt<5>(f, v) ? v / 10.0 : SHADIN_NO_DATA; break;
+  case 'O': block.leftFuelFlowGalHr = fixedInt<4>(f, v) ? v / 10.0 : SHADIN_NO_DATA; break;
+  case 'P': block.leftFuelUsedGal = fixedInt<5>(f, v) ? v / 10.0 : SHADIN_NO_DATA; break;
+  case 'Q': block.err = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'R':
+    // Sum of everything from the STX up to this line
+    if (sum8_decimal<5>::Match(fieldStart, f)) checksGood |= SHADIN_FIELD('R');
+    break;
+  case 'S':
+    gpsStart = fieldStart;
+    block.groundSpeedKts = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA;
+    break;
+  case 'T': block.magTrackDeg = fixedInt<3>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'U': block.distToDestNm = fixedInt<6>(f, v) ? v : SHADIN_NO_DATA; break;
+  case 'V':
+    v = hemisphere(f[0], 'E', 'W');
+    if (v == 0 || !fixedInt<3>(&f[1], block.magVarDeg)) block.magVarDeg = SHADIN_NO_DATA;
+    else block.magVarDeg *= v;
+    break;
+  case 'W': block.latDeg = position<2>(f, hemisphere(f[0], 'N', 'S')); break;
+  case 'X': block.lonDeg = position<3>(f, hemisphere(f[0], 'W', 'E')); break;
+  case 'Y':
+    // Sum of the ZS line up to this one
+    if (sum8_decimal<3>::Match(fieldStart - gpsStart, f)) checksGood |= SHADIN_FIELD('Y');
+    break;
   }
-  printf("GOOD SHADIN CHECKSUM -- Checksum/Sumchecked: %d/%d\n", checksum, sum_checked);
-  return TRUE;
+  blockFields |= SHADIN_FIELD(label);
+  block.fieldsSeen |= SHADIN_FIELD(label);
 }
 
 
-void shadinZ::printValues() {
-  printf("iasKts:%d tasKts:%d mach:%f pAlt:%f dAlt:%f oatDegC:%f tatDegC:%f\n winDir:%d windSpeedKts:%d rateTurnDegSec:%f vSpeedFpm:%d trueHeading:%d\n rightFuelFlowGalHr:%f rightFuelUsedGal:%f leftFuelFlowGalHr:%f leftFuelUsedGal:%f err:%d checksum1:%d groundSpeedKts:%d magTrackDeg:%d distToDestNm:%d magVarDeg:%d latDeg:%f lonDeg:%f checksum2:%d\n",
-	 iasKts, tasKts, mach, pAlt, dAlt, oatDegC, tatDegC, windDir,
-         windSpeedKts, rateTurnDegSec, vSpeedFpm, trueHeading,
-         rightFuelFlowGalHr, rightFuelUsedGal, leftFuelFlowGalHr, leftFuelUsedGal,
-         err, checksum1, groundSpeedKts, magTrackDeg, distToDestNm, magVarDeg,
-         latDeg, lonDeg, checksum2);
+void shadinZ::printValues(const shadinZData &d) {
+  printf("iasKts:%d tasKts:%d mach:%f pAlt:%f dAlt:%f oatDegC:%f tatDegC:%f\n winDir:%d windSpeedKts:%d rateTurnDegSec:%f vSpeedFpm:%d trueHeading:%d\n rightFuelFlowGalHr:%f rightFuelUsedGal:%f leftFuelFlowGalHr:%f leftFuelUsedGal:%f err:%d groundSpeedKts:%d magTrackDeg:%d distToDestNm:%d magVarDeg:%d latDeg:%f lonDeg:%f\n",
+	 d.iasKts, d.tasKts, d.mach, d.pAlt, d.dAlt, d.oatDegC, d.tatDegC, d.windDir,
+         d.windSpeedKts, d.rateTurnDegSec, d.vSpeedFpm, d.trueHeading,
+         d.rightFuelFlowGalHr, d.rightFuelUsedGal, d.leftFuelFlowGalHr, d.leftFuelUsedGal,
+         d.err, d.groundSpeedKts, d.magTrackDeg, d.distToDestNm, d.magVarDeg,
+         d.latDeg, d.lonDeg);
 }
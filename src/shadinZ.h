@@ -14,49 +14,99 @@
 //  along with this program; if not, write to the Free Software
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
-//
 
-#define MAX_SHADIN_MSG_SIZE 256
+#ifndef SHADINZ_H
+#define SHADINZ_H
+
+// A Z format block is STX, then one "Z<label><fixed width value><CR><LF>"
+// line per field, then ETX. Labels A-R are air data and fuel (checksummed
+// by ZR), S-Y are from the GPS (checksummed by ZY).
+
+// Value of any field the unit sent as dashes, i.e. has no value for
+#define SHADIN_NO_DATA          -999999
+
+// Bit in shadinZData::fieldsSeen for the field labelled "label"
+#define SHADIN_FIELD(label)     (1u << ((label) - 'A'))
+
+#define SHADIN_MAX_FIELD_WIDTH  8
+
+// shadinZData: The latest good values. A field keeps its last value until a
+// block with a good checksum brings a new one.
+struct shadinZData {
+    unsigned    fieldsSeen;             // SHADIN_FIELD bits of every field received
+    int         iasKts;                 // ZA
+    int         tasKts;                 // ZB
+    double      mach;                   // ZC
+    double      pAlt;                   // ZD
+    double      dAlt;                   // ZE
+    double      oatDegC;                // ZF
+    double      tatDegC;                // ZG
+    int         windDir;                // ZH
+    int         windSpeedKts;           // ZI
+    double      rateTurnDegSec;         // ZJ, + is a right turn
+    int         vSpeedFpm;              // ZK
+    int         trueHeading;            // ZL
+    double      rightFuelFlowGalHr;     // ZM
+    double      rightFuelUsedGal;       // ZN
+    double      leftFuelFlowGalHr;      // ZO, no data if only one flow sensor
+    double      leftFuelUsedGal;        // ZP
+    int         err;                    // ZQ, 001=temp_sensor_fail, 000=no_errors
+    int         groundSpeedKts;         // ZS
+    int         magTrackDeg;            // ZT
+    int         distToDestNm;           // ZU
+    int         magVarDeg;              // ZV, east is positive
+    double      latDeg;                 // ZW, north is positive
+    double      lonDeg;                 // ZX, west is positive
+};
 
+// shadinZ class: Streaming Z format parser. Bytes can be fed in any size
+// pieces; each field is converted by a fixed width integer conversion as
+// soon as its last char arrives. No heap, no stdio, no libc number parsing.
 class shadinZ {
     public:
-      char rawMsg[MAX_SHADIN_MSG_SIZE];
-
-      int iasKts;
-      int tasKts;
-      double mach;
-      double pAlt;
-      double dAlt;
-      double oatDegC;
-      double tatDegC;
-      int windDir;
-      int windSpeedKts;
-      double rateTurnDegSec;
-      int vSpeedFpm;
-      int trueHeading;
-      double rightFuelFlowGalHr;
-      double rightFuelUsedGal;
-      double leftFuelFlowGalHr;
-      double leftFuelUsedGal;
-      int err;
-      int checksum1;
-      int groundSpeedKts;
-      int magTrackDeg;
-      int distToDestNm;
-      int magVarDeg;
-      double latDeg;
-      double lonDeg;
-      int checksum2;
+        shadinZ(void);
 
+        /**
+         * Parse
+         * DESCRIPTION:     Runs "len" more bytes through the parser. Every
+         *                  block that ends (ETX) in them with all of its
+         *                  checksums good is copied into "data".
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // TRUE if "data" was updated
+            Parse(const unsigned char *buf, int len, shadinZData &data);
 
-    protected:
+        /**
+         * Reset
+         * DESCRIPTION:     Throws away any partly received block
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: Parser is waiting for an STX
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void Reset(void);
 
-    // Funcs
-    public:
-        shadinZ(const char unstrippedMsg[]);
-	void parseShadinZFormat();
-        void printValues(void);
-    protected:   
-	bool shadinZ::checksumOk(char *pktPtr, int dataIdxStart, int dataIdxStop, int checksum);
+        // Prints every value (debugging only)
+        static void printValues(const shadinZData &data);
 
+    protected:
+        void storeField(void);
+
+        int             state;
+        unsigned        sum;            // Of every byte since the STX
+        unsigned        fieldStart;     // sum before the current field's 'Z'
+        unsigned        gpsStart;       // sum before the ZS line
+        int             label;
+        int             fieldWidth;
+        int             fieldLen;
+        unsigned char   field[SHADIN_MAX_FIELD_WIDTH];
+        unsigned        blockFields;    // SHADIN_FIELD bits seen since the STX
+        unsigned        checksGood;     // Same, for the checksums that matched
+        bool            broken;         // A field was cut short
+        shadinZData     block;          // Values so far, published at ETX
 };
+
+#endif /* SHADINZ_H */
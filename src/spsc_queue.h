@@ -0,0 +1,113 @@
+// spsc_queue.h: Lock-free single producer/single consumer queue
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+
+// spsc_queue: A fixed ring of N slots (N a power of two) passed from exactly
+// one producer thread to exactly one consumer thread without locks. Slots
+// are filled and read in place: the producer gets a slot with WriteSlot,
+// fills it and publishes it with Push; the consumer looks at the oldest
+// slot with ReadSlot and hands it back with Pop when done with it.
+template <class T, unsigned N>
+class spsc_queue
+{
+    public:
+        spsc_queue (void)
+            {
+                head = 0;
+                tail = 0;
+            }
+
+        /**
+         * WriteSlot
+         * DESCRIPTION:     Producer side: the next free slot
+         * PRE-CONDITIONS:  Called from the producer thread only
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        T *     // Slot to fill, or NULL if the queue is full
+            WriteSlot (void)
+            {
+                unsigned h = __atomic_load_n (&head, __ATOMIC_ACQUIRE);
+                if (tail - h == N)
+                    return (NULL);
+                return (&slots [tail & (N - 1)]);
+            }
+
+        /**
+         * Push
+         * DESCRIPTION:     Producer side: publish the slot from WriteSlot
+         * PRE-CONDITIONS:  WriteSlot returned a slot
+         * POST-CONDITIONS: Slot is visible to the consumer
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void Push (void)
+            {
+                __atomic_store_n (&tail, tail + 1, __ATOMIC_RELEASE);
+            }
+
+        /**
+         * ReadSlot
+         * DESCRIPTION:     Consumer side: the oldest published slot
+         * PRE-CONDITIONS:  Called from the consumer thread only
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        T *     // Oldest slot, or NULL if the queue is empty
+            ReadSlot (void)
+            {
+                unsigned t = __atomic_load_n (&tail, __ATOMIC_ACQUIRE);
+                if (head == t)
+                    return (NULL);
+                return (&slots [head & (N - 1)]);
+            }
+
+        /**
+         * Pop
+         * DESCRIPTION:     Consumer side: hand the slot from ReadSlot back
+         * PRE-CONDITIONS:  ReadSlot returned a slot
+         * POST-CONDITIONS: Slot may be reused by the producer
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void Pop (void)
+            {
+                __atomic_store_n (&head, head + 1, __ATOMIC_RELEASE);
+            }
+
+        // Number of slots in use (only a snapshot if called from a
+        // third thread)
+        unsigned Count (void) const
+            {
+                return (__atomic_load_n (&tail, __ATOMIC_ACQUIRE) -
+                        __atomic_load_n (&head, __ATOMIC_ACQUIRE));
+            }
+
+    protected:
+        // Kept on separate cache lines so the two threads don't fight over them
+        unsigned        head __attribute__ ((aligned (64)));  // Written by the consumer
+        unsigned        tail __attribute__ ((aligned (64)));  // Written by the producer
+        T               slots [N] __attribute__ ((aligned (64)));
+};
+
+#endif /* SPSC_QUEUE_H */
@@ -16,47 +16,52 @@
 //  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 //
 
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 
-    public:
-        // Flight parameters
-        double          pitch_angle;            // In radians
-        double          dpitch_angle;           // 1st deriviative In radians
-        double          roll_angle;             // In radians
-        double          droll_angle;            // 1st deriviative In radians
-        double          yaw_angle;              // In radians
-        double          dyaw_angle;             // 1st deriviative In radians
-        unsigned        airspeed;               // In knots CAS
-        unsigned        dairspeed;              // 1st deriviative In knots CAS
-        unsigned        altitude;               // In feet MSL
-        unsigned        daltitude;              // 1st deriviative In feet MSL
-        unsigned        heading;                // 1-360 compass heading
-        unsigned        dheading;               // 1st deriviative 1-360 compass heading
-        double          lat, lng;               // GPS coordinates
-
-    protected:
-        // Aircraft configuration
-        double          aileron_position;       // Right roll deflection in radians
-        double          elevator_position;      // Pitch up deflection in radians
-        double          rudder_position;        // Yaw right deflection in radians
-        double          flap_position;          // down deflection in radians
-        unsigned        engine_power;           // Percent power output of engine(s)
-        // Landing gear ignored for now
-
-        // Environmental parameters
-        int             oat;                    // Outside air temp in degrees C
-        double          altimeter;              // Barametric pressure in "Hg
-        unsigned        wa_heading;             // Winds aloft
-        unsigned        wa_speed;               // Winds aloft speed
-        unsigned        turbulence;             // Amount of turbulence on a scale of 1-100
-        unsigned        density_altitude;       // Density altitude (computed and saved)
-
-    public:
-        // Inputs from test or autopilot
+#include "constants.h"
+#include "exceptions.h"
+#include "test_aircraft.h"
+
+#define G_FPS2                  32.174  // Feet / s^2
+#define FPS_PER_KNOT            1.68781
+#define NM_PER_DEGREE           60.0
+
+aircraft::aircraft (void)
+{
+    pitch_angle = dpitch_angle = 0;
+    roll_angle = droll_angle = 0;
+    yaw_angle = dyaw_angle = 0;
+    airspeed = 120;
+    dairspeed = 0;
+    altitude = 8000;
+    daltitude = 0;
+    heading = 0;
+    dheading = 0;
+    lat = 47.45;
+    lng = -122.31;
+    ground_speed = airspeed;
+
+    aileron_position = 0;
+    elevator_position = 0;
+    rudder_position = 0;
+    flap_position = 0;
+    engine_power = 85;
+
+    oat = 15;
+    altimeter = 29.92;
+    wa_heading = 0;
+    wa_speed = 0;
+    turbulence = 0;
+    density_altitude = 8000;
+    gust_seed = 1;
+}
 
 /**
  * SetAilerons
  * DESCRIPTION:     Set new aileron input to the aircraft
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Ailerons set
  * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
@@ -72,7 +77,7 @@ double         deflection              // Right roll deflection in radians
 /**
  * SetElevator
  * DESCRIPTION:     Set new elevator input to the aircraft
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Elevator set
  * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
@@ -88,7 +93,7 @@ void aircraft::SetElevator
 /**
  * SetRudder
  * DESCRIPTION:     Set new rudder input to the aircraft
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Rudder set
  * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
@@ -104,7 +109,7 @@ void aircraft::SetRudder
 /**
  * SetFlaps
  * DESCRIPTION:     Set new flaps input to the aircraft
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Flaps set
  * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
@@ -120,7 +125,7 @@ void aircraft::SetFlaps
 /**
  * SetPower
  * DESCRIPTION:     Set power level to the aircraft
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Power set
  * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
@@ -139,7 +144,7 @@ void aircraft::SetPower
  *                  period.
  * PRE-CONDITIONS:  Environmental factors loaded.
  * POST-CONDITIONS: Aircraft state variables advanced
- * EXCEPTIONS THROWN:  NO_ENVIRONMENT
+ * EXCEPTIONS THROWN:  None
  * EXCEPTIONS HANDLED: None
  */
 void aircraft::IncrementTime
@@ -147,16 +152,66 @@ void aircraft::IncrementTime
  double         seconds         // How many seconds to advance the state of the aircraft
 )
 {
+    // Controls set the rates, which die away on their own when centred
+    droll_angle += (ROLL_CONSTANT * aileron_position - droll_angle) * RATE_RESPONSE * seconds;
+    dpitch_angle += (PITCH_CONSTANT * elevator_position - dpitch_angle) * RATE_RESPONSE * seconds;
 
-    droll_angle = ROLL_CONSTANT * aileron_deflection;
-    dpitch_angle = PITCH_CONSTANT;
-    dyaw
+    // Turbulence kicks the rates from a fixed sequence, so a run repeats
+    if (turbulence != 0)
+    {
+        gust_seed = gust_seed * 1103515245 + 12345;
+        double gust = ((int)((gust_seed >> 16) & 0x7FFF) - 0x4000) / (double)0x4000;
+        droll_angle += gust * TURBULENCE_RATE * turbulence / 100;
+        dpitch_angle += gust * TURBULENCE_RATE * turbulence / 200;
+    }
+
+    roll_angle += droll_angle * seconds;
+    if (fabs (roll_angle) > MAX_ROLL)
+    {
+        roll_angle = (roll_angle > 0) ? MAX_ROLL : -MAX_ROLL;
+        droll_angle = 0;
+    }
+    pitch_angle += dpitch_angle * seconds;
+    if (fabs (pitch_angle) > MAX_PITCH)
+    {
+        pitch_angle = (pitch_angle > 0) ? MAX_PITCH : -MAX_PITCH;
+        dpitch_angle = 0;
+    }
+
+    // A coordinated turn at the bank angle, plus whatever the rudder adds
+    double tas_fps = airspeed * FPS_PER_KNOT * (1 + altitude / 1000 * 0.02);
+    double turn_rate = 0;
+    if (tas_fps > 1)
+        turn_rate = G_FPS2 * tan (roll_angle) / tas_fps;
+    dyaw_angle = turn_rate + YAW_CONSTANT * rudder_position;
+    yaw_angle = fmod (yaw_angle + dyaw_angle * seconds + 2 * M_PI, 2 * M_PI);
+    dheading = dyaw_angle * 180 / M_PI;
+    heading = yaw_angle * 180 / M_PI;
+
+    // Speed settles where power meets drag, less what the climb costs
+    double target = CRUISE_SPEED * engine_power / 100.0 - FLAP_DRAG * flap_position;
+    dairspeed = (target - airspeed) / SPEED_TIME_CONSTANT -
+                G_FPS2 * sin (pitch_angle) / FPS_PER_KNOT;
+    airspeed += dairspeed * seconds;
+    if (airspeed < 0)
+        airspeed = 0;
+
+    daltitude = tas_fps * sin (pitch_angle);
+    altitude += daltitude * seconds;
+    density_altitude = (unsigned) (altitude + 120 * (oat - (15 - 2 * altitude / 1000)));
+
+    // Ground track, with the winds aloft blowing from wa_heading
+    double north = airspeed * cos (yaw_angle) - wa_speed * cos (wa_heading * M_PI / 180);
+    double east = airspeed * sin (yaw_angle) - wa_speed * sin (wa_heading * M_PI / 180);
+    ground_speed = sqrt (north * north + east * east);
+    lat += north / 3600 * seconds / NM_PER_DEGREE;
+    lng += east / 3600 * seconds / (NM_PER_DEGREE * cos (lat * M_PI / 180));
 }
 
 /**
  * ReadInitialConditions
  * DESCRIPTION:     Read aircraft and environment initial conditions
- * PRE-CONDITIONS:  
+ * PRE-CONDITIONS:
  * POST-CONDITIONS: Class initialized and aircraft ready to simulate
  * EXCEPTIONS THROWN:  NO_SUCH_FILE
  * EXCEPTIONS HANDLED: None
@@ -166,8 +221,65 @@ SyntaxError     *       // Pointer to syntax error descriptor if there was an er
                         // pointer.
 aircraft::ReadInitialConditions
 (
- string         path
+ const char    *path
 )
 {
+    SyntaxError        *ret = NULL;
+    FILE               *cfile;
+    unsigned            line_num;
+    char                line_text [256];
+    char                name [256];
+    double              value;
+
+    cfile = fopen (path, "r");
+    if (cfile == NULL)
+        ThrowException (NO_SUCH_FILE);
 
+    for (line_num = 1; fgets (line_text, sizeof (line_text), cfile); line_num++)
+    {
+        if (line_text [0] == '#' || sscanf (line_text, "%255s", name) != 1)
+            continue;
+        if (sscanf (line_text, "%255s %lf", name, &value) != 2)
+        {
+            ret = new SyntaxError (line_num, 0, "Missing value");
+            break;
+        }
+        if (strcmp (name, "pitch") == 0) {
+            pitch_angle = value * M_PI / 180;
+        } else if (strcmp (name, "roll") == 0) {
+            roll_angle = value * M_PI / 180;
+        } else if (strcmp (name, "heading") == 0) {
+            heading = value;
+            yaw_angle = value * M_PI / 180;
+        } else if (strcmp (name, "airspeed") == 0) {
+            airspeed = value;
+        } else if (strcmp (name, "altitude") == 0) {
+            altitude = value;
+        } else if (strcmp (name, "lat") == 0) {
+            lat = value;
+        } else if (strcmp (name, "lng") == 0) {
+            lng = value;
+        } else if (strcmp (name, "power") == 0) {
+            engine_power = (unsigned) value;
+        } else if (strcmp (name, "flaps") == 0) {
+            flap_position = value * M_PI / 180;
+        } else if (strcmp (name, "oat") == 0) {
+            oat = (int) value;
+        } else if (strcmp (name, "altimeter") == 0) {
+            altimeter = value;
+        } else if (strcmp (name, "wa_heading") == 0) {
+            wa_heading = (unsigned) value;
+        } else if (strcmp (name, "wa_speed") == 0) {
+            wa_speed = (unsigned) value;
+        } else if (strcmp (name, "turbulence") == 0) {
+            turbulence = (unsigned) value;
+        } else if (strcmp (name, "seed") == 0) {
+            gust_seed = (unsigned) value;
+        } else {
+            ret = new SyntaxError (line_num, 0, "Unknown initial condition");
+            break;
+        }
+    }
+    fclose (cfile);
+    return (ret);
 }
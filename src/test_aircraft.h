@@ -19,6 +19,25 @@
 //
 //
 
+#ifndef TEST_AIRCRAFT_H
+#define TEST_AIRCRAFT_H
+
+#include <math.h>
+
+#include "syntax_error.h"
+
+// Flight model constants. The model is a point mass that flies where it is
+// pointed: enough to close an autopilot loop around, nothing more.
+#define ROLL_CONSTANT           2.0     // Roll rate (rad/s) per radian of aileron
+#define PITCH_CONSTANT          1.0     // Pitch rate (rad/s) per radian of elevator
+#define YAW_CONSTANT            0.5     // Yaw rate (rad/s) per radian of rudder
+#define RATE_RESPONSE           5.0     // How fast (1/s) the rates follow the controls
+#define MAX_ROLL                (60 * M_PI / 180)
+#define MAX_PITCH               (30 * M_PI / 180)
+#define CRUISE_SPEED            140     // Knots at 100% power in level flight
+#define SPEED_TIME_CONSTANT     10      // Seconds to settle on a new speed
+#define FLAP_DRAG               20      // Knots lost per radian of flap
+#define TURBULENCE_RATE         0.05    // Rate kick (rad/s) at turbulence 100
 
 class aircraft
 {
@@ -30,13 +49,14 @@ class aircraft
         double          droll_angle;            // 1st deriviative In radians/s
         double          yaw_angle;              // In radians
         double          dyaw_angle;             // 1st deriviative In radians/s
-        unsigned        airspeed;               // In knots CAS
-        unsigned        dairspeed;              // 1st deriviative In knots CAS/s
-        unsigned        altitude;               // In feet MSL
-        unsigned        daltitude;              // 1st deriviative In feet MSL/s
-        unsigned        heading;                // 1-360 compass heading
-        unsigned        dheading;               // 1st deriviative 1-360 degrees / s
+        double          airspeed;               // In knots CAS
+        double          dairspeed;              // 1st deriviative In knots CAS/s
+        double          altitude;               // In feet MSL
+        double          daltitude;              // 1st deriviative In feet MSL/s
+        double          heading;                // 0-360 compass heading
+        double          dheading;               // 1st deriviative degrees / s
         double          lat, lng;               // GPS coordinates
+        double          ground_speed;           // Knots, winds aloft included
 
     protected:
         // Aircraft configuration
@@ -54,14 +74,17 @@ class aircraft
         unsigned        wa_speed;               // Winds aloft speed
         unsigned        turbulence;             // Amount of turbulence on a scale of 1-100
         unsigned        density_altitude;       // Density altitude (computed and saved)
+        unsigned        gust_seed;              // Turbulence comes from this, so runs repeat
 
     public:
+        aircraft (void);
+
         // Inputs from test or autopilot
 
         /**
          * SetAilerons
          * DESCRIPTION:     Set new aileron input to the aircraft
-         * PRE-CONDITIONS:  
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Ailerons set
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
@@ -74,7 +97,7 @@ class aircraft
         /**
          * SetElevator
          * DESCRIPTION:     Set new elevator input to the aircraft
-         * PRE-CONDITIONS:  
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Elevator set
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
@@ -87,7 +110,7 @@ class aircraft
         /**
          * SetRudder
          * DESCRIPTION:     Set new rudder input to the aircraft
-         * PRE-CONDITIONS:  
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Rudder set
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
@@ -100,7 +123,7 @@ class aircraft
         /**
          * SetFlaps
          * DESCRIPTION:     Set new flaps input to the aircraft
-         * PRE-CONDITIONS:  
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Flaps set
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
@@ -113,7 +136,7 @@ class aircraft
         /**
          * SetPower
          * DESCRIPTION:     Set power level to the aircraft
-         * PRE-CONDITIONS:  
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Power set
          * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
@@ -126,10 +149,11 @@ class aircraft
         /**
          * IncrementTime
          * DESCRIPTION:     Simulates the aircraft and computes its state for the given time
-         *                  period.
+         *                  period. The same inputs and steps always give the
+         *                  same states.
          * PRE-CONDITIONS:  Environmental factors loaded.
          * POST-CONDITIONS: Aircraft state variables advanced
-         * EXCEPTIONS THROWN:  NO_ENVIRONMENT
+         * EXCEPTIONS THROWN:  None
          * EXCEPTIONS HANDLED: None
          */
         void IncrementTime
@@ -139,8 +163,9 @@ class aircraft
 
         /**
          * ReadInitialConditions
-         * DESCRIPTION:     Read aircraft and environment initial conditions
-         * PRE-CONDITIONS:  
+         * DESCRIPTION:     Read aircraft and environment initial conditions,
+         *                  one "name value" pair a line
+         * PRE-CONDITIONS:
          * POST-CONDITIONS: Class initialized and aircraft ready to simulate
          * EXCEPTIONS THROWN:  NO_SUCH_FILE
          * EXCEPTIONS HANDLED: None
@@ -150,6 +175,8 @@ class aircraft
                                 // pointer.
         ReadInitialConditions
         (
-         string         path
+         const char    *path
         );
-}
+};
+
+#endif /* TEST_AIRCRAFT_H */
@@ -0,0 +1,162 @@
+// test_checksum.cpp: Standalone test suite for the checksum policies
+//
+// Checks each policy against a packet in its wire format with a known
+// good checksum (the SL70 ^AH one was captured from a unit; the others
+// were built to the formats the drivers parse), then checks that every
+// single byte corruption of each packet is caught, that the accumulator
+// agrees with the one-shot sum, and that the vector byteSum agrees with a
+// plain loop for every length and alignment.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "checksum.h"
+
+typedef bool (*checkFn) (const unsigned char *frame, int start, int stop, int idx);
+typedef void (*putFn) (unsigned char *frame, int start, int stop, int idx);
+
+struct packetTest {
+    const char         *name;
+    const unsigned char *data;
+    int                 len;
+    checkFn             ok;
+    putFn               put;
+    int                 sentLen;
+    int                 start;
+    int                 stop;
+    int                 idx;
+};
+
+#define POLICY(p)       checksum<p>::Ok, checksum<p>::Put, p::SENT_LEN
+
+static const unsigned char xbowFrame [] =
+{
+    0xAA, 0x55, 0xA5, 0x4D, 0xCA, 0x18, 0x25, 0x30, 0xBB, 0x1D, 0x6D, 0x13, 0x2C,
+    0xDE, 0xD6, 0x23, 0x7B, 0x2E, 0xD9, 0x1E, 0x3F, 0x72, 0x1F, 0xCB, 0x08, 0xBF
+};
+static const unsigned char tsipGwss [] =
+{
+    0x10, 0x5E, 0x19, 0x71, 0x17, 0x44, 0x01, 0x53, 0x10, 0x03
+};
+static const unsigned char grtHighRate [] =
+{
+    0x7F, 0xFF, 0xFE, 0x94, 0xD6, 0x49, 0x3C, 0x9D, 0x5C, 0x34, 0x60, 0xBE,
+    0x31, 0x20, 0x1E, 0x69, 0xFE, 0xDA, 0xA0, 0xEE, 0xE8, 0xB9, 0xE8
+};
+static const unsigned char sl70AltHold [] = "^AH -+00000,03DE\r";
+static const unsigned char sl70Alt []     = "#AL +01234T+15DA\r";
+static const unsigned char sl40Status []  = "$PMRRC01FM12NT?9\r";
+static const unsigned char shadinZ []     = "\002ZA123\r\nZB456\r\nZR00156\r\n\003";
+
+static const packetTest packets [] =
+{
+    { "ahrs_xbow",          xbowFrame,   sizeof (xbowFrame),   POLICY (sum16_be),         2, 23, 24 },
+    { "gps_ff 0x5e",        tsipGwss,    sizeof (tsipGwss),    POLICY (sum16_be),         0, 5,  6  },
+    { "adahrs_grtaa301",    grtHighRate, sizeof (grtHighRate), POLICY (sum8_inverted),    2, 21, 22 },
+    { "xpdr_sl70r ^AH",     sl70AltHold, 17,                   POLICY (sum8_hex),         0, 13, 14 },
+    { "xpdr_sl70r #AL",     sl70Alt,     17,                   POLICY (sum8_hex),         0, 13, 14 },
+    { "comm_sl40",          sl40Status,  17,                   POLICY (sum8_nibbles),     6, 13, 14 },
+    { "shadinZ",            shadinZ,     25,                   POLICY (sum8_decimal<5>),  0, 14, 17 }
+};
+
+
+static unsigned plainSum (const unsigned char *buf, int len)
+{
+    unsigned    sum = 0;
+    for (int i = 0; i < len; i++)
+        sum += buf[i];
+    return (sum);
+}
+
+
+int main (void)
+{
+    unsigned            failures = 0;
+    unsigned char       frame [64];
+
+    printf ("\n\nKnown packets\n"
+                "-------------\n");
+    for (unsigned p = 0; p < NELEMENTS (packets); p++)
+    {
+        const packetTest *t = &packets [p];
+        bool good = t->ok (t->data, t->start, t->stop, t->idx);
+
+        // Writing the checksum must reproduce what was sent
+        memcpy (frame, t->data, t->len);
+        memset (&frame [t->idx], 0, t->sentLen);
+        t->put (frame, t->start, t->stop, t->idx);
+        bool put = (memcmp (frame, t->data, t->len) == 0);
+
+        // Any one byte changed in the summed bytes or the checksum itself
+        // must be caught
+        int missed = 0;
+        for (int i = t->start; i < t->idx + t->sentLen; i++)
+        {
+            if (i > t->stop && i < t->idx)
+                continue;
+            for (int delta = 1; delta < 256; delta++)
+            {
+                memcpy (frame, t->data, t->len);
+                frame [i] ^= delta;
+                // Lower case hex is the same checksum, not a corruption
+                if (t->ok == checksum<sum8_hex>::Ok && i >= t->idx &&
+                    hexDigit (frame [i]) >= 0 && hexDigit (frame [i]) == hexDigit (t->data [i]))
+                    continue;
+                if (t->ok (frame, t->start, t->stop, t->idx))
+                    missed++;
+            }
+        }
+        printf ("%-20s ok=%d put=%d missed corruptions=%d\n", t->name, good, put, missed);
+        if (!good || !put || missed != 0)
+            failures++;
+    }
+
+    printf ("\n\nAccumulator\n"
+                "-----------\n");
+    for (unsigned p = 0; p < NELEMENTS (packets); p++)
+    {
+        const packetTest *t = &packets [p];
+        checksum_accumulator<sum16_be> acc;
+        for (int i = t->start; i <= t->stop; i++)
+            acc.Add (t->data [i]);
+        unsigned oneShot = byteSum (&t->data [t->start], t->stop - t->start + 1);
+        printf ("%-20s byte at a time=%u one shot=%u\n", t->name, acc.Sum (), oneShot);
+        if (acc.Sum () != oneShot)
+            failures++;
+    }
+
+    printf ("\n\nbyteSum against a plain loop\n"
+                "----------------------------\n");
+    unsigned char       buf [600];
+    unsigned            mismatches = 0;
+    for (unsigned i = 0; i < sizeof (buf); i++)
+        buf [i] = rand () & 0xFF;
+    memset (buf, 0xFF, 64);         // Make sure the wide sums get to carry
+    for (int offset = 0; offset < 16; offset++)
+        for (int len = 0; len + offset <= (int)sizeof (buf); len++)
+            if (byteSum (&buf [offset], len) != plainSum (&buf [offset], len))
+                mismatches++;
+    printf ("%u mismatches\n", mismatches);
+    if (mismatches != 0)
+        failures++;
+
+    printf ("\n%s\n", (failures == 0) ? "PASSED" : "FAILED");
+    return ((failures == 0) ? 0 : 1);
+}
@@ -1,5 +1,12 @@
 // test_differentiate.cpp: Standalone test suite for the differentiate class
 //
+// Checks that Differentiate and Rate, which keep their sums up to date as
+// samples arrive, give exactly what the old walk back through the history
+// gave, then times the two. The old walk is kept here as scan_differentiate.
+// Then does the same for fixed_differentiate against differentiate.
+//
+//   test_differentiate [-v]      -v prints every pattern's values
+//
 //  This program is free software; you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
 //  the Free Software Foundation; either version 2 of the License, or
@@ -18,21 +25,239 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "differentiate.h"
+#include "fixed_differentiate.h"
+
+#define PATTERN_LEN     400
+#define BENCH_SAMPLES   2000000
+#define BENCH_LEN       4096        // Samples made ahead, so only the derivative is timed
 
 float   test_filt1 [] =
 {
     0.6, 0.3, 0.07, 0.03
 };
 
-float   test_filt2 [20];
+float   test_filt2 [20];            // Airspeed and altitude
+float   test_filt3 [8];             // Compass
+
+struct test_filt1_taps
+{
+    enum { NTAPS = 4, HALVING = 0 };
+    static float Tap (unsigned k) { return (test_filt1 [k]); }
+};
+
+// The derivative as it was computed before: a walk back through the taps'
+// entries, then through the quiet stretch if those showed nothing
+class scan_differentiate : public differentiate
+{
+    public:
+        scan_differentiate (const unsigned hist_size, const float *filt, const unsigned ntaps)
+            : differentiate (hist_size, filt, ntaps) {}
+
+        float ScanDifferentiate (void) const
+        {
+            double      value_sum, time_sum;
+            unsigned    count;
+
+            Scan (value_sum, time_sum, count);
+            if (count != 0)
+                value_sum /= count;
+            return ((float)value_sum);
+        }
+
+        float ScanRate (void) const
+        {
+            double      value_sum, time_sum;
+            unsigned    count;
+
+            Scan (value_sum, time_sum, count);
+            if (time_sum <= 0)
+                return (0);
+            return ((float)(value_sum * 1000000.0 / time_sum));
+        }
+
+    protected:
+        void Scan (double &value_sum, double &time_sum, unsigned &count_out) const
+        {
+            unsigned    index, count;
+            bool        nonzero;
+
+            count = 0;
+            index = t0_index;
+            value_sum = time_sum = 0;
+            count_out = 0;
+            nonzero = FALSE;
+            while (count < buf.NTaps ())
+            {
+                int     h = buf.history [index];
+                if (count >= elements_filled)
+                    break;
+                if ((h < -1) || (h > 1))
+                    nonzero = TRUE;
+                time_sum += (buf.Tap (count) * buf.intervals [index]);
+                value_sum += (buf.Tap (count++) * h);
+                if (index == 0)
+                    index = buf.Size () - 1;
+                else
+                    --index;
+            }
+            if ((nonzero == FALSE) && (elements_filled > buf.NTaps ()))
+            {
+                bool    positive, negative;
+                count = 0;
+                index = t0_index;
+                value_sum = time_sum = 0;
+                positive = negative = FALSE;
+                while (count < elements_filled)
+                {
+                    int     h = buf.history [index];
+                    if ((h < -1) || (h > 1))
+                        break;
+                    if (h == 1)
+                    {
+                        if (negative)
+                            break;
+                        positive = TRUE;
+                    }
+                    if (h == -1)
+                    {
+                        if (positive)
+                            break;
+                        negative = TRUE;
+                    }
+                    value_sum += h;
+                    time_sum += buf.intervals [index];
+                    if (index == 0)
+                        index = buf.Size () - 1;
+                    else
+                        --index;
+                    count++;
+                }
+                count_out = count;
+            }
+        }
+};
+
+struct filterCase {
+    const char     *name;
+    unsigned        history;
+    const float    *taps;
+    unsigned        ntaps;
+};
+
+static unsigned seed = 1;
+
+static int noise (int range)
+{
+    seed = seed * 1103515245 + 12345;
+    return ((int)((seed >> 16) % (2 * range + 1)) - range);
+}
+
+// Sample i of pattern p, and its time stamp
+static int pattern (int p, unsigned i, unsigned &stamp)
+{
+    stamp += 20000;
+    switch (p)
+    {
+        case 0:     return ((int)(1000 * sin (i * M_PI / 50)));
+        case 1:     return ((int)(i * i));
+        case 2:     return ((int)(i * .07));            // Micro slope
+        case 3:     return ((int)(i));                  // Small slope
+        case 4:                                         // 1000/s, jittery stamps
+            stamp += (i % 3 == 0) ? 60000 : (i % 7) * 5000;
+            return ((int)(stamp / 1000));
+        case 5:     return (noise (1));                 // Quiet, both ways
+        case 6:     return ((i / 150) % 2 ? 7 : (int)(i * .01)); // Quiet runs longer than the history
+        default:    return ((i % 37 < 30) ? (int)(i * .2) + noise (1) : noise (500));
+    }
+}
+
+static const char *patternNames [] = {
+    "sine wave", "parabola", "micro slope line", "small slope line",
+    "1000/s line, jittery stamps", "+/-1 noise", "long quiet runs", "quiet with bursts"
+};
+
+
+static double cpuSecs (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+
+static int      benchValues [BENCH_LEN];
+static unsigned benchStamps [BENCH_LEN];
+
+// Pattern p, BENCH_LEN samples of it, into benchValues and benchStamps
+static void makeBench (int p)
+{
+    unsigned    stamp = 0;
+    for (unsigned i = 0; i < BENCH_LEN; i++)
+    {
+        benchValues [i] = pattern (p, i, stamp);
+        benchStamps [i] = stamp;
+    }
+}
+
+// Runs every pattern through a fixed_differentiate and a differentiate with
+// the same taps, then times the two. Returns the number of mismatches.
+template <class Fixed>
+static unsigned compareFixed (const char *name, unsigned history, const float *taps, unsigned ntaps)
+{
+    Fixed              *f = new Fixed ();
+    differentiate      *d = new differentiate (history, taps, ntaps);
+    unsigned            stamp = 0, i, bad = 0;
+    volatile float      sink = 0;
+    double              start, fixedSecs, runtimeSecs;
+
+    for (int p = 0; p < (int)NELEMENTS(patternNames); p++)
+        for (i = 0; i < PATTERN_LEN; i++)
+        {
+            int v = pattern (p, i, stamp);
+            f->AddSample (v, stamp);
+            d->AddSample (v, stamp);
+            if (f->Differentiate () != d->Differentiate () || f->Rate () != d->Rate ())
+                if (bad++ < 10)
+                    printf ("MISMATCH %s, %s, sample %u: %f/%f, rate %f/%f\n",
+                            name, patternNames [p], i, f->Differentiate (), d->Differentiate (),
+                            f->Rate (), d->Rate ());
+        }
+
+    makeBench (0);
+    start = cpuSecs ();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+    {
+        f->AddSample (benchValues [i % BENCH_LEN], benchStamps [i % BENCH_LEN]);
+        sink = f->Rate ();
+    }
+    fixedSecs = cpuSecs () - start;
+    start = cpuSecs ();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+    {
+        d->AddSample (benchValues [i % BENCH_LEN], benchStamps [i % BENCH_LEN]);
+        sink = d->Rate ();
+    }
+    runtimeSecs = cpuSecs () - start;
+    (void) sink;
+
+    printf ("%-12s %5u mismatched %12.1f %12.1f\n", name, bad,
+            runtimeSecs * 1e9 / BENCH_SAMPLES, fixedSecs * 1e9 / BENCH_SAMPLES);
+    delete f;
+    delete d;
+    return (bad);
+}
+
 
 int main (int argc, char *argv[])
 {
     unsigned            i;
     float               tap;
-    differentiate      *test1, *test2;
+    bool                verbose = (argc > 1 && strcmp (argv [1], "-v") == 0);
+    unsigned            mismatches = 0;
 
     tap = .5;
     for (i = 0; i < NELEMENTS(test_filt2)-1; i++)
@@ -40,45 +265,96 @@ int main (int argc, char *argv[])
         test_filt2 [i] = tap;
         tap /= 2;
     }
-    test_filt2 [NELEMENTS(test_filt2)-1] = test_filt2 [NELEMENTS(test_filt2)-2]; 
-
-    test1 = new differentiate (NELEMENTS(test_filt1), test_filt1, NELEMENTS(test_filt1));
-    test2 = new differentiate (100, test_filt2, NELEMENTS(test_filt2));
-
-    printf ("\n\ntestpat1: sine wave\n"
-                "------------------\n");
-    for (i = 0; i < 100; i++)
-    {
-        test1->AddSample ((int)(1000 * sin (i * M_PI / 50)));
-        test2->AddSample ((int)(1000 * sin (i * M_PI / 50)));
-        printf ("t1 = %10f, t2 = %10f\n", test1->Differentiate(), test2->Differentiate());
-    }
-    printf ("\n\ntestpat2: Parabola\n"
-                "------------------\n");
-    for (i = 0; i < 100; i++)
-    {
-        test1->AddSample ((int)(i * i));
-        test2->AddSample ((int)(i * i));
-        printf ("t1 = %10f, t2 = %10f\n", test1->Differentiate(), test2->Differentiate());
-    }
-    printf ("\n\ntestpat3: micro slope line\n"
-                "------------------\n");
-    for (i = 0; i < 100; i++)
+    test_filt2 [NELEMENTS(test_filt2)-1] = test_filt2 [NELEMENTS(test_filt2)-2];
+    tap = .5;
+    for (i = 0; i < NELEMENTS(test_filt3)-1; i++)
     {
-        test1->AddSample ((int)(i * .07));
-        test2->AddSample ((int)(i * .07));
-        printf ("t1 = %10f, t2 = %10f\n", test1->Differentiate(), test2->Differentiate());
+        test_filt3 [i] = tap;
+        tap /= 2;
     }
-    printf ("\n\ntestpat4: small slope line\n"
-                "------------------\n");
-    for (i = 0; i < 100; i++)
+    test_filt3 [NELEMENTS(test_filt3)-1] = test_filt3 [NELEMENTS(test_filt3)-2];
+
+    filterCase  cases [] = {
+        { "4 taps/4",   NELEMENTS(test_filt1), test_filt1, NELEMENTS(test_filt1) },
+        { "20 taps/100", 100, test_filt2, NELEMENTS(test_filt2) },
+        { "8 taps/100", 100, test_filt3, NELEMENTS(test_filt3) },
+        { "8 taps/8",   NELEMENTS(test_filt3), test_filt3, NELEMENTS(test_filt3) }
+    };
+
+    // Each filter sees every pattern one after the other, as the
+    // instruments do, so the history carries over from one to the next
+    for (unsigned c = 0; c < NELEMENTS(cases); c++)
     {
-        test1->AddSample ((int)(i));
-        test2->AddSample ((int)(i));
-        printf ("t1 = %10f, t2 = %10f\n", test1->Differentiate(), test2->Differentiate());
+        scan_differentiate  *d = new scan_differentiate (cases [c].history, cases [c].taps, cases [c].ntaps);
+        unsigned            stamp = 0;
+        unsigned            bad = 0;
+
+        for (int p = 0; p < (int)NELEMENTS(patternNames); p++)
+        {
+            if (verbose)
+                printf ("\n%s, %s\n------------------\n", cases [c].name, patternNames [p]);
+            for (i = 0; i < PATTERN_LEN; i++)
+            {
+                d->AddSample (pattern (p, i, stamp), stamp);
+                float diff = d->Differentiate (), rate = d->Rate ();
+                float scanDiff = d->ScanDifferentiate (), scanRate = d->ScanRate ();
+                if (diff != scanDiff || rate != scanRate)
+                {
+                    if (bad++ < 10)
+                        printf ("MISMATCH %s, %s, sample %u: %f/%f, rate %f/%f\n",
+                                cases [c].name, patternNames [p], i, diff, scanDiff, rate, scanRate);
+                }
+                else if (verbose)
+                    printf ("d = %10f, rate = %10f\n", diff, rate);
+            }
+        }
+        printf ("%-12s %u samples, %u mismatched\n", cases [c].name,
+                PATTERN_LEN * (unsigned)NELEMENTS(patternNames), bad);
+        mismatches += bad;
+        delete d;
     }
 
-    delete test1;
-    delete test2;
-    return 0;
+    // A sample and a derivative, as each instrument's Update does
+    printf ("\n%-12s %-20s %12s %12s\n", "filter", "signal", "scan ns", "now ns");
+    for (unsigned c = 1; c < 3; c++)
+        for (int p = 6; p < 8; p++)
+        {
+            scan_differentiate  *d = new scan_differentiate (cases [c].history, cases [c].taps, cases [c].ntaps);
+            unsigned            stamp = 0;
+            volatile float      sink = 0;
+            double              start, scanSecs, nowSecs;
+
+            makeBench (p);
+            start = cpuSecs ();
+            for (i = 0; i < BENCH_SAMPLES; i++)
+            {
+                d->AddSample (benchValues [i % BENCH_LEN], stamp += 20000);
+                sink = d->ScanRate ();
+            }
+            scanSecs = cpuSecs () - start;
+            start = cpuSecs ();
+            for (i = 0; i < BENCH_SAMPLES; i++)
+            {
+                d->AddSample (benchValues [i % BENCH_LEN], stamp += 20000);
+                sink = d->Rate ();
+            }
+            nowSecs = cpuSecs () - start;
+            (void) sink;
+            printf ("%-12s %-20s %12.1f %12.1f\n", cases [c].name, patternNames [p],
+                    scanSecs * 1e9 / BENCH_SAMPLES, nowSecs * 1e9 / BENCH_SAMPLES);
+            delete d;
+        }
+
+    // The fixed sizes, on a signal that always goes through the taps
+    printf ("\n%-12s %16s %12s %12s\n", "fixed", "", "runtime ns", "fixed ns");
+    mismatches += compareFixed<fixed_differentiate<4, test_filt1_taps> >
+                      ("4 taps/4", NELEMENTS(test_filt1), test_filt1, NELEMENTS(test_filt1));
+    mismatches += compareFixed<fixed_differentiate<100, halving_taps<20> > >
+                      ("20 taps/100", 100, test_filt2, NELEMENTS(test_filt2));
+    mismatches += compareFixed<fixed_differentiate<100, halving_taps<8> > >
+                      ("8 taps/100", 100, test_filt3, NELEMENTS(test_filt3));
+    mismatches += compareFixed<fixed_differentiate<8, halving_taps<8> > >
+                      ("8 taps/8", NELEMENTS(test_filt3), test_filt3, NELEMENTS(test_filt3));
+
+    return (mismatches == 0 ? 0 : 1);
 }
@@ -1,6 +1,7 @@
 // test_main_loop.cpp: Test the avionics package using an interface to X-Plane
-// Must be running the xplane_interface program in the background on the same machine
-// as this program.
+// X-Plane's DATA packets are received in this process. With -relay they come
+// through the xplane_interface program instead, which must then be running in
+// the background on the same machine as this program.
 //
 //  This program is free software; you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
@@ -35,6 +36,7 @@
 #include "utilities.h"
 #include "constants.h"
 #include "exceptions.h"
+#include "reactor.h"
 
 #include "ahrs_xplane.h"
 #include "ahrs_cooked.h"
@@ -44,6 +46,7 @@
 #include "compass_xplane.h"
 #include "autopilot_xplane.h"
 #include "nav_xplane.h"
+#include "xplane_ingest.h"
 
 // Main loop interval the period in uS: 30 ms
 #define  MAIN_LOOP_INTERVAL     30000
@@ -62,26 +65,36 @@ int main (int argc, char *argv[])
 {
     unsigned            i;
 
-    if (argc != 1)
-    {
-        fprintf (stderr, "Usage: test_avionics\n");
-        return (-1);
-    }
-#if 0
-    if (inet_aton (argv [1], &xplane_ip) == 0)
+    bool                relay = FALSE;
+    const char         *xplane_host = NULL;
+
+    for (int a = 1; a < argc; a++)
     {
-        struct hostent  *host = gethostbyname (argv [1]);
-        // Number a numbers and dots address. Must be a name
-        if (host == NULL)
+        if (strcmp (argv [a], "-relay") == 0)
+            relay = TRUE;
+        else if (xplane_host == NULL && argv [a][0] != '-')
+            xplane_host = argv [a];
+        else
         {
-            perror ("Invalid host");
+            fprintf (stderr, "Usage: test_avionics [-relay] [xplane_host_address]\n");
             return (-1);
         }
-        memcpy (&xplane_ip, host->h_addr_list[0], sizeof (xplane_ip));
     }
-#endif
+    if (relay && xplane_host != NULL)
+    {
+        fprintf (stderr, "test_avionics: the host is given to xplane_interface with -relay\n");
+        return (-1);
+    }
 
     try {
+        // Sockets receive on the reactor thread from the moment they're made
+        TheReactor                  = new io_reactor ();
+        TheReactor->Start ();
+
+        // Without this the instruments open the relay's loopback ports
+        if (!relay)
+            TheXPlane               = new xplane_ingest (xplane_host);
+
         // Instantiate and bind all avionics classes
         TheAHRS                     = new ahrs_cooked ();
         ahrs_xplane        *ax      = new ahrs_xplane ();
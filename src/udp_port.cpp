@@ -0,0 +1,179 @@
+// udp_port.cpp: Member functions of the UDP receive socket
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "exceptions.h"
+#include "constants.h"
+#include "utilities.h"
+#include "udp_port.h"
+
+udp_port::udp_port (int localPort, const char *owner)
+{
+    struct sockaddr_in  lcl;
+    char                statsName [PORT_STATS_NAME_LEN];
+
+    rxQueue = NULL;
+    snprintf (statsName, sizeof (statsName), "%s udp:%d", owner, localPort);
+    stats = portStatsClaim (statsName);
+
+    fd = socket (PF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        perror (owner);
+        ThrowException (errno);
+    }
+    memset (&lcl, 0, sizeof (lcl));
+    lcl.sin_family = AF_INET;
+    lcl.sin_port = htons (localPort);
+    lcl.sin_addr.s_addr = htonl (INADDR_ANY);
+
+    if (bind (fd, (struct sockaddr*) &lcl, sizeof (lcl)) == -1)
+        perror (owner);
+    fcntl (fd, F_SETFL, O_NONBLOCK);
+
+    // Have the kernel stamp each datagram as it arrives, so a late Receive
+    // doesn't look like a late sample.
+    int on = 1;
+    if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof (on)) == -1)
+        perror (owner);
+
+    if (TheReactor != NULL)
+        TheReactor->Add (this);
+}
+
+
+udp_port::~udp_port ()
+{
+    if (Reactor () != NULL)
+        Reactor ()->Remove (this);
+    close (fd);
+    delete rxQueue;
+    portStatsRelease (stats);
+}
+
+
+int udp_port::Receive (char *buf, int len, unsigned *stamp)
+{
+    unsigned    arrival;
+
+    // Dropped by the reactor: once its datagrams are used up, receive here
+    if ((rxQueue != NULL) && (rxQueue->ReadSlot () == NULL) && (Reactor () == NULL))
+    {
+        delete rxQueue;
+        rxQueue = NULL;
+    }
+    if (rxQueue == NULL)
+    {
+        int size = ReceiveStamped (buf, len, arrival);
+        if (size != -1)
+        {
+            statInc (stats->framesDelivered);
+            if (stamp != NULL)
+                *stamp = arrival;
+        }
+        return (size);
+    }
+
+    queuedDatagram *dgram = rxQueue->ReadSlot ();
+    if (dgram == NULL)
+        return (-1);
+    int size = (dgram->len < len) ? dgram->len : len;
+    memcpy (buf, dgram->data, size);
+    if (stamp != NULL)
+        *stamp = dgram->stamp;
+    rxQueue->Pop ();
+    statInc (stats->framesDelivered);
+    return (size);
+}
+
+
+// recv() plus the SO_TIMESTAMPNS control message, converted to the
+// monotonic clock. Falls back to "now" if the kernel didn't stamp it.
+int udp_port::ReceiveStamped (char *buf, int len, unsigned &stamp)
+{
+    struct msghdr       msg;
+    struct iovec        iov;
+    char                control [CMSG_SPACE (sizeof (struct timespec))];
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+
+    int size = recvmsg (fd, &msg, 0);
+    if (size == -1)
+        return (-1);
+
+    stamp = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR (&msg); cm != NULL; cm = CMSG_NXTHDR (&msg, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            struct timespec ts;
+            memcpy (&ts, CMSG_DATA (cm), sizeof (ts));
+            stamp = realtime_to_monotonic_us (ts);
+        }
+    }
+    if (stamp == 0)
+        stamp = monotonic_us ();
+    statAdd (stats->bytesRead, size);
+    statFrame (stats, stamp);
+    return (size);
+}
+
+
+void udp_port::ReactorAttached (void)
+{
+    if (rxQueue == NULL)
+        rxQueue = new spsc_queue<queuedDatagram, DATAGRAM_QUEUE_LEN>;
+}
+
+
+// Runs on the reactor thread: receive everything waiting straight into the
+// queue slots.
+void udp_port::ReactorReadable (void)
+{
+    while (1)
+    {
+        queuedDatagram *slot = rxQueue->WriteSlot ();
+        if (slot == NULL)
+        {
+            // Reader is behind; drop what is waiting at the socket
+            // rather than spin on a readable fd.
+            char discard [MAX_DATAGRAM_LEN];
+            if (recv (fd, discard, sizeof (discard), 0) == -1)
+                return;
+            statInc (stats->queueDrops);
+            continue;
+        }
+        slot->len = ReceiveStamped (slot->data, sizeof (slot->data), slot->stamp);
+        if (slot->len == -1)
+            return;
+        rxQueue->Push ();
+    }
+}
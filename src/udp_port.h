@@ -0,0 +1,77 @@
+// udp_port.h: Class definition for a bound, non-blocking UDP receive socket
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef UDP_PORT_H
+#define UDP_PORT_H
+
+#include "reactor.h"
+#include "spsc_queue.h"
+#include "port_stats.h"
+
+#define MAX_DATAGRAM_LEN        1500
+#define DATAGRAM_QUEUE_LEN      64      // Power of two
+
+struct queuedDatagram {
+    int         len;
+    unsigned    stamp;          // Arrival time, monotonic_us()
+    char        data [MAX_DATAGRAM_LEN];
+};
+
+// udp_port class: A datagram socket bound to a local port. If TheReactor
+// exists when the port is made, the reactor thread receives the datagrams
+// and Receive pops them from a queue; otherwise Receive reads the socket.
+class udp_port : public reactor_client
+{
+    public:
+        int             fd;
+        portStats      *stats;          // This socket's counters (see port_stats.h)
+
+        /**
+         * udp_port class constructor
+         * DESCRIPTION:     Opens a non-blocking UDP socket bound to localPort
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: Socket ready to receive
+         * EXCEPTIONS THROWN:  errno if the socket can't be made or bound
+         * EXCEPTIONS HANDLED: None
+         */
+        udp_port (int localPort, const char *owner);
+        ~udp_port ();
+
+        /**
+         * Receive
+         * DESCRIPTION:     Next datagram, copied into buf
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: If stamp is given it gets the kernel's arrival
+         *                  time for the datagram, as monotonic_us()
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        int     // Bytes received, or -1 if nothing is waiting
+            Receive (char *buf, int len, unsigned *stamp = NULL);
+
+        // reactor_client interface
+        int     ReactorFd (void) const { return (fd); }
+        void    ReactorAttached (void);
+        void    ReactorReadable (void);
+
+    protected:
+        int     ReceiveStamped (char *buf, int len, unsigned &stamp);
+
+        spsc_queue<queuedDatagram, DATAGRAM_QUEUE_LEN> *rxQueue;
+};
+
+#endif /* UDP_PORT_H */
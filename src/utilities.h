@@ -1,5 +1,9 @@
 
+#ifndef UTILITIES_H
+#define UTILITIES_H
+
 #include <sys/time.h>
+#include <time.h>
 
 /**
  * time_in_us
@@ -16,3 +20,43 @@ inline unsigned time_in_us (void)
     gettimeofday (&tv, NULL);
     return (tv.tv_sec * 1000000 + tv.tv_usec);
 }
+
+/**
+ * monotonic_us
+ * DESCRIPTION:     Microseconds on the monotonic clock. Unlike time_in_us
+ *                  this never jumps when the wall clock is set, so the
+ *                  difference of two readings is a true interval (modulo
+ *                  2^32 us, about 71 minutes).
+ * PRE-CONDITIONS:  
+ * POST-CONDITIONS:
+ * EXCEPTIONS THROWN:  
+ * EXCEPTIONS HANDLED: 
+ */
+inline unsigned monotonic_us (void)
+{
+    struct timespec     ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/**
+ * realtime_to_monotonic_us
+ * DESCRIPTION:     Convert a wall clock time stamp (e.g. a socket's
+ *                  SO_TIMESTAMPNS) into the monotonic_us time base.
+ * PRE-CONDITIONS:  ts is recent
+ * POST-CONDITIONS:
+ * EXCEPTIONS THROWN:  
+ * EXCEPTIONS HANDLED: 
+ */
+inline unsigned realtime_to_monotonic_us (const struct timespec &ts)
+{
+    struct timespec     now;
+    clock_gettime (CLOCK_REALTIME, &now);
+    long long age_ns = (now.tv_sec - ts.tv_sec) * 1000000000LL +
+                       (now.tv_nsec - ts.tv_nsec);
+    if (age_ns < 0)
+        age_ns = 0;
+    return (monotonic_us () - (unsigned)(age_ns / 1000));
+}
+
+#endif /* UTILITIES_H */
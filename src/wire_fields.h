@@ -0,0 +1,97 @@
+// wire_fields.h: Declarative field layouts for binary device packets
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef WIRE_FIELDS_H
+#define WIRE_FIELDS_H
+
+#include <stdint.h>
+#include <string.h>
+
+// A driver describes each field of a packet once, next to the others:
+//
+//   WIRE_FIELD (xbowRoll, 2, int16_t, WIRE_BE, M_PI/32768);
+//
+// and reads it straight out of the frame with xbowRoll::Get (frame) (scaled)
+// or xbowRoll::Raw (frame) (as sent). Every read is one unaligned load from
+// the frame plus a byte swap if the wire order isn't the host's; the fixed
+// size memcpy's below compile down to plain moves.
+
+#define WIRE_BE         0
+#define WIRE_LE         1
+#if defined (__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WIRE_HOST       WIRE_BE
+#else
+#define WIRE_HOST       WIRE_LE
+#endif
+
+// Unsigned integer of "Size" bytes and how to reverse its bytes
+template <int Size> struct wire_word;
+template <> struct wire_word<1>
+{
+    typedef uint8_t type;
+    static type Swap (type v) { return (v); }
+};
+template <> struct wire_word<2>
+{
+    typedef uint16_t type;
+    static type Swap (type v) { return (__builtin_bswap16 (v)); }
+};
+template <> struct wire_word<4>
+{
+    typedef uint32_t type;
+    static type Swap (type v) { return (__builtin_bswap32 (v)); }
+};
+template <> struct wire_word<8>
+{
+    typedef uint64_t type;
+    static type Swap (type v) { return (__builtin_bswap64 (v)); }
+};
+
+/**
+ * wireGet
+ * DESCRIPTION:     Reads a T sent in "Endian" byte order at "p"
+ * PRE-CONDITIONS:  sizeof (T) bytes readable at p (no alignment needed)
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+template <class T, int Endian>
+static inline T wireGet (const unsigned char *p)
+{
+    typedef wire_word<sizeof (T)> word;
+    typename word::type raw;
+    memcpy (&raw, p, sizeof (raw));
+    if (Endian != WIRE_HOST)
+        raw = word::Swap (raw);
+    T value;
+    memcpy (&value, &raw, sizeof (value));
+    return (value);
+}
+
+// One field: name, byte offset in the frame, type as sent, byte order and
+// the scale that turns it into engineering units.
+#define WIRE_FIELD(name, offset, type, endian, scale)                       \
+    struct name                                                             \
+    {                                                                       \
+        enum { OFFSET = (offset), SIZE = sizeof (type) };                   \
+        static type Raw (const unsigned char *frame)                        \
+            { return (wireGet<type, endian> (&frame[offset])); }            \
+        static double Get (const unsigned char *frame)                      \
+            { return (Raw (frame) * (scale)); }                             \
+    }
+
+#endif /* WIRE_FIELDS_H */
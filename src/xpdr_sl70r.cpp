@@ -27,6 +27,7 @@
 #include "exceptions.h"
 #include "constants.h"
 #include "xpdr_sl70r.h"
+#include "checksum.h"
 
 #define ALT_MSG_LEN 17
 #define STATUS_MSG_LEN 11
@@ -35,12 +36,37 @@
 #define CONF_MSG_LEN 16
 #define ALTHOLD_MSG_LEN 17
 
+// Message types, used to tag frames coming back from the serial layer
+enum {
+    ALT_MSG,
+    STATUS_MSG,
+    MODE_MSG,
+    REPLYCNT_MSG,
+    CONF_MSG,
+    ALTHOLD_MSG
+};
+
+// Everything the unit sends us. Checksums are an 8 bit sum in ASCII hex.
+static const frameDialect xpdrDialects[] = {
+  // type         hdr    hdrLen  frameLen          lenIdx/Bias  checksum            start stop idx
+  { ALT_MSG,      "#AL", 3,      ALT_MSG_LEN,      0, 0,        CHECKSUM_SUM8_HEX,  0,    13,  14 },
+  { STATUS_MSG,   "^SS", 3,      STATUS_MSG_LEN,   0, 0,        CHECKSUM_SUM8_HEX,  0,    8,   9  },
+  { MODE_MSG,     "^MD", 3,      MODE_MSG_LEN,     0, 0,        CHECKSUM_SUM8_HEX,  0,    13,  14 },
+  { REPLYCNT_MSG, "^RC", 3,      REPLYCNT_MSG_LEN, 0, 0,        CHECKSUM_SUM8_HEX,  0,    7,   8  },
+  { CONF_MSG,     "^C1", 3,      CONF_MSG_LEN,     0, 0,        CHECKSUM_SUM8_HEX,  0,    8,   9  },
+  { ALTHOLD_MSG,  "^AH", 3,      ALTHOLD_MSG_LEN,  0, 0,        CHECKSUM_SUM8_HEX,  0,    13,  14 }
+};
+
 using namespace std;
 
 xpdr_sl70r::xpdr_sl70r(const char *port)
 {
     serialPtr = new serial(port, TRUE);
+    for (unsigned i=0; i<NELEMENTS(xpdrDialects); i++) {
+      serialPtr->addFrameDialect(xpdrDialects[i]);
+    }
     initialize();
+    if (TheReactor != NULL) TheReactor->Add(serialPtr);
 }
 
 
@@ -53,191 +79,220 @@ void xpdr_sl70r::initialize() {
     identCharSend = '-'; // "-"=inactive; "I"=enabled
     squawkCodeSend = 1200;
     status2Bytes = 0xFFFF; // Assume good status until otherwise recvd
+    statusFaults = 0;
     serialPtr->setHwFlowControl(0);
     serialPtr->setBaud(B9600);
     setModeStandby();
 }
 
+
+int xpdr_sl70r::Recognize(const unsigned char *buf, int len, int &covered)
+{
+  return serial::scanDialects(xpdrDialects, NELEMENTS(xpdrDialects), buf, len, covered);
+}
+
+// Value of the "Width" decimal digits at "p", after an optional '+' or '-'.
+// FALSE (and "value" untouched) if any of them isn't a digit.
+template <int Width>
+static inline bool fixedDec(const unsigned char *p, int &value)
+{
+  int i = 0;
+  int sign = 1;
+  if (p[0] == '+' || p[0] == '-') {
+    sign = (p[0] == '-') ? -1 : 1;
+    i = 1;
+  }
+  int v = 0;
+  for (; i < Width; i++) {
+    unsigned digit = p[i] - '0';
+    if (digit > 9) return FALSE;
+    v = v * 10 + digit;
+  }
+  value = sign * v;
+  return TRUE;
+}
+
+// Same for "Width" hex digits
+template <int Width>
+static inline bool fixedHex(const unsigned char *p, unsigned &value)
+{
+  unsigned v = 0;
+  for (int i = 0; i < Width; i++) {
+    int digit = hexDigit(p[i]);
+    if (digit < 0) return FALSE;
+    v = (v << 4) | digit;
+  }
+  value = v;
+  return TRUE;
+}
+
+// What each bit of the ^SS status word reports. The unit sets a bit while
+// that check passes, so a clear bit is a fault.
+static const char *statusFaultNames[XPDR_STATUS_BITS] = {
+  "3.3 volt power supply",
+  "5 volt power supply",
+  "8 volt power supply",
+  "12 volt power supply",
+  "45 volt power supply",
+  "high voltage power supply",
+  "input voltage",
+  "discrete input reference voltage",
+  "display temperature",
+  "transmitter temperature",
+  "photo cell",
+  "synthesizer locked",
+  "receiver test",
+  "transmitter test",
+  "suppression stuck",
+  NULL                          // Unused
+};
+
+static char *putChars(char *out, const void *from, int n)
+{
+  memcpy(out, from, n);
+  return out + n;
+}
+
+
 // Returns TRUE if new data was available
 // or FALSE if the data remains unchanged as a result
 // of calling this function.
 bool xpdr_sl70r::Sample() {
-  // Look for all msg types
-  int msgLen[] = {ALT_MSG_LEN, STATUS_MSG_LEN, MODE_MSG_LEN, REPLYCNT_MSG_LEN,CONF_MSG_LEN,ALTHOLD_MSG_LEN};
-
-  int idx[6];
-  while(1) {
-    idx[0] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"#AL", 3, ALT_MSG_LEN);
-    idx[1] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"^SS", 3, STATUS_MSG_LEN);
-    idx[2] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"^MD", 3, MODE_MSG_LEN);
-    idx[3] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"^RC", 3, REPLYCNT_MSG_LEN);
-    idx[4] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"^C1", 3, CONF_MSG_LEN);
-    idx[5] = serialPtr->peekBufForStartCharsPlusFrameLength((unsigned char *)"^AH", 3, ALTHOLD_MSG_LEN);
-    
-    int tmpIdx = 1000000;
-    int frameLen = -1;
-    for (int i=0; i < 6; i++) {
-      if (idx[i] == -1) continue;
-      if (idx[i] < tmpIdx) {
-	tmpIdx = idx[i];
-	frameLen= msgLen[i];
-      }
-    }
-    
-    unsigned char msg[32]; // 32 chars will take care of longest message.
-    memset(msg, '\0', 32); // terminate str
-    if (tmpIdx == 1000000) return FALSE; // No more messages found
-    serialPtr->getFrameFromBufAndShift(msg, tmpIdx, frameLen);
-    parseMessage((char *)msg);
+  bool newData = FALSE;
+  frameView view;
+  while (serialPtr->getFrameView(view)) {
+    unsigned char scratch[32]; // 32 chars will take care of longest message.
+    parseMessage(view.type, view.linear(scratch), view.len);
+    newData = TRUE;
   }
-
-  return TRUE;
+  return newData;
 }
 
 
-void xpdr_sl70r::parseMessage(char *msg) {
-  if (strstr(msg, "#AL") != NULL) {
-    if (DEBUG) printf("RECEIVED ALT MSG: %17s\n", msg);
-    if (!checksumOk(msg, 0, 13, 14)) return;
+// Frames arrive already matched on their 3 char header, sized and
+// checksummed by the serial layer, so every field is at a known offset.
+void xpdr_sl70r::parseMessage(int msgType, const unsigned char *msg, int len) {
+  switch (msgType) {
+  case ALT_MSG:
     handleAltMsg(msg);
-  }
-  else if (strstr(msg, "^SS") != NULL) {
-    if (DEBUG) printf("RECEIVED STATUS MSG: %11s\n", msg);
-    if (!checksumOk(msg, 0, 8, 9)) return;
+    break;
+  case STATUS_MSG:
     handleStatusMsg(msg);
-  }
-  else if (strstr(msg, "^MD") != NULL) {
-  if (DEBUG) printf("RECEIVED MODE MSG: %17s\n", msg);
-    if (!checksumOk(msg, 0, 13, 14)) return;
+    break;
+  case MODE_MSG:
     handleModeMsg(msg);
-  }
-  else if (strstr(msg, "^RC") != NULL) {
-    if (DEBUG) printf("RECEIVED REPLY CNT MSG: %11s\n", msg);
-    if (!checksumOk(msg, 0, 7, 8)) return;
+    break;
+  case REPLYCNT_MSG:
     handleReplyCountMsg(msg);
-  }
-  else if (strstr(msg, "^C1") != NULL) {
-    if (DEBUG) printf("RECEIVED SW VER MSG: %16s\n", msg);
-    if (!checksumOk(msg, 0, 8, 9)) return;
+    break;
+  case CONF_MSG:
     handleSoftwareVersionMsg(msg);
-  }
-  else if (strstr(msg, "^AH") != NULL) {
-    if (DEBUG) printf("RECEIVED ALT HOLD MSG: %16s\n", msg);
-    if (!checksumOk(msg, 0, 13, 14)) return;
+    break;
+  case ALTHOLD_MSG:
     handleAltHoldMsg(msg);
+    break;
   }
+  if (DEBUG) printMessage(msgType, msg, len);
 }
 
-void xpdr_sl70r::handleAltMsg(char *msg) {
-  sscanf(&msg[4], "%d", &squawkAltFlLvl);
+// "#AL +nnnnn..."
+void xpdr_sl70r::handleAltMsg(const unsigned char *msg) {
+  if (!fixedDec<6>(&msg[4], squawkAltFlLvl)) return;
   // Check for error conditions
   if (squawkAltFlLvl == -9981) {
-    if (DEBUG) printf("ERROR: POSSIBLE HARDWARE PROB\n");
     errorHardwareBad = TRUE;
   }
   else if (squawkAltFlLvl == -9982) {
-    if (DEBUG) printf("ERROR: SQUAWK_ALT_FL OUT OF RANGE\n");
     errorAltOutOfRange = TRUE;
   }
   else { // All good...
-    if (DEBUG) printf("SQUAWK_ALT_FL=: %d\n", squawkAltFlLvl);
     errorAltOutOfRange = FALSE;
     errorHardwareBad = FALSE;
   }
 }
 
 
-void xpdr_sl70r::handleStatusMsg(char *msg) {
-  sscanf(&msg[4], "%4x", &status2Bytes);
-  if (DEBUG) printf("RECEIVED STATUS BYTES: %X\n", status2Bytes);
-  // TODO: add status flags for each but condition
-  if ((status2Bytes & 0x0001) == 0) {
-    // 3.3 volt power supply prob
-  }
-  if ((status2Bytes & 0x0002) == 0) {
-    // 5 volt power supply prob
-  }
-  if ((status2Bytes & 0x0004) == 0) {
-    // 8 volt power supply prob
-  }
-  if ((status2Bytes & 0x0008) == 0) {
-    // 12 volt power supply prob
-  }
-  if ((status2Bytes & 0x0010) == 0) {
-    // 45 volt power supply prob
-  }
-  if ((status2Bytes & 0x0020) == 0) {
-    // high voltage power supply prob
-  }
-  if ((status2Bytes & 0x0040) == 0) {
-    // input voltage prob
-  }
-  if ((status2Bytes & 0x0080) == 0) {
-    // discrete input reference V prob
-  }
-  if ((status2Bytes & 0x0100) == 0) {
-    // display temperature prob
-  }
-  if ((status2Bytes & 0x0200) == 0) {
-    // transmitter temperature prob
-  }
-  if ((status2Bytes & 0x0300) == 0) {
-    // photo cell prob
-  }
-  if ((status2Bytes & 0x0400) == 0) {
-    // synthesizer locked prob
-  }
-  if ((status2Bytes & 0x0800) == 0) {
-    // receiver test prob
-  }
-  if ((status2Bytes & 0x1000) == 0) {
-    // transmitter test prob
-  }
-  if ((status2Bytes & 0x2000) == 0) {
-    // supression stuck prob
-  }
+// "^SS hhhh"
+void xpdr_sl70r::handleStatusMsg(const unsigned char *msg) {
+  unsigned bits;
+  if (!fixedHex<4>(&msg[4], bits)) return;
+  status2Bytes = bits;
+  statusFaults = ~bits & XPDR_STATUS_KNOWN;
 }
 
 
-void xpdr_sl70r::handleModeMsg(char *msg) {
-  // Set member variables
-  sscanf(&msg[4], "%c,%c,%4i", &modeCharReceive, &identCharReceive, &squawkCodeReceive);
-  if (DEBUG) printf("MODE_CHAR=%c  IDENT_CHAR=%c  SQUAWK_RECV=%04d\n", modeCharReceive, identCharReceive, squawkCodeReceive);
+const char *xpdr_sl70r::statusFaultName(int bit) {
+  if (bit < 0 || bit >= XPDR_STATUS_BITS) return NULL;
+  return statusFaultNames[bit];
 }
 
 
-void xpdr_sl70r::handleReplyCountMsg(char *msg) {
-  // Set replyCnt member variable
-  sscanf(&msg[4], "%4i", &replyCount);
-  if (DEBUG) printf("REPLY_CNT=%d\n", replyCount);
+// "^MD m,i,nnnn"
+void xpdr_sl70r::handleModeMsg(const unsigned char *msg) {
+  modeCharReceive = msg[4];
+  identCharReceive = msg[6];
+  fixedDec<4>(&msg[8], squawkCodeReceive);
 }
 
-void xpdr_sl70r::handleSoftwareVersionMsg(char *msg) {
-  //sprintf(softwareVersion, "Micro SW version %3c, FPGA SW version %2c MODE %c Transponder", 
-  //	  &msg[4],&msg[8],&msg[10]);
-  sprintf(softwareVersion, "Micro SW ver %3.3s FPGA SW ver %2.2s Mode %1.1s Transponder",
-	  &msg[4], &msg[8], &msg[10]);
-  if (DEBUG) printf("RECEIVED SW VER MSG: %s\n", softwareVersion);
+
+// "^RC nnnn"
+void xpdr_sl70r::handleReplyCountMsg(const unsigned char *msg) {
+  fixedDec<4>(&msg[4], replyCount);
+}
+
+// "^C1 mmm ff t": micro and FPGA software versions, transponder mode
+void xpdr_sl70r::handleSoftwareVersionMsg(const unsigned char *msg) {
+  char *p = softwareVersion;
+  p = putChars(p, "Micro SW ver ", 13);
+  p = putChars(p, &msg[4], 3);
+  p = putChars(p, " FPGA SW ver ", 13);
+  p = putChars(p, &msg[8], 2);
+  p = putChars(p, " Mode ", 6);
+  p = putChars(p, &msg[10], 1);
+  p = putChars(p, " Transponder", 13); // With its '\0'
 }
 
 
-void xpdr_sl70r::handleAltHoldMsg(char *msg) {
-  if (DEBUG) printf("RECEIVED ALT HOLD MSG: %17s\n", msg);
+void xpdr_sl70r::handleAltHoldMsg(const unsigned char *) {
   // TODO: figure out format for this msg type (not listed in manual?)
   // "^AH -+00000,03DE" is a captured msg example - what do these indicate?
 }
 
+
+void xpdr_sl70r::printMessage(int msgType, const unsigned char *msg, int len) {
+  printf("RECEIVED MSG: %.*s\n", len, (const char *)msg);
+  switch (msgType) {
+  case ALT_MSG:
+    if (errorHardwareBad) printf("ERROR: POSSIBLE HARDWARE PROB\n");
+    else if (errorAltOutOfRange) printf("ERROR: SQUAWK_ALT_FL OUT OF RANGE\n");
+    else printf("SQUAWK_ALT_FL=: %d\n", squawkAltFlLvl);
+    break;
+  case STATUS_MSG:
+    printf("RECEIVED STATUS BYTES: %X\n", status2Bytes);
+    for (int b = 0; b < XPDR_STATUS_BITS; b++) {
+      if (statusFaults & (1 << b)) printf("STATUS FAULT: %s\n", statusFaultName(b));
+    }
+    break;
+  case MODE_MSG:
+    printf("MODE_CHAR=%c  IDENT_CHAR=%c  SQUAWK_RECV=%04d\n", modeCharReceive, identCharReceive, squawkCodeReceive);
+    break;
+  case REPLYCNT_MSG:
+    printf("REPLY_CNT=%d\n", replyCount);
+    break;
+  case CONF_MSG:
+    printf("RECEIVED SW VER MSG: %s\n", softwareVersion);
+    break;
+  }
+}
+
 void xpdr_sl70r::sendMsgToUnit(char *msg, int numChars) {
-  // TODO: where to catch exception from write???
   char msgTmp[64];
-  unsigned short checksum = calculateChecksum(msg, 0, numChars-1);
-  char hexTmp[4];
-  sprintf(hexTmp, "%02X", checksum);
   memcpy(msgTmp, msg, numChars);
-  memcpy(&msgTmp[numChars], hexTmp, 2);
+  checksum<sum8_hex>::Put((unsigned char *)msgTmp, 0, numChars-1, numChars);
   msgTmp[numChars+2] = '\r'; // All msgs are terminated with CR
-  int numWrote = serialPtr->writePort(msg, numChars+3);
-  if (DEBUG) printf("sendMsgToUnit string=%s bytes_wrote=%d\n", msgTmp, numWrote);
+  msgTmp[numChars+3] = '\0';
+  int numQueued = serialPtr->writePort(msgTmp, numChars+3);
+  if (DEBUG) printf("sendMsgToUnit string=%s bytes_queued=%d\n", msgTmp, numQueued);
 }
 
 void xpdr_sl70r::resetUnit() {
@@ -255,36 +310,12 @@ void xpdr_sl70r::setAltitude(int altFeet, int degCels) {
 }
 
 
-bool xpdr_sl70r::checksumOk(char *msg, 
-			    int msgStartIdx, 
-			    int msgStopIdx, 
-			    int checksumIdx) {
-  char tmp[32];
-  sprintf(tmp, "0X%c%c", msg[checksumIdx], msg[checksumIdx+1]);
-  unsigned short sentChecksum = 0;
-  sscanf(tmp, "%x", &sentChecksum);
- 
-  unsigned short calcChecksum = calculateChecksum(msg, msgStartIdx, msgStopIdx);
-  if (calcChecksum != sentChecksum) {
-    if (DEBUG) printf("BAD CHECKSUM sent:calc  %2X:%2X\n", sentChecksum, calcChecksum);
-    return FALSE;
-  }
-  return TRUE;
-}
-
-
-// TODO: Need to refactor and move to serial class?
-// I didn't use the serial class' checksum method because
-// here they use checksums that aer stored in ascii-hex
+// 8 bit sum of the message; sent as two ascii-hex digits (sum8_hex)
 unsigned short xpdr_sl70r::calculateChecksum(char *msgPtr, 
 					     int msgStartIdx,
 					     int msgStopIdx) {
-  unsigned short checksum = 0;
-  for (int i=msgStartIdx; i<=msgStopIdx; i++) {
-    checksum += msgPtr[i];
-    //if (DEBUG) printf("<<<%d:%d:%d:%02X>>>\n",i,msgPtr[i], checksum, checksum);
-  }
-  checksum = checksum & 0xFF; // i.e only a one-byte checksum
+  unsigned short checksum = byteSum((unsigned char *)&msgPtr[msgStartIdx],
+				     msgStopIdx - msgStartIdx + 1) & 0xFF; // i.e only a one-byte checksum
   if (DEBUG) printf("FINAL<<<%d:%02X>>>\n",checksum, checksum);
   return checksum;
 }
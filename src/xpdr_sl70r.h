@@ -22,6 +22,9 @@
 
 #define XPDR_SAMPLE_PERIOD  1000000 // Once a sec
 
+#define XPDR_STATUS_BITS    16      // Width of the ^SS status word
+#define XPDR_STATUS_KNOWN   0x7FFF  // Status bits that report something
+
 class xpdr_sl70r {
     // Members
     public:
@@ -34,6 +37,7 @@ class xpdr_sl70r {
 	int  squawkCodeReceive;
 	int  replyCount;
 	char softwareVersion[80];
+	unsigned short statusFaults; // Bit n set if status bit n reports a fault
     protected:
         serial *serialPtr;
         int altFt;
@@ -58,9 +62,21 @@ class xpdr_sl70r {
         Sample(void);
 
         xpdr_sl70r(const char *port);
+
+        /**
+         * Recognize
+         * DESCRIPTION:     Counts the transponder's messages with good hex
+         *                  checksums in bytes heard on a port (see
+         *                  port_detect.h)
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: covered is the number of bytes in those messages
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	static int      // Good messages found
+	  Recognize(const unsigned char *buf, int len, int &covered);
 	void sendMsgToUnit(char *msg, int numChars);
 	unsigned short calculateChecksum(char *ptr, int startIdx, int stopIdx);
-	bool  checksumOk(char *msg, int startIdx, int stopIdx, int checksumIdx);
 	void resetUnit(void);
 	
 	void setAltitude(int altFeet, int degC);
@@ -71,6 +87,17 @@ class xpdr_sl70r {
 	void disableIdent();
 	void setSquawk(int squawkInt);
 	void setSquawk(char *squawkStr);
+
+        /**
+         * statusFaultName
+         * DESCRIPTION:     What status bit "bit" (as in statusFaults) reports
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+	static const char *    // NULL for a bit that reports nothing
+	  statusFaultName(int bit);
     protected:   
         /**
          * initialize
@@ -93,17 +120,20 @@ class xpdr_sl70r {
 	//void parseDataFrame(unsigned char *framePtr);
 	void setMode(void);
 
-	void parseMessage(char *);
+	void parseMessage(int msgType, const unsigned char *msg, int len);
+
+	void handleAltMsg(const unsigned char *msg);
 
-	void handleAltMsg(char *msg);
+	void handleStatusMsg(const unsigned char *msg);
 
-	void handleStatusMsg(char *msg);
+	void handleModeMsg(const unsigned char *msg);
 
-	void handleModeMsg(char *msg);
+	void handleReplyCountMsg(const unsigned char *msg);
 
-	void handleReplyCountMsg(char *msg);
+	void handleSoftwareVersionMsg(const unsigned char *msg);
 
-	void handleSoftwareVersionMsg(char *msg);
+	void handleAltHoldMsg(const unsigned char *msg);
 
-	void handleAltHoldMsg(char *msg);
+	// What the message just handled set (debugging only)
+	void printMessage(int msgType, const unsigned char *msg, int len);
 };
@@ -0,0 +1,347 @@
+// xplane_ingest.cpp: Receives X-Plane's DATA packets inside the EFIS process
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "exceptions.h"
+#include "constants.h"
+#include "utilities.h"
+#include "xplane_interface.h"
+#include "xplane_ingest.h"
+
+xplane_ingest  *TheXPlane = NULL;
+
+// Which instrument takes each record type. The order within an instrument
+// is the order of its records in the slot. XPT_XYZ isn't here: the GPS has
+// no use for it.
+static const struct {
+    int         type;
+    int         instrument;
+} routes [] = {
+    { XPT_LAT_LONG_ALT, XPLANE_GPS },
+    { XPT_GPS,          XPLANE_GPS },
+    { XPT_ENG_THRUST,   XPLANE_AHRS },
+    { XPT_AERO_FORCE,   XPLANE_AHRS },
+    { XPT_ANG_VEL,      XPLANE_AHRS },
+    { XPT_PRH,          XPLANE_AHRS },
+    { XPT_SPEED_VSI,    XPLANE_AIRSPEED },
+    { XPT_NAV_DEFLECT,  XPLANE_NAV }
+};
+
+// routes, indexed by record type
+static struct {
+    signed char instrument;     // -1 for types nobody takes
+    signed char record;         // Position in the instrument's slot
+    signed char stat;           // Position in portStats::framesByType
+} routeOf [XPLANE_MAX_TYPES];
+
+
+xplane_ingest::xplane_ingest (const char *host)
+{
+    struct sockaddr_in  lcl;
+
+    memset (slots, 0, sizeof (slots));
+    memset (routeOf, -1, sizeof (routeOf));
+    peer = 0;
+    connected = FALSE;
+    stats = portStatsClaim ("xplane udp:49000");
+
+    for (unsigned i = 0; i < NELEMENTS (routes); i++)
+    {
+        int     inst = routes [i].instrument;
+        routeOf [routes [i].type].instrument = inst;
+        routeOf [routes [i].type].record = slots [inst].numRecords;
+        routeOf [routes [i].type].stat = i;
+        slots [inst].records [slots [inst].numRecords++].type = routes [i].type;
+        stats->typeIds [i] = routes [i].type;
+    }
+    __atomic_store_n (&stats->numTypes, NELEMENTS (routes), __ATOMIC_RELEASE);
+
+    fd = socket (PF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        perror ("xplane_ingest: socket");
+        ThrowException (errno);
+    }
+    memset (&lcl, 0, sizeof (lcl));
+    lcl.sin_family = AF_INET;
+    lcl.sin_port = htons (XPLANE_DATA_PORT);
+    lcl.sin_addr.s_addr = htonl (INADDR_ANY);
+    if (bind (fd, (struct sockaddr*) &lcl, sizeof (lcl)) == -1)
+    {
+        perror ("xplane_ingest: bind");
+        ThrowException (errno);
+    }
+
+    if (host != NULL)
+    {
+        struct sockaddr_in  xpl;
+
+        memset (&xpl, 0, sizeof (xpl));
+        xpl.sin_family = AF_INET;
+        xpl.sin_port = htons (XPLANE_DATA_PORT);
+        if (inet_aton (host, &xpl.sin_addr) == 0)
+        {
+            struct hostent  *h = gethostbyname (host);
+            // Not a numbers and dots address. Must be a name
+            if (h == NULL)
+            {
+                fprintf (stderr, "xplane_ingest: Invalid host %s\n", host);
+                ThrowException (EINVAL);
+            }
+            memcpy (&xpl.sin_addr, h->h_addr_list[0], sizeof (xpl.sin_addr));
+        }
+        if (connect (fd, (struct sockaddr*) &xpl, sizeof (xpl)) == -1)
+        {
+            perror ("xplane_ingest: connect");
+            ThrowException (errno);
+        }
+        connected = TRUE;
+    }
+    fcntl (fd, F_SETFL, O_NONBLOCK);
+
+    int on = 1;
+    if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof (on)) == -1)
+        perror ("xplane_ingest: SO_TIMESTAMPNS");
+
+    for (int i = 0; i < XPLANE_BATCH; i++)
+    {
+        iovs [i].iov_base = bufs [i];
+        iovs [i].iov_len = sizeof (bufs [i]);
+        memset (&msgs [i], 0, sizeof (msgs [i]));
+        msgs [i].msg_hdr.msg_iov = &iovs [i];
+        msgs [i].msg_hdr.msg_iovlen = 1;
+    }
+
+    if (TheReactor != NULL)
+        TheReactor->Add (this);
+}
+
+
+xplane_ingest::~xplane_ingest ()
+{
+    if (Reactor () != NULL)
+        Reactor ()->Remove (this);
+    close (fd);
+    portStatsRelease (stats);
+}
+
+
+void xplane_ingest::ReactorReadable (void)
+{
+    Receive ();
+}
+
+
+// Takes everything waiting at the socket, XPLANE_BATCH packets per system call
+void xplane_ingest::Receive (void)
+{
+    while (1)
+    {
+        for (int i = 0; i < XPLANE_BATCH; i++)
+        {
+            msgs [i].msg_hdr.msg_name = &from [i];
+            msgs [i].msg_hdr.msg_namelen = sizeof (from [i]);
+            msgs [i].msg_hdr.msg_control = controls [i];
+            msgs [i].msg_hdr.msg_controllen = sizeof (controls [i]);
+        }
+        int got = recvmmsg (fd, msgs, XPLANE_BATCH, MSG_DONTWAIT, NULL);
+        if (got <= 0)
+            return;
+
+        for (int i = 0; i < got; i++)
+        {
+            struct msghdr  *msg = &msgs [i].msg_hdr;
+            unsigned        stamp = 0;
+
+            for (struct cmsghdr *cm = CMSG_FIRSTHDR (msg); cm != NULL; cm = CMSG_NXTHDR (msg, cm))
+            {
+                if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS)
+                {
+                    struct timespec ts;
+                    memcpy (&ts, CMSG_DATA (cm), sizeof (ts));
+                    stamp = realtime_to_monotonic_us (ts);
+                }
+            }
+            if (stamp == 0)
+                stamp = monotonic_us ();
+            statAdd (stats->bytesRead, msgs [i].msg_len);
+            statFrame (stats, stamp);
+
+            if (!connected && msg->msg_namelen == sizeof (from [i]))
+            {
+                unsigned long long addr = ((unsigned long long)ntohl (from [i].sin_addr.s_addr) << 16) |
+                                          ntohs (from [i].sin_port);
+                if (addr != peer)
+                    __atomic_store_n (&peer, addr, __ATOMIC_RELAXED);
+            }
+            Decode (bufs [i], msgs [i].msg_len, stamp);
+        }
+        if (got < XPLANE_BATCH)
+            return;
+    }
+}
+
+
+/**
+ * Decode
+ * DESCRIPTION:     Copies the records of one DATA packet into their
+ *                  instruments' slots. Each slot touched is written inside
+ *                  one sequence lock for the whole packet.
+ * PRE-CONDITIONS:  Called only from the receiving thread
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+void xplane_ingest::Decode (const unsigned char *pkt, int len, unsigned stamp)
+{
+    bool        open [XPLANE_INSTRUMENTS];
+
+    if (len < XPLANE_DATA_HDR_LEN || memcmp (pkt, "DATA", 4) != 0)
+        return;
+
+    memset (open, 0, sizeof (open));
+    for (int offset = XPLANE_DATA_HDR_LEN; offset + (int)SIZEOF_XPT_DATA <= len;
+         offset += SIZEOF_XPT_DATA)
+    {
+        int type;
+        memcpy (&type, pkt + offset, sizeof (type));
+        if (type < 0 || type >= XPLANE_MAX_TYPES || routeOf [type].instrument < 0)
+            continue;
+
+        xplane_slot    *slot = &slots [(int)routeOf [type].instrument];
+        if (!open [(int)routeOf [type].instrument])
+        {
+            open [(int)routeOf [type].instrument] = TRUE;
+            __atomic_store_n (&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence (__ATOMIC_RELEASE);
+        }
+        xplane_record  *r = &slot->records [(int)routeOf [type].record];
+        memcpy (r->value, pkt + offset + sizeof (type), sizeof (r->value));
+        r->stamp = stamp;
+        r->count++;
+        statInc (stats->framesByType [(int)routeOf [type].stat]);
+    }
+
+    for (int i = 0; i < XPLANE_INSTRUMENTS; i++)
+        if (open [i])
+            __atomic_store_n (&slots [i].seq, slots [i].seq + 1, __ATOMIC_RELEASE);
+}
+
+
+void xplane_ingest::Read (int instrument, xplane_slot &copy)
+{
+    const xplane_slot  *slot = &slots [instrument];
+    unsigned            before, after;
+
+    if (Reactor () == NULL)
+        Receive ();    // No reactor, or it dropped us
+    do
+    {
+        before = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+        memcpy (&copy, slot, sizeof (copy));
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        after = __atomic_load_n (&slot->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) != 0 || before != after);
+}
+
+
+int xplane_ingest::Send (const void *buf, int len)
+{
+    if (connected)
+        return (send (fd, buf, len, 0));
+
+    unsigned long long addr = __atomic_load_n (&peer, __ATOMIC_RELAXED);
+    if (addr == 0)
+        return (-1);
+    struct sockaddr_in  to;
+    memset (&to, 0, sizeof (to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons (addr & 0xffff);
+    to.sin_addr.s_addr = htonl ((unsigned)(addr >> 16));
+    return (sendto (fd, buf, len, 0, (struct sockaddr*) &to, sizeof (to)));
+}
+
+
+xplane_source::xplane_source (int instrument, int relayPort, const char *owner)
+{
+    this->instrument = instrument;
+    next = -1;
+    memset (seen, 0, sizeof (seen));
+    memset (&slot, 0, sizeof (slot));
+    if (TheXPlane != NULL)
+        udp = NULL;
+    else
+        udp = new udp_port (relayPort, owner);
+}
+
+
+xplane_source::~xplane_source ()
+{
+    delete udp;
+}
+
+
+int xplane_source::Fd (void) const
+{
+    return ((udp != NULL) ? udp->fd : TheXPlane->fd);
+}
+
+
+bool xplane_source::Next (int &type, const unsigned char *&record, unsigned &stamp, unsigned &n)
+{
+    if (udp != NULL)
+    {
+        // The relay sends each record on its own
+        if (udp->Receive ((char *)buf, sizeof (buf), &stamp) < (int)SIZEOF_XPT_DATA)
+            return (FALSE);
+        memcpy (&type, buf, sizeof (type));
+        record = &buf [sizeof (type)];
+        n = 1;
+        return (TRUE);
+    }
+
+    if (next == -1)
+    {
+        TheXPlane->Read (instrument, slot);
+        next = 0;
+    }
+    while (next < slot.numRecords)
+    {
+        const xplane_record    *r = &slot.records [next];
+        unsigned                fresh = r->count - seen [next];
+        seen [next++] = r->count;
+        if (fresh == 0)
+            continue;
+        type = r->type;
+        record = (const unsigned char *)r->value;
+        stamp = r->stamp;
+        n = fresh;
+        return (TRUE);
+    }
+    next = -1;
+    return (FALSE);
+}
@@ -0,0 +1,188 @@
+// xplane_ingest.h: Receives X-Plane's DATA packets inside the EFIS process
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#ifndef XPLANE_INGEST_H
+#define XPLANE_INGEST_H
+
+#include <netinet/in.h>
+
+#include "reactor.h"
+#include "udp_port.h"
+#include "port_stats.h"
+#include "wire_fields.h"
+
+// X-Plane sends its DATA packets here, and takes control records here
+#define XPLANE_DATA_PORT        49000
+#define XPLANE_DATA_HDR_LEN     6       // "DATA" and the index byte, padded
+
+// Packets taken per recvmmsg
+#define XPLANE_BATCH            8
+
+// Record types are looked up in a table this long (XPT_GPS is the highest
+// any instrument takes)
+#define XPLANE_MAX_TYPES        128
+
+// The instruments the records are for. Each has one slot.
+enum {
+    XPLANE_GPS = 0,
+    XPLANE_AHRS,
+    XPLANE_AIRSPEED,
+    XPLANE_NAV,
+    XPLANE_INSTRUMENTS
+};
+
+// Most record types any one instrument takes (the AHRS)
+#define XPLANE_SLOT_RECORDS     4
+
+// xplane_record: The latest of one record type
+struct xplane_record {
+    int         type;           // XPT_*
+    unsigned    count;          // Records of this type received so far
+    unsigned    stamp;          // monotonic_us() arrival of the packet it came in
+    float       value [8];
+};
+
+// xplane_slot: An instrument's records. The ingest writes every record an
+// instrument takes out of one packet inside one sequence lock, so a reader
+// sees them all from the same simulator frame.
+struct xplane_slot {
+    unsigned        seq;        // Odd while the ingest is writing
+    int             numRecords;
+    xplane_record   records [XPLANE_SLOT_RECORDS];
+};
+
+// xplane_ingest class: The one socket X-Plane talks to. Each batch of
+// packets is taken with one recvmmsg, every record is routed by a table
+// indexed by its type and copied into its instrument's slot. If TheReactor
+// exists the reactor thread does the receiving; otherwise whoever reads a
+// slot receives first.
+//
+// Without it (test_avionics -relay) the xplane_interface process does the
+// routing and each instrument has its own loopback socket.
+class xplane_ingest : public reactor_client
+{
+    public:
+        int             fd;
+        portStats      *stats;          // The socket's counters (see port_stats.h)
+
+        /**
+         * xplane_ingest class constructor
+         * DESCRIPTION:     Binds XPLANE_DATA_PORT. Control records go to
+         *                  "host" if it is given, otherwise back to
+         *                  wherever the DATA packets come from.
+         * PRE-CONDITIONS:  No xplane_interface relay is running
+         * POST-CONDITIONS: Records are received from now on
+         * EXCEPTIONS THROWN:  errno if the socket can't be made or bound
+         * EXCEPTIONS HANDLED: None
+         */
+        xplane_ingest (const char *host = NULL);
+        ~xplane_ingest ();
+
+        /**
+         * Read
+         * DESCRIPTION:     A consistent copy of "instrument"'s slot
+         * PRE-CONDITIONS:  All reads are from one thread
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        void    Read (int instrument, xplane_slot &copy);
+
+        /**
+         * Send
+         * DESCRIPTION:     Sends a packet (e.g. control records) to X-Plane
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        int     // Bytes sent, or -1 if X-Plane's address isn't known yet
+            Send (const void *buf, int len);
+
+        // reactor_client interface
+        int     ReactorFd (void) const { return (fd); }
+        void    ReactorReadable (void);
+
+    protected:
+        void    Receive (void);
+        void    Decode (const unsigned char *pkt, int len, unsigned stamp);
+
+        xplane_slot     slots [XPLANE_INSTRUMENTS];
+        bool            connected;      // Host was given; send() goes there
+        unsigned long long peer;        // Address << 16 | port of the last sender, 0 if none
+
+        // recvmmsg buffers, used only by the receiving thread
+        struct mmsghdr  msgs [XPLANE_BATCH];
+        struct iovec    iovs [XPLANE_BATCH];
+        struct sockaddr_in from [XPLANE_BATCH];
+        unsigned char   bufs [XPLANE_BATCH][MAX_DATAGRAM_LEN];
+        char            controls [XPLANE_BATCH][CMSG_SPACE (sizeof (struct timespec))];
+};
+
+// xplane_source class: Where one X-Plane instrument gets its records. With
+// TheXPlane they come from its slot, otherwise from the relay's socket.
+class xplane_source
+{
+    public:
+        xplane_source (int instrument, int relayPort, const char *owner);
+        ~xplane_source ();
+
+        /**
+         * Next
+         * DESCRIPTION:     Next record that is new since it was last
+         *                  returned. "n" is how many records of its type
+         *                  arrived since then (the slot keeps only the
+         *                  latest, the relay socket gives every one).
+         *                  "record" is the record's 8 values, for
+         *                  xplaneValue.
+         * PRE-CONDITIONS:  None
+         * POST-CONDITIONS: None
+         * EXCEPTIONS THROWN:  None
+         * EXCEPTIONS HANDLED: None
+         */
+        bool    // FALSE once there are no more
+            Next (int &type, const unsigned char *&record, unsigned &stamp, unsigned &n);
+
+        // Descriptor records arrive on
+        int     Fd (void) const;
+
+    protected:
+        int             instrument;
+        udp_port       *udp;            // Relay socket, or NULL to use TheXPlane
+        xplane_slot     slot;           // Copy being handed out
+        int             next;           // Next record of it, or -1 for a fresh copy
+        unsigned        seen [XPLANE_SLOT_RECORDS];
+        unsigned char   buf [MAX_DATAGRAM_LEN];
+};
+
+/**
+ * xplaneValue
+ * DESCRIPTION:     Value k (0 - 7) of a record Next handed out. Records sit
+ *                  at any alignment in the packet, so they are read as bytes.
+ * PRE-CONDITIONS:  None
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static inline float xplaneValue (const unsigned char *record, int k)
+{
+    return (wireGet<float, WIRE_HOST> (&record [k * sizeof (float)]));
+}
+
+extern xplane_ingest   *TheXPlane;
+
+#endif /* XPLANE_INGEST_H */
@@ -1,5 +1,8 @@
 // xplane_interface.c: The interface to the X-Plane flight simulator
 //                     for testing.
+//                     test_avionics receives X-Plane's packets itself (see
+//                     xplane_ingest.h); this relay is only needed when it
+//                     is run with -relay.
 //
 //  This program is free software; you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
@@ -153,7 +156,6 @@ int main (int argc, char *argv[])
                         break;
                     case XPT_LAT_LONG_ALT:
                     case XPT_GPS:
-                    case XPT_XYZ:
                         to = &gps;
                         break;
                     case XPT_NAV_DEFLECT:
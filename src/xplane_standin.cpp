@@ -0,0 +1,321 @@
+// xplane_standin.cpp: Plays X-Plane for test_avionics, flying the test_aircraft model
+//
+// Sends DATA packets with the records the X-Plane instruments take, at a
+// fixed rate, and steers the model with the XPT_FLT_CONTROL records the
+// autopilot sends back. The model is stepped exactly 1 / rate seconds per
+// packet whatever the clock does, so a run is the same every time for the
+// same control inputs.
+//
+//   xplane_standin [-r rate] [-t seconds] [-i initial_conditions]
+//                  [-c course] [-l local_port] [efis_host]
+//
+// test_avionics (without -relay or a host) learns where to send its control
+// records from the packets, so run it on efis_host with nothing else on
+// port 49000. The rate goes from 20 Hz, about what X-Plane sends, to 1 kHz
+// for load testing.
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "constants.h"
+#include "exceptions.h"
+#include "xplane_interface.h"
+#include "xplane_ingest.h"
+#include "ahrs_xplane.h"
+#include "test_aircraft.h"
+
+#define STANDIN_PORT            49001   // X-Plane's own is taken by the EFIS on the same machine
+#define MIN_RATE                20
+#define MAX_RATE                1000
+#define DEFAULT_RATE            XP_FRAME_RATE
+
+#define MAX_DEFLECTION          (20 * M_PI / 180)       // Control surfaces at full yoke
+#define CDI_DEGREES_PER_DOT     2.0
+#define CDI_FULL_SCALE          2.5     // Dots
+#define THRUST_AT_FULL_POWER    800     // lbf, at CRUISE_SPEED
+#define FPM_PER_FPS             60
+
+struct standinCounts {
+    unsigned    sent;           // DATA packets
+    unsigned    sendErrors;
+    unsigned    controls;       // XPT_FLT_CONTROL records taken
+    unsigned    controlsLost;   // By the gaps in the control packets' sequence
+    int         lastSequence;   // Byte 4 of the last control packet, -1 before one
+    unsigned    late;           // Ticks that started after their deadline
+};
+
+
+// One record of a DATA packet
+static int putRecord (unsigned char *pkt, int len, int type, const float *values)
+{
+    memcpy (&pkt [len], &type, sizeof (type));
+    memcpy (&pkt [len + sizeof (type)], values, 8 * sizeof (float));
+    return (len + SIZEOF_XPT_DATA);
+}
+
+
+/**
+ * buildPacket
+ * DESCRIPTION:     A DATA packet with the aircraft's state, in the rows and
+ *                  units the X-Plane instruments read
+ * PRE-CONDITIONS:  pkt has room for MAX_DATAGRAM_LEN bytes
+ * POST-CONDITIONS: None
+ * EXCEPTIONS THROWN:  None
+ * EXCEPTIONS HANDLED: None
+ */
+static int      // Packet length
+    buildPacket (unsigned char *pkt, const aircraft &ac, float course)
+{
+    float   v [8];
+    int     len;
+
+    memcpy (pkt, "DATA@", 5);
+    pkt [5] = 0;
+    len = XPLANE_DATA_HDR_LEN;
+
+    // Airspeed, vertical speed and ground speed
+    memset (v, 0, sizeof (v));
+    v [0] = v [1] = ac.airspeed;
+    v [2] = ac.airspeed * (1 + ac.altitude / 1000 * 0.02);
+    v [3] = v [6] = ac.ground_speed;
+    v [4] = ac.daltitude * FPM_PER_FPS;
+    len = putRecord (pkt, len, XPT_SPEED_VSI, v);
+
+    // Thrust to hold the speed it is flying at
+    memset (v, 0, sizeof (v));
+    v [0] = THRUST_AT_FULL_POWER * ac.airspeed / CRUISE_SPEED;
+    len = putRecord (pkt, len, XPT_ENG_THRUST, v);
+
+    // Lift carries the weight, and the load factor in a turn
+    memset (v, 0, sizeof (v));
+    v [0] = 9.8 * AIRCRAFT_WEIGHT / NEWTON_PER_LBF / cos (ac.roll_angle);
+    v [1] = v [0] / 10;
+    len = putRecord (pkt, len, XPT_AERO_FORCE, v);
+
+    memset (v, 0, sizeof (v));
+    v [0] = ac.dpitch_angle * 180 / M_PI;
+    v [1] = ac.droll_angle * 180 / M_PI;
+    v [2] = ac.dheading;
+    len = putRecord (pkt, len, XPT_ANG_VEL, v);
+
+    memset (v, 0, sizeof (v));
+    v [0] = ac.pitch_angle * 180 / M_PI;
+    v [1] = ac.roll_angle * 180 / M_PI;
+    v [2] = v [3] = ac.heading;
+    len = putRecord (pkt, len, XPT_PRH, v);
+
+    memset (v, 0, sizeof (v));
+    v [0] = ac.lat;
+    v [1] = ac.lng;
+    v [2] = ac.altitude;
+    v [3] = ac.altitude;
+    len = putRecord (pkt, len, XPT_LAT_LONG_ALT, v);
+
+    // Needles off a localizer on "course", no glideslope
+    memset (v, 0, sizeof (v));
+    float off = fmod (ac.heading - course + 540, 360) - 180;
+    v [0] = off / CDI_DEGREES_PER_DOT;
+    if (fabs (v [0]) > CDI_FULL_SCALE)
+        v [0] = (v [0] > 0) ? CDI_FULL_SCALE : -CDI_FULL_SCALE;
+    len = putRecord (pkt, len, XPT_NAV_DEFLECT, v);
+
+    return (len);
+}
+
+
+// Takes whatever control packets have come in and moves the surfaces
+static void takeControls (int fd, aircraft &ac, standinCounts &counts)
+{
+    unsigned char   pkt [MAX_DATAGRAM_LEN];
+    int             len;
+
+    while ((len = recv (fd, pkt, sizeof (pkt), MSG_DONTWAIT)) > 0)
+    {
+        if (len < XPLANE_DATA_HDR_LEN || memcmp (pkt, "DATA", 4) != 0)
+            continue;
+        if (counts.lastSequence >= 0)
+            counts.controlsLost += (unsigned char)(pkt [4] - counts.lastSequence - 1);
+        counts.lastSequence = pkt [4];
+        for (int offset = XPLANE_DATA_HDR_LEN; offset + (int)SIZEOF_XPT_DATA <= len;
+             offset += SIZEOF_XPT_DATA)
+        {
+            int type;
+            memcpy (&type, &pkt [offset], sizeof (type));
+            if (type != XPT_FLT_CONTROL)
+                continue;
+            const unsigned char *record = &pkt [offset + sizeof (type)];
+            ac.SetElevator (xplaneValue (record, 0) * MAX_DEFLECTION);
+            ac.SetAilerons (xplaneValue (record, 1) * MAX_DEFLECTION);
+            ac.SetRudder (xplaneValue (record, 2) * MAX_DEFLECTION);
+            counts.controls++;
+        }
+    }
+}
+
+
+static void addNsecs (struct timespec &t, long nsecs)
+{
+    t.tv_nsec += nsecs;
+    while (t.tv_nsec >= 1000000000)
+    {
+        t.tv_nsec -= 1000000000;
+        t.tv_sec++;
+    }
+}
+
+
+static int usage (void)
+{
+    fprintf (stderr, "Usage: xplane_standin [-r rate (%d - %d)] [-t seconds] [-i initial_conditions]\n"
+                     "                      [-c course] [-l local_port] [efis_host]\n",
+             MIN_RATE, MAX_RATE);
+    return (-1);
+}
+
+
+int main (int argc, char *argv[])
+{
+    int                 rate = DEFAULT_RATE;
+    double              seconds = 0;            // 0 runs until killed
+    const char         *conditions = NULL;
+    const char         *host = "127.0.0.1";
+    int                 localPort = STANDIN_PORT;
+    float               course = -1;
+    int                 opt;
+
+    while ((opt = getopt (argc, argv, "r:t:i:c:l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': rate = atoi (optarg); break;
+            case 't': seconds = atof (optarg); break;
+            case 'i': conditions = optarg; break;
+            case 'c': course = atof (optarg); break;
+            case 'l': localPort = atoi (optarg); break;
+            default: return (usage ());
+        }
+    }
+    if (optind < argc)
+        host = argv [optind++];
+    if (optind != argc || rate < MIN_RATE || rate > MAX_RATE)
+        return (usage ());
+
+    aircraft            ac;
+    try {
+        if (conditions != NULL)
+        {
+            SyntaxError *se = ac.ReadInitialConditions (conditions);
+            if (se != NULL)
+            {
+                fprintf (stderr, "Syntax error in %s, line %d: %s\n",
+                         conditions, se->line, se->errorstring);
+                delete se;
+                return (-1);
+            }
+        }
+    }
+    catch (...)
+    {
+        perror (conditions);
+        return (-1);
+    }
+    if (course < 0)
+        course = ac.heading;
+
+    struct sockaddr_in  lcl, efis;
+    memset (&efis, 0, sizeof (efis));
+    efis.sin_family = AF_INET;
+    efis.sin_port = htons (XPLANE_DATA_PORT);
+    if (inet_aton (host, &efis.sin_addr) == 0)
+    {
+        struct hostent  *h = gethostbyname (host);
+        // Not a numbers and dots address. Must be a name
+        if (h == NULL)
+        {
+            fprintf (stderr, "xplane_standin: Invalid host %s\n", host);
+            return (-1);
+        }
+        memcpy (&efis.sin_addr, h->h_addr_list[0], sizeof (efis.sin_addr));
+    }
+
+    int fd = socket (PF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        perror ("socket");
+        return (-1);
+    }
+    memset (&lcl, 0, sizeof (lcl));
+    lcl.sin_family = AF_INET;
+    lcl.sin_port = htons (localPort);
+    lcl.sin_addr.s_addr = htonl (INADDR_ANY);
+    if (bind (fd, (struct sockaddr*) &lcl, sizeof (lcl)) == -1 ||
+        connect (fd, (struct sockaddr*) &efis, sizeof (efis)) == -1)
+    {
+        perror ("xplane_standin");
+        return (-1);
+    }
+
+    standinCounts       counts;
+    unsigned char       pkt [MAX_DATAGRAM_LEN];
+    long                period = 1000000000L / rate;
+    unsigned long       ticks = (unsigned long) (seconds * rate);
+    unsigned long       perSecond = rate;   // Checked positive above
+    struct timespec     deadline, now;
+
+    memset (&counts, 0, sizeof (counts));
+    counts.lastSequence = -1;
+    printf ("xplane_standin: %d Hz to %s:%d from port %d\n", rate, host, XPLANE_DATA_PORT, localPort);
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+    for (unsigned long tick = 0; ticks == 0 || tick < ticks; tick++)
+    {
+        takeControls (fd, ac, counts);
+        ac.IncrementTime (1.0 / rate);
+        int len = buildPacket (pkt, ac, course);
+        if (send (fd, pkt, len, 0) == len)
+            counts.sent++;
+        else
+            counts.sendErrors++;
+
+        if (tick % perSecond == perSecond - 1)
+            printf ("%5lus: sent %u (%u failed), controls %u (%u lost), late %u  "
+                    "ias %.0f alt %.0f hdg %.0f pitch %.1f roll %.1f\n",
+                    (tick + 1) / perSecond, counts.sent, counts.sendErrors, counts.controls,
+                    counts.controlsLost, counts.late,
+                    ac.airspeed, ac.altitude, ac.heading,
+                    ac.pitch_angle * 180 / M_PI, ac.roll_angle * 180 / M_PI);
+
+        addNsecs (deadline, period);
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec ||
+            (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec))
+            counts.late++;
+        else
+            clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+    close (fd);
+    return (0);
+}